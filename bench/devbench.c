@@ -0,0 +1,512 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/utsname.h>
+
+#include "../second/src/second.h"
+#include "hist.h"
+
+/*
+ *globalfifo、globalmem、second统一的吞吐/延迟测试工具
+ *每次运行一个负载，结果以一行JSON输出，便于脚本收集并与历史结果比较。负载:
+ *  fifo       每对线程中一个写者、一个读者，经同一个globalfifo设备传输，按读者收到的字节统计吞吐
+ *  mem-read   每个线程在globalmem设备上自己的区域内循环pread
+ *  mem-write  每个线程在globalmem设备上自己的区域内循环pwrite
+ *  second     每个线程打开一个second设备，以给定周期读取事件记录，延迟为定时器到期到读者拿到记录的时间
+ *等待方式(-m)对fifo和second有效，globalmem的读写不会阻塞:
+ *  block      阻塞读写
+ *  nonblock   O_NONBLOCK，遇到EAGAIN立即重试(忙等)
+ *  epoll      O_NONBLOCK，遇到EAGAIN时在epoll上等待就绪
+ *fifo/mem的延迟为一次成功读写(含等待与重试)的耗时，单位纳秒。
+ *线程依次绑定到-c给出的CPU列表上(如"0-3,8")，不给出时不绑定。
+ *多个线程分布在-n个设备上: 第i个线程(对)使用次设备i % n，设备文件名默认为/dev/<驱动>_%d(second的次设备0为/dev/second)，
+ *可用-f更改。
+ *
+ *用法: devbench -w 负载 [-t 线程数(对数)] [-s 单次长度] [-d 秒数] [-m block|nonblock|epoll]
+ *               [-c CPU列表] [-n 设备数] [-f 设备文件名格式] [-P second周期(纳秒)] [-l 标签] [-o 输出文件(追加)]
+ */
+
+#define MAX_THREADS     256
+#define MAX_CPUS        1024
+#define BATCH_EVENTS    256
+
+enum workload { W_FIFO, W_MEM_READ, W_MEM_WRITE, W_SECOND };
+enum mode { M_BLOCK, M_NONBLOCK, M_EPOLL };
+
+static const char *workload_names[] = { "fifo", "mem-read", "mem-write", "second" };
+static const char *mode_names[] = { "block", "nonblock", "epoll" };
+static const char *dev_formats[] = { "/dev/globalfifo_%d", "/dev/globalmem_%d", "/dev/globalmem_%d", "/dev/second_%d" };
+
+struct worker {
+    pthread_t tid;
+    int index;
+    int cpu;
+    int fd;
+    int writer;                 /*fifo: 写者为1，读者为0*/
+    volatile int done;
+    unsigned long long ops;
+    unsigned long long bytes;
+    unsigned long long retries; /*nonblock/epoll: 遇到EAGAIN的次数*/
+    struct hist hist;
+};
+
+static enum workload workload = W_FIFO;
+static enum mode mode = M_BLOCK;
+static int nthreads = 1;
+static size_t msg_size = 64;
+static double duration = 5.0;
+static int ndevices = 1;
+static uint64_t period = 100000;
+static const char *label = "";
+static const char *output;
+static const char *dev_format;
+static int cpus[MAX_CPUS];
+static int ncpus;
+
+static volatile int stop;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ *解析"0-3,8,10-11"形式的CPU列表
+ */
+static int parse_cpus(const char *s)
+{
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+
+        if (end == s) {
+            return -1;
+        }
+        if ('-' == *end) {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s) {
+                return -1;
+            }
+        }
+        for (; lo <= hi && ncpus < MAX_CPUS; lo++) {
+            cpus[ncpus++] = lo;
+        }
+        s = end;
+        if (',' == *s) {
+            s++;
+        } else if (*s) {
+            return -1;
+        }
+    }
+    return ncpus ? 0 : -1;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0) {
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ *等待fd就绪，只在epoll模式下使用；被信号打断或停止时返回-1
+ */
+static int wait_ready(int epfd)
+{
+    struct epoll_event ev;
+
+    while (!stop) {
+        int n = epoll_wait(epfd, &ev, 1, -1);
+
+        if (n > 0) {
+            return 0;
+        }
+        if (n < 0 && EINTR != errno) {
+            perror("epoll_wait");
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static int make_epoll(int fd, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    int epfd = epoll_create1(0);
+
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+        perror("epoll");
+        return -1;
+    }
+    return epfd;
+}
+
+/*
+ *fifo与mem负载: 每次循环完成一次读或写，按模式处理EAGAIN
+ */
+static void *rw_work(void *arg)
+{
+    struct worker *w = arg;
+    char *buf = malloc(msg_size);
+    int is_write = W_MEM_WRITE == workload || (W_FIFO == workload && w->writer);
+    off_t off = (off_t)(w->index / ndevices) * msg_size;
+    int epfd = -1;
+
+    pin(w->cpu);
+    memset(buf, 'a' + w->index % 26, msg_size);
+    if (M_EPOLL == mode && W_FIFO == workload) {
+        epfd = make_epoll(w->fd, is_write ? EPOLLOUT : EPOLLIN);
+        if (epfd < 0) {
+            goto out;
+        }
+    }
+
+    while (!stop) {
+        uint64_t t0 = now_ns();
+        ssize_t ret;
+
+        for (;;) {
+            if (W_FIFO == workload) {
+                ret = is_write ? write(w->fd, buf, msg_size) : read(w->fd, buf, msg_size);
+            } else {
+                ret = is_write ? pwrite(w->fd, buf, msg_size, off) : pread(w->fd, buf, msg_size, off);
+            }
+            if (ret > 0 || stop) {
+                break;
+            }
+            if (0 == ret) {     /*区域超出了globalmem设备的大小*/
+                fprintf(stderr, "offset %lld beyond end of device\n", (long long)off);
+                stop = 1;
+                break;
+            }
+            if (ret < 0 && EINTR == errno) {
+                continue;
+            }
+            if (ret < 0 && EAGAIN == errno) {
+                w->retries++;
+                if (M_EPOLL == mode && wait_ready(epfd)) {
+                    break;
+                }
+                continue;
+            }
+            perror(is_write ? "write" : "read");
+            stop = 1;
+            break;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        hist_record(&w->hist, now_ns() - t0);
+        w->ops++;
+        w->bytes += ret;
+    }
+
+out:
+    if (epfd >= 0) {
+        close(epfd);
+    }
+    free(buf);
+    w->done = 1;
+    return NULL;
+}
+
+/*
+ *second负载: 批量读取事件记录，每条记录的延迟为读到时刻减去其内核时间戳
+ */
+static void *second_work(void *arg)
+{
+    struct worker *w = arg;
+    struct second_event ev[BATCH_EVENTS];
+    int epfd = -1;
+
+    pin(w->cpu);
+    if (ioctl(w->fd, SECOND_IOC_SET_PERIOD, &period)) {
+        perror("SECOND_IOC_SET_PERIOD");
+        stop = 1;
+        goto out;
+    }
+    if (M_EPOLL == mode) {
+        epfd = make_epoll(w->fd, EPOLLIN);
+        if (epfd < 0) {
+            goto out;
+        }
+    }
+
+    while (!stop) {
+        ssize_t ret = read(w->fd, ev, sizeof(ev));
+        uint64_t t = now_ns();
+        long i;
+
+        if (ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EAGAIN == errno) {
+                w->retries++;
+                if (M_EPOLL == mode && wait_ready(epfd)) {
+                    break;
+                }
+                continue;
+            }
+            perror("read");
+            stop = 1;
+            break;
+        }
+        for (i = 0; i < ret / (long)sizeof(ev[0]); i++) {
+            hist_record(&w->hist, t - ev[i].ktime_ns);
+            w->ops++;
+            w->bytes += sizeof(ev[0]);
+        }
+    }
+
+out:
+    if (epfd >= 0) {
+        close(epfd);
+    }
+    w->done = 1;
+    return NULL;
+}
+
+static void wakeup_handler(int sig)
+{
+    (void)sig;  /*只用来打断阻塞中的系统调用*/
+}
+
+/*
+ *输出带引号的JSON字符串，转义引号、反斜杠和控制字符
+ */
+static void print_json_string(FILE *fp, const char *str)
+{
+    const unsigned char *p;
+
+    fputc('"', fp);
+    for (p = (const unsigned char *)str; *p; p++) {
+        if ('"' == *p || '\\' == *p) {
+            fprintf(fp, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void print_json(FILE *fp, struct worker *w, int nw, double elapsed)
+{
+    static struct hist total;
+    unsigned long long ops = 0, bytes = 0, retries = 0;
+    struct utsname uts;
+    int i;
+
+    hist_init(&total);
+    for (i = 0; i < nw; i++) {
+        /*fifo只统计读者，一次传输对应一次读*/
+        if (W_FIFO == workload && w[i].writer) {
+            continue;
+        }
+        hist_merge(&total, &w[i].hist);
+        ops += w[i].ops;
+        bytes += w[i].bytes;
+        retries += w[i].retries;
+    }
+    uname(&uts);
+
+    /*标签由用户给出，内核版本号理论上也可以包含任意字符，都要转义*/
+    fprintf(fp, "{\"label\":");
+    print_json_string(fp, label);
+    fprintf(fp, ",\"kernel\":");
+    print_json_string(fp, uts.release);
+    fprintf(fp, ",\"workload\":\"%s\",\"mode\":\"%s\",\"threads\":%d,\"devices\":%d,\"msg_size\":%zu,",
+            workload_names[workload], mode_names[mode], nthreads, ndevices,
+            W_SECOND == workload ? sizeof(struct second_event) : msg_size);
+    if (W_SECOND == workload) {
+        fprintf(fp, "\"period_ns\":%llu,", (unsigned long long)period);
+    }
+    fprintf(fp, "\"duration_s\":%.3f,\"ops\":%llu,\"ops_per_sec\":%.1f,\"mb_per_sec\":%.3f,\"retries\":%llu,"
+            "\"latency_ns\":", elapsed, ops, ops / elapsed, bytes / elapsed / 1e6, retries);
+    hist_print_json(fp, &total);
+    fprintf(fp, ",\"per_thread\":[");
+    for (i = 0; i < nw; i++) {
+        fprintf(fp, "%s{\"index\":%d,\"role\":\"%s\",\"cpu\":%d,\"ops\":%llu,\"p99_ns\":%llu}", i ? "," : "",
+                w[i].index, W_FIFO == workload ? (w[i].writer ? "writer" : "reader") : workload_names[workload],
+                w[i].cpu, w[i].ops, (unsigned long long)hist_percentile(&w[i].hist, 99));
+    }
+    fprintf(fp, "]}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -w fifo|mem-read|mem-write|second [-t threads] [-s size] [-d seconds]\n"
+            "          [-m block|nonblock|epoll] [-c cpulist] [-n devices] [-f path_format] [-P period_ns]\n"
+            "          [-l label] [-o file]\n",
+            prog);
+    exit(1);
+}
+
+static int lookup(const char *s, const char **names, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (0 == strcmp(s, names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct worker w[MAX_THREADS * 2];
+    struct sigaction sa;
+    FILE *fp = stdout;
+    uint64_t start;
+    double elapsed;
+    int opt, nw, i;
+
+    while ((opt = getopt(argc, argv, "w:t:s:d:m:c:n:f:P:l:o:")) != -1) {
+        switch (opt) {
+        case 'w':
+            i = lookup(optarg, workload_names, 4);
+            if (i < 0) {
+                usage(argv[0]);
+            }
+            workload = i;
+            break;
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 's':
+            msg_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'm':
+            i = lookup(optarg, mode_names, 3);
+            if (i < 0) {
+                usage(argv[0]);
+            }
+            mode = i;
+            break;
+        case 'c':
+            if (parse_cpus(optarg)) {
+                usage(argv[0]);
+            }
+            break;
+        case 'n':
+            ndevices = atoi(optarg);
+            break;
+        case 'f':
+            dev_format = optarg;
+            break;
+        case 'P':
+            period = strtoull(optarg, NULL, 0);
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (nthreads < 1 || nthreads > MAX_THREADS || 0 == msg_size || ndevices < 1 || duration <= 0) {
+        usage(argv[0]);
+    }
+
+    /*不带SA_RESTART的空处理函数: 结束时用信号把阻塞在read/write中的线程叫醒*/
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = wakeup_handler;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (NULL == dev_format) {
+        dev_format = dev_formats[workload];
+    }
+    nw = W_FIFO == workload ? nthreads * 2 : nthreads;
+    for (i = 0; i < nw; i++) {
+        char path[256];
+        int flags;
+
+        w[i].index = W_FIFO == workload ? i / 2 : i;
+        w[i].writer = W_FIFO == workload && 0 == i % 2;
+        w[i].cpu = ncpus ? cpus[i % ncpus] : -1;
+        hist_init(&w[i].hist);
+
+        if (W_SECOND == workload && dev_format == dev_formats[W_SECOND] && 0 == w[i].index % ndevices) {
+            snprintf(path, sizeof(path), "/dev/second");
+        } else {
+            snprintf(path, sizeof(path), dev_format, w[i].index % ndevices);
+        }
+        if (W_FIFO == workload) {
+            flags = w[i].writer ? O_WRONLY : O_RDONLY;
+        } else {
+            flags = W_MEM_WRITE == workload ? O_WRONLY : O_RDONLY;
+        }
+        if (M_BLOCK != mode && (W_FIFO == workload || W_SECOND == workload)) {
+            flags |= O_NONBLOCK;
+        }
+        w[i].fd = open(path, flags);
+        if (-1 == w[i].fd) {
+            fprintf(stderr, "open device file %s error: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+
+    start = now_ns();
+    for (i = 0; i < nw; i++) {
+        pthread_create(&w[i].tid, NULL, W_SECOND == workload ? second_work : rw_work, &w[i]);
+    }
+    while (!stop && now_ns() - start < duration * 1e9) {
+        usleep(10000);
+    }
+    stop = 1;
+    elapsed = (now_ns() - start) / 1e9;
+
+    /*阻塞中的线程收到信号后从系统调用返回EINTR，看到stop后退出；信号可能早于系统调用到达，因此重复发送*/
+    for (i = 0; i < nw; i++) {
+        while (!w[i].done) {
+            pthread_kill(w[i].tid, SIGUSR1);
+            usleep(1000);
+        }
+        pthread_join(w[i].tid, NULL);
+        close(w[i].fd);
+    }
+
+    if (output) {
+        fp = fopen(output, "a");
+        if (NULL == fp) {
+            perror(output);
+            return 1;
+        }
+    }
+    print_json(fp, w, nw, elapsed);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    return 0;
+}
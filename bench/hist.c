@@ -0,0 +1,104 @@
+#include <string.h>
+#include "hist.h"
+
+static int hist_index(uint64_t value)
+{
+    int msb, shift;
+
+    if (value < HIST_SUB_COUNT) {
+        return value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - (HIST_SUB_BITS - 1);      /*保留最高的HIST_SUB_BITS - 1位作为桶内序号*/
+    return HIST_SUB_COUNT + (shift - 1) * HIST_HALF_COUNT + (int)(value >> shift) - HIST_HALF_COUNT;
+}
+
+/*
+ *桶内的最大值，百分位按桶的上界报告，与HdrHistogram的highestEquivalentValue一致
+ */
+static uint64_t hist_value(int index)
+{
+    int shift;
+    uint64_t mantissa;
+
+    if (index < HIST_SUB_COUNT) {
+        return index;
+    }
+    shift = (index - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+    mantissa = (index - HIST_SUB_COUNT) % HIST_HALF_COUNT + HIST_HALF_COUNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void hist_init(struct hist *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(struct hist *h, uint64_t value)
+{
+    h->buckets[hist_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t hist_percentile(const struct hist *h, double percentile)
+{
+    uint64_t want, seen = 0;
+    int i;
+
+    if (0 == h->count) {
+        return 0;
+    }
+    want = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+    if (want < 1) {
+        want = 1;
+    }
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= want) {
+            uint64_t v = hist_value(i);
+
+            return v < h->max ? v : h->max;     /*不超过实际记录到的最大值*/
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const struct hist *h)
+{
+    return h->count ? h->sum / h->count : 0;
+}
+
+void hist_print_json(FILE *fp, const struct hist *h)
+{
+    fprintf(fp, "{\"count\":%llu,\"min\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+            "\"p99.9\":%llu,\"p99.99\":%llu,\"max\":%llu}",
+            (unsigned long long)h->count, (unsigned long long)(h->count ? h->min : 0), hist_mean(h),
+            (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 90),
+            (unsigned long long)hist_percentile(h, 99), (unsigned long long)hist_percentile(h, 99.9),
+            (unsigned long long)hist_percentile(h, 99.99), (unsigned long long)h->max);
+}
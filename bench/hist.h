@@ -0,0 +1,36 @@
+#ifndef _HIST_H
+#define _HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ *对数-线性延迟直方图(与HdrHistogram的分桶方式相同，精度2位有效数字)
+ *小于128的值每个值一个桶；之后每个2的幂区间[2^k, 2^(k+1))均分为64个桶，
+ *相对误差不超过1/64，覆盖整个uint64_t范围，记录一个值只需一次计数，合并只需逐桶相加。
+ */
+#define HIST_SUB_BITS   7
+#define HIST_SUB_COUNT  (1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)
+#define HIST_BUCKETS    (HIST_SUB_COUNT + (64 - HIST_SUB_BITS) * HIST_HALF_COUNT)
+
+struct hist {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+void hist_init(struct hist *h);
+void hist_record(struct hist *h, uint64_t value);
+void hist_merge(struct hist *dst, const struct hist *src);
+uint64_t hist_percentile(const struct hist *h, double percentile);
+double hist_mean(const struct hist *h);
+
+/*
+ *以JSON对象输出: {"count":..,"min":..,"mean":..,"p50":..,"p90":..,"p99":..,"p99.9":..,"p99.99":..,"max":..}
+ */
+void hist_print_json(FILE *fp, const struct hist *h);
+
+#endif /* _HIST_H */
@@ -14,108 +14,1494 @@
 #include <linux/uaccess.h>
 #include <linux/device.h>
 #include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/rcupdate.h>
+#include <linux/log2.h>
+#include <linux/topology.h>
+#include <linux/cpumask.h>
+#include <linux/uio.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/percpu.h>
 
-#define GLOBALFIFO_SIZE			0x1000  /*全局内存大小，用于模拟读写操作的内存区域*/
+#include "globalfifo.h"
+
+#define CREATE_TRACE_POINTS
+#include "globalfifo_trace.h"
+
+#define GLOBALFIFO_SIZE			0x1000  /*默认的FIFO容量*/
+#define GLOBALFIFO_MIN_SIZE     PAGE_SIZE   /*FIFO容量下限*/
+#define GLOBALFIFO_MAX_SIZE     (1U << 30)  /*FIFO容量上限，head/tail为32位自由递增下标，容量不能超过2^31*/
+#define GLOBALFIFO_MQ_SIZE      0x10000 /*多队列模式下每个CPU子环的默认容量*/
+#define GLOBALFIFO_CTRL_SIZE    PAGE_SIZE   /*mmap映射中位于数据区之前的控制页*/
 #define MEM_CLEAR				0x1     /*ioctl操作命令                      */
 #define GLOBALFIFO_MAJOR		230     /*主设备号                           */
 #define DEVICE_NUM              10      /*设备数目                           */
 
-static int globalfifo_major = GLOBALFIFO_MAJOR;
-module_param(globalfifo_major, int, S_IRUGO);    /*声明insmod时的参数*/
+static int globalfifo_major = GLOBALFIFO_MAJOR;
+module_param(globalfifo_major, int, S_IRUGO);    /*声明insmod时的参数*/
+
+static bool globalfifo_spsc;
+module_param(globalfifo_spsc, bool, S_IRUGO);    /*加载时即为所有设备开启SPSC模式*/
+
+static unsigned int globalfifo_size = GLOBALFIFO_SIZE;
+module_param(globalfifo_size, uint, S_IRUGO);    /*每个设备的初始容量，不足一页按一页，向上取整为2的幂*/
+
+static int globalfifo_mq;
+module_param(globalfifo_mq, int, S_IRUGO);      /*加载时即为所有设备开启多队列模式，取值为GLOBALFIFO_MQ_*之一*/
+
+static unsigned int globalfifo_mq_size = GLOBALFIFO_MQ_SIZE;
+module_param(globalfifo_mq_size, uint, S_IRUGO);    /*多队列模式下每个CPU子环的容量，不足一页按一页，向上取整为2的幂*/
+
+/*
+ *globalfifo_dev.flags中的位
+ *读端(修改tail)和写端(修改head)各自需要互斥，用这两个位作为轻量的单端锁，
+ *SPSC模式下只有一个读者和一个写者，这两个位永远不会发生竞争
+ */
+#define GLOBALFIFO_RD_BUSY      0
+#define GLOBALFIFO_WR_BUSY      1
+
+/*
+ *数据报模式下每条记录的格式: 4字节长度头 + 数据，整体按4字节对齐，记录在环中首尾相接存放。
+ *切换到数据报模式时下标复位为0，容量是4的倍数，长度头永远不会跨越缓冲区末尾
+ */
+#define GLOBALFIFO_DGRAM_HDR    sizeof(u32)
+#define GLOBALFIFO_RECORD_SIZE(len)     ALIGN(GLOBALFIFO_DGRAM_HDR + (len), GLOBALFIFO_DGRAM_HDR)
+
+/*
+ *多队列模式下子环中每条记录的头，记录按头的大小对齐，子环容量是它的倍数，头永远不会跨越缓冲区末尾
+ *时间戳在写者持有子环锁时读取，同一子环内的记录时间戳单调不减
+ */
+struct globalfifo_mq_hdr {
+    u32 len;                            /*数据长度*/
+    u32 pad;
+    u64 stamp;                          /*发布时的ktime_get_ns()*/
+};
+
+#define GLOBALFIFO_MQ_HDR       sizeof(struct globalfifo_mq_hdr)
+#define GLOBALFIFO_MQ_RECORD_SIZE(len)  ALIGN(GLOBALFIFO_MQ_HDR + (len), GLOBALFIFO_MQ_HDR)
+
+/*
+ *读写路径内部使用，不会返回给用户: 取得锁或被唤醒后发现多队列模式已被切换，
+ *当前路径对应的环不再有读写者，需要回到read_iter/write_iter按新的模式重新选择路径
+ */
+#define GLOBALFIFO_EMODE        ESTALE
+
+/*
+ *每CPU统计计数，数组下标为GLOBALFIFO_STAT_READ/GLOBALFIFO_STAT_WRITE
+ *读写路径上只对本CPU的计数做无锁加法，不产生跨CPU的cache line争用，读取sysfs属性时再对所有CPU求和
+ */
+#define GLOBALFIFO_STAT_READ    0
+#define GLOBALFIFO_STAT_WRITE   1
+
+struct globalfifo_stats {
+    u64 calls[2];                       /*read/write调用次数*/
+    u64 bytes[2];                       /*成功读写的字节数*/
+    u64 blocks[2];                      /*因数据或空闲空间不足而睡眠的次数*/
+    u64 eagain[2];                      /*非阻塞读写返回EAGAIN的次数*/
+};
+
+/*
+ *环形缓冲区，控制页和数据区由vmalloc_user一次申请，可整体mmap到用户空间
+ *调整容量时整体替换，读写路径在持有单端锁期间使用，其他地方在RCU读临界区内使用
+ */
+struct globalfifo_ring {
+    struct globalfifo_ring_ctrl *ctrl;  /*控制页，head/tail保存在这里以便与用户空间共享*/
+	unsigned char *mem;                 /*数据区，紧跟在控制页之后*/
+    unsigned int size;                  /*数据区大小，2的幂；控制页中的size用户空间可写，内核不使用*/
+};
+
+/*
+ *多队列模式下每个CPU的子环，在所在CPU的节点上申请，首次在该CPU上写入时才创建，模块卸载时释放
+ *head只由本CPU的写者在持有lock时修改，tail只由持有读端锁的读者修改，两者位于不同的cache line
+ */
+struct globalfifo_mq_ring {
+    struct mutex lock;                  /*同一CPU上的写者之间互斥，复制时可能缺页，不能用自旋锁*/
+    unsigned char *mem;
+    unsigned int size;                  /*2的幂*/
+    unsigned int head;
+    unsigned int tail ____cacheline_aligned_in_smp;
+};
+
+/*
+ *设备结构体按访问频率分组: 前面是读写路径上只读或很少修改的字段，
+ *锁和等待队列在读写路径上被频繁修改，各自从新的cache line开始，
+ *避免一次加锁或唤醒使其他CPU缓存的只读字段失效。
+ *每个设备单独申请，不再与相邻设备共享cache line。
+ */
+struct globalfifo_dev {
+	struct cdev cdev;                   /*字符设备结构体*/
+    struct globalfifo_ring __rcu *ring; /*当前的环形缓冲区*/
+    int node;                           /*设备结构体和环描述符所在的NUMA节点*/
+    bool spsc;                          /*是否请求了SPSC模式*/
+    bool spsc_active;                   /*SPSC无锁路径是否生效，读者或写者多于一个时自动退回加锁路径*/
+    bool dgram;                         /*数据报模式，只在FIFO为空且没有被mmap时切换*/
+    unsigned int readers;               /*以读方式打开的文件数*/
+    unsigned int writers;               /*以写方式打开的文件数*/
+    struct fasync_struct *async_queue;  /*异步通知*/
+    struct mutex mmap_lock;             /*保护mmap_count，不能使用mutex: mmap时已持有mmap_sem，而读写路径持有mutex时可能缺页*/
+    unsigned int mmap_count;            /*映射了环形缓冲区的vma数目，存在映射时不允许调整容量和切换数据报模式*/
+    struct list_head files;             /*打开本设备的所有globalfifo_file，由mutex保护*/
+    struct globalfifo_stats __percpu *stats;    /*每CPU统计计数，通过sysfs导出*/
+    int mq;                             /*多队列模式GLOBALFIFO_MQ_*，只在FIFO为空且没有其他打开者时切换*/
+    bool mq_switching;                  /*正在切换多队列模式，子环的写者暂停发布记录，由mutex保护修改*/
+    struct globalfifo_mq_ring **mq_rings;   /*按CPU号索引的子环，未创建时为NULL*/
+
+    /*
+     *水位线，由各打开文件的设置汇总而来，由mutex保护修改:
+     *r_lowat为所有读端水位线的最小值，数据量低于它时没有读者或poll会就绪，写入后不必唤醒；
+     *w_lowat同理对应写端；flush_ns为读端最短的刷新超时，0表示不刷新
+     */
+    unsigned int r_lowat;
+    unsigned int w_lowat;
+    u64 flush_ns;
+    bool flush;                         /*刷新定时器已到期，读端暂时忽略水位线，读取后清除*/
+    struct hrtimer flush_timer;
+
+    struct mutex mutex ____cacheline_aligned_in_smp;    /*用于多用户(进程)访问时的控制，不能用自旋锁，因为读写操作中有调用可能导致阻塞的copy_to_user及copy_from_user; 只能使用互斥体*/
+    unsigned long flags;                /*GLOBALFIFO_RD_BUSY/GLOBALFIFO_WR_BUSY*/
+
+    /*多队列模式下读端的状态，由读端锁保护，与写者访问的字段分开存放*/
+    int mq_cur;                         /*第一条记录只读走一部分的子环所在的CPU，-1表示没有*/
+    unsigned int mq_off;                /*该记录已读走的字节数*/
+    unsigned int mq_next;               /*轮转模式下下一次从哪个CPU开始查找*/
+
+    wait_queue_head_t r_wait ____cacheline_aligned_in_smp;  /*定义读取等待队列头部*/
+    wait_queue_head_t w_wait ____cacheline_aligned_in_smp;  /*定义写入等待队列头部*/
+};
+
+static struct globalfifo_dev *globalfifo_devp[DEVICE_NUM];
+
+/*
+ *每次open对应的状态，保存在file->private_data中
+ */
+struct globalfifo_file {
+    struct globalfifo_dev *dev;
+    struct list_head list;              /*链入dev->files*/
+    fmode_t mode;                       /*打开方式，只有可读的文件参与读端水位线的计算，写端同理*/
+    bool atomic;                        /*整体读写: 不超过容量的读写要么全部完成，要么什么都不做*/
+    unsigned int rcvlowat;              /*读取至少等待的数据量，与SO_RCVLOWAT类似*/
+    unsigned int sndlowat;              /*写入至少等待的空闲空间*/
+    unsigned int flush_us;              /*数据低于rcvlowat时最多等待的时间，0表示一直等待*/
+};
+
+static inline struct globalfifo_dev *globalfifo_dev(struct file *filp)
+{
+    return ((struct globalfifo_file *)filp->private_data)->dev;
+}
+
+/*
+ *取得当前的环，调用者需持有任一单端锁或mmap_lock，调整容量时这些锁都会被持有，环不会被替换
+ */
+static inline struct globalfifo_ring *globalfifo_ring(struct globalfifo_dev *dev)
+{
+    return rcu_dereference_protected(dev->ring, 1);
+}
+
+/*
+ *FIFO中当前的数据长度，head/tail为自由递增的无符号数，回绕后相减结果仍然正确
+ *head由写端以release语义发布，读端以acquire语义读取，保证看到head时数据已写入缓冲区；
+ *tail同理，保证写端覆盖某段空间前读端已经读完
+ */
+static inline unsigned int globalfifo_ring_len(struct globalfifo_ring *ring)
+{
+    unsigned int len = smp_load_acquire(&ring->ctrl->head) - smp_load_acquire(&ring->ctrl->tail);
+
+    /*控制页对用户空间可写，不能信任其中的值，长度超出容量时按满处理，保证复制不会越界*/
+    return min_t(unsigned int, len, ring->size);
+}
+
+/*
+ *不持有单端锁时(poll、等待条件、门铃)通过RCU访问环，容量调整后旧的环在宽限期后才释放
+ */
+static unsigned int globalfifo_len(struct globalfifo_dev *dev)
+{
+    unsigned int len;
+
+    rcu_read_lock();
+    len = globalfifo_ring_len(rcu_dereference(dev->ring));
+    rcu_read_unlock();
+
+    return len;
+}
+
+static unsigned int globalfifo_space(struct globalfifo_dev *dev)
+{
+    struct globalfifo_ring *ring;
+    unsigned int space;
+
+    rcu_read_lock();
+    ring = rcu_dereference(dev->ring);
+    space = ring->size - globalfifo_ring_len(ring);
+    rcu_read_unlock();
+
+    return space;
+}
+
+static unsigned int globalfifo_capacity(struct globalfifo_dev *dev)
+{
+    unsigned int size;
+
+    rcu_read_lock();
+    size = rcu_dereference(dev->ring)->size;
+    rcu_read_unlock();
+
+    return size;
+}
+
+/*
+ *获取/释放单端锁，读端和写端可以同时进行
+ */
+static inline int globalfifo_side_lock(struct globalfifo_dev *dev, int bit)
+{
+    return wait_on_bit_lock(&dev->flags, bit, TASK_INTERRUPTIBLE);
+}
+
+static inline void globalfifo_side_unlock(struct globalfifo_dev *dev, int bit)
+{
+    clear_bit_unlock(bit, &dev->flags);
+    smp_mb__after_atomic();
+    wake_up_bit(&dev->flags, bit);
+}
+
+/*
+ *IOCB_NOWAIT的请求(io_uring、preadv2/pwritev2的RWF_NOWAIT)不能睡眠: 既不等待数据/空间，也不等待锁，
+ *不能立即完成时返回EAGAIN，io_uring随后通过poll等待就绪再重试，不必交给工作线程；
+ *O_NONBLOCK只是不等待数据/空间，锁仍然可以等待
+ */
+static inline bool globalfifo_nowait(struct kiocb *iocb)
+{
+    return iocb->ki_flags & IOCB_NOWAIT;
+}
+
+static inline bool globalfifo_nonblock(struct kiocb *iocb)
+{
+    return (iocb->ki_filp->f_flags & O_NONBLOCK) || globalfifo_nowait(iocb);
+}
+
+/*
+ *读写路径上第一次获取单端锁，IOCB_NOWAIT时只尝试一次
+ */
+static int globalfifo_side_lock_iocb(struct globalfifo_dev *dev, int bit, struct kiocb *iocb)
+{
+    if (globalfifo_nowait(iocb)) {
+        return test_and_set_bit_lock(bit, &dev->flags) ? -EAGAIN : 0;
+    }
+    return globalfifo_side_lock(dev, bit) ? -ERESTARTSYS : 0;
+}
+
+/*
+ *加锁路径上第一次获取mutex和单端锁，IOCB_NOWAIT时只尝试一次
+ */
+static int globalfifo_lock_iocb(struct globalfifo_dev *dev, int bit, struct kiocb *iocb)
+{
+    int ret;
+
+    if (globalfifo_nowait(iocb)) {
+        if (!mutex_trylock(&dev->mutex)) {
+            return -EAGAIN;
+        }
+    } else {
+        mutex_lock(&dev->mutex);
+    }
+
+    ret = globalfifo_side_lock_iocb(dev, bit, iocb);
+    if (ret) {
+        mutex_unlock(&dev->mutex);
+    }
+    return ret;
+}
+
+/*
+ *同时取得读写两端的锁，用于清空、调整容量等需要独占整个环的操作，调用者需持有dev->mutex
+ */
+static void globalfifo_lock_both(struct globalfifo_dev *dev)
+{
+    wait_on_bit_lock(&dev->flags, GLOBALFIFO_RD_BUSY, TASK_UNINTERRUPTIBLE);
+    wait_on_bit_lock(&dev->flags, GLOBALFIFO_WR_BUSY, TASK_UNINTERRUPTIBLE);
+}
+
+static void globalfifo_unlock_both(struct globalfifo_dev *dev)
+{
+    globalfifo_side_unlock(dev, GLOBALFIFO_WR_BUSY);
+    globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+}
+
+/*
+ *根据请求的模式和读写端数目决定是否启用无锁路径，调用者需持有dev->mutex
+ *模式切换时仍在进行的操作由单端锁保证正确性，无需等待其结束；多队列模式下不使用主环，无锁路径不生效
+ */
+static void globalfifo_spsc_update(struct globalfifo_dev *dev)
+{
+    WRITE_ONCE(dev->spsc_active, dev->spsc && !dev->mq && dev->readers <= 1 && dev->writers <= 1);
+}
+
+static inline int globalfifo_minor(struct globalfifo_dev *dev)
+{
+    return MINOR(dev->cdev.dev);
+}
+
+/*
+ *一次读写调用结束后更新统计计数并触发跟踪点
+ */
+static void globalfifo_account(struct globalfifo_dev *dev, int dir, size_t count, ssize_t ret)
+{
+    this_cpu_inc(dev->stats->calls[dir]);
+    if (ret > 0) {
+        this_cpu_add(dev->stats->bytes[dir], ret);
+    } else if (-EAGAIN == ret) {
+        this_cpu_inc(dev->stats->eagain[dir]);
+    }
+
+    if (GLOBALFIFO_STAT_READ == dir) {
+        trace_globalfifo_read(globalfifo_minor(dev), count, ret);
+    } else {
+        trace_globalfifo_write(globalfifo_minor(dev), count, ret);
+    }
+}
+
+/*
+ *读者/写者即将睡眠
+ */
+static void globalfifo_account_block(struct globalfifo_dev *dev, int dir, size_t need)
+{
+    this_cpu_inc(dev->stats->blocks[dir]);
+    trace_globalfifo_block(globalfifo_minor(dev), GLOBALFIFO_STAT_WRITE == dir, need, globalfifo_len(dev));
+}
+
+/*
+ *有数据但低于读端水位线时启动刷新定时器，保证数据最多等待flush_ns就会被读取
+ */
+static void globalfifo_flush_arm(struct globalfifo_dev *dev)
+{
+    u64 flush_ns = READ_ONCE(dev->flush_ns);
+
+    if (flush_ns && !READ_ONCE(dev->flush) && !hrtimer_active(&dev->flush_timer)) {
+        hrtimer_start(&dev->flush_timer, ns_to_ktime(flush_ns), HRTIMER_MODE_REL);
+    }
+}
+
+static enum hrtimer_restart globalfifo_flush_timer(struct hrtimer *timer)
+{
+    struct globalfifo_dev *dev = container_of(timer, struct globalfifo_dev, flush_timer);
+
+    WRITE_ONCE(dev->flush, true);
+    smp_mb();   /*与读者设置进程状态后检查条件配对*/
+    trace_globalfifo_wake(globalfifo_minor(dev), false, globalfifo_len(dev));
+    wake_up_interruptible_poll(&dev->r_wait, EPOLLIN | EPOLLRDNORM);
+    if (dev->async_queue) {
+        kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+    }
+    return HRTIMER_NORESTART;
+}
+
+/*
+ *读取后唤醒写者，SPSC路径不持有mutex，先检查等待队列是否为空以免无谓地获取等待队列锁
+ *空闲空间低于所有写端的水位线时，没有写者或poll会因此就绪，不必唤醒
+ *唤醒时带上事件掩码，epoll和io_uring在同一队列上只等待可读的项不会被写端的唤醒惊扰
+ */
+static void globalfifo_wake_writers(struct globalfifo_dev *dev)
+{
+    struct globalfifo_ring *ring;
+    unsigned int len, size;
+
+    rcu_read_lock();
+    ring = rcu_dereference(dev->ring);
+    len = globalfifo_ring_len(ring);
+    size = ring->size;
+    rcu_read_unlock();
+
+    if (size - len < min(READ_ONCE(dev->w_lowat), size)) {
+        return;
+    }
+    if (wq_has_sleeper(&dev->w_wait)) {
+        trace_globalfifo_wake(globalfifo_minor(dev), true, len);
+        wake_up_interruptible_poll(&dev->w_wait, EPOLLOUT | EPOLLWRNORM);
+    }
+    if (dev->async_queue) {
+        kill_fasync(&dev->async_queue, SIGIO, POLL_OUT);
+    }
+}
+
+/*
+ *写入后唤醒读者，数据量低于所有读端的水位线时只启动刷新定时器，连续的小块写入只产生一次唤醒
+ */
+static void globalfifo_wake_readers(struct globalfifo_dev *dev)
+{
+    struct globalfifo_ring *ring;
+    unsigned int len, size;
+
+    rcu_read_lock();
+    ring = rcu_dereference(dev->ring);
+    len = globalfifo_ring_len(ring);
+    size = ring->size;
+    rcu_read_unlock();
+
+    if (0 == len) {
+        return;
+    }
+    if (len < min(READ_ONCE(dev->r_lowat), size)) {
+        globalfifo_flush_arm(dev);
+        return;
+    }
+    if (wq_has_sleeper(&dev->r_wait)) {
+        trace_globalfifo_wake(globalfifo_minor(dev), false, len);
+        wake_up_interruptible_poll(&dev->r_wait, EPOLLIN | EPOLLRDNORM);
+    }
+    if (dev->async_queue) {
+        kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+    }
+}
+
+/*
+ *根据所有打开文件的设置重新计算设备的水位线，调用者需持有dev->mutex
+ *水位线提高后，按旧水位线等待的读写者需要重新计算条件，因此唤醒所有等待者
+ */
+static void globalfifo_update_watermarks(struct globalfifo_dev *dev)
+{
+    struct globalfifo_file *gf;
+    unsigned int r_lowat = UINT_MAX, w_lowat = UINT_MAX;
+    u64 flush_ns = 0;
+
+    list_for_each_entry(gf, &dev->files, list) {
+        if (gf->mode & FMODE_READ) {
+            r_lowat = min(r_lowat, gf->rcvlowat);
+            if (gf->flush_us && (!flush_ns || (u64)gf->flush_us * NSEC_PER_USEC < flush_ns)) {
+                flush_ns = (u64)gf->flush_us * NSEC_PER_USEC;
+            }
+        }
+        if (gf->mode & FMODE_WRITE) {
+            w_lowat = min(w_lowat, gf->sndlowat);
+        }
+    }
+
+    WRITE_ONCE(dev->r_lowat, r_lowat);
+    WRITE_ONCE(dev->w_lowat, w_lowat);
+    WRITE_ONCE(dev->flush_ns, flush_ns);
+    wake_up_interruptible(&dev->r_wait);
+    wake_up_interruptible(&dev->w_wait);
+}
+
+/*
+ *从环形缓冲区mem(大小为size，2的幂)的pos处(自由递增的下标，一般为tail)复制count字节到iov_iter，
+ *数据跨越缓冲区末尾时分两段复制；主环和多队列模式的子环都经由这里
+ *iov_iter可以包含多个用户空间缓冲区(readv)，一次复制即可填满所有缓冲区
+ *返回实际复制的字节数，与copy_to_iter一致
+ */
+static size_t globalfifo_copy_to_iter(unsigned char *mem, unsigned int size, unsigned int pos, struct iov_iter *to, size_t count)
+{
+    unsigned int off = pos & (size - 1);
+    size_t first = min_t(size_t, count, size - off);
+    size_t copied;
+
+    copied = copy_to_iter(mem + off, first, to);
+    if (copied < first) {
+        return copied;
+    }
+    return copied + copy_to_iter(mem, count - first, to);
+}
+
+/*
+ *从iov_iter复制count字节到环形缓冲区的pos处(一般为head)，空闲空间跨越缓冲区末尾时分两段复制
+ */
+static size_t globalfifo_copy_from_iter(unsigned char *mem, unsigned int size, unsigned int pos, struct iov_iter *from, size_t count)
+{
+    unsigned int off = pos & (size - 1);
+    size_t first = min_t(size_t, count, size - off);
+    size_t copied;
+
+    copied = copy_from_iter(mem + off, first, from);
+    if (copied < first) {
+        return copied;
+    }
+    return copied + copy_from_iter(mem, count - first, from);
+}
+
+/*
+ *一次读写至少需要的数据量/空闲空间
+ *流模式下有1个字节即可；整体模式下为请求的全部长度，但超过容量的请求永远无法整体完成，退回流模式。
+ *容量可能在等待期间被调整，因此每次检查时都与当前容量比较
+ */
+static inline size_t globalfifo_need(struct globalfifo_ring *ring, size_t need)
+{
+    return need > ring->size ? 1 : need;
+}
+
+/*
+ *读写条件: 数据量/空闲空间既要满足need，也要达到该文件的水位线lowat(超过容量时按容量计)
+ *刷新定时器到期后，只要有数据读端就不再等待水位线
+ */
+static bool globalfifo_readable(struct globalfifo_dev *dev, size_t need, unsigned int lowat)
+{
+    struct globalfifo_ring *ring;
+    unsigned int len;
+    bool ret;
+
+    rcu_read_lock();
+    ring = rcu_dereference(dev->ring);
+    len = globalfifo_ring_len(ring);
+    if (READ_ONCE(dev->flush)) {
+        lowat = 1;
+    }
+    ret = len >= max_t(size_t, globalfifo_need(ring, need), min(lowat, ring->size));
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static bool globalfifo_writable(struct globalfifo_dev *dev, size_t need, unsigned int lowat)
+{
+    struct globalfifo_ring *ring;
+    bool ret;
+
+    rcu_read_lock();
+    ring = rcu_dereference(dev->ring);
+    ret = ring->size - globalfifo_ring_len(ring) >= max_t(size_t, globalfifo_need(ring, need), min(lowat, ring->size));
+    rcu_read_unlock();
+
+    return ret;
+}
+
+/*
+ *数据报模式下读取tail处的一条记录，用户缓冲区放不下整条记录时返回EMSGSIZE，记录仍留在FIFO中
+ *数据报模式下不允许mmap，长度头只由内核写入，可以信任
+ */
+static ssize_t globalfifo_dgram_read(struct globalfifo_ring *ring, struct iov_iter *to)
+{
+    unsigned int tail = ring->ctrl->tail;
+    unsigned int len = globalfifo_ring_len(ring);
+    u32 rlen;
+
+    if (len < GLOBALFIFO_DGRAM_HDR) {
+        return -EAGAIN;
+    }
+    rlen = *(u32 *)(ring->mem + (tail & (ring->size - 1)));
+    if (GLOBALFIFO_RECORD_SIZE(rlen) > len) {
+        return -EIO;
+    }
+    if (rlen > iov_iter_count(to)) {
+        return -EMSGSIZE;
+    }
+
+    if (globalfifo_copy_to_iter(ring->mem, ring->size, tail + GLOBALFIFO_DGRAM_HDR, to, rlen) < rlen) {
+        return -EFAULT;
+    }
+    smp_store_release(&ring->ctrl->tail, tail + GLOBALFIFO_RECORD_SIZE(rlen));
+
+    return rlen;
+}
+
+/*
+ *数据报模式下把整个iov_iter作为一条记录写入head处，先复制数据和长度头，最后移动head一次性发布整条记录
+ */
+static ssize_t globalfifo_dgram_write(struct globalfifo_ring *ring, struct iov_iter *from)
+{
+    unsigned int head = ring->ctrl->head;
+    size_t count = iov_iter_count(from);
+
+    if (GLOBALFIFO_RECORD_SIZE(count) > ring->size - globalfifo_ring_len(ring)) {
+        return -EMSGSIZE;   /*等待期间容量被调小*/
+    }
+
+    if (globalfifo_copy_from_iter(ring->mem, ring->size, head + GLOBALFIFO_DGRAM_HDR, from, count) < count) {
+        return -EFAULT;
+    }
+    *(u32 *)(ring->mem + (head & (ring->size - 1))) = count;
+    smp_store_release(&ring->ctrl->head, head + GLOBALFIFO_RECORD_SIZE(count));
+
+    return count;
+}
+
+/*
+ *在持有读端锁且数据量满足need的情况下读取，移动tail并返回读取的字节数
+ *复制中途出错时，已复制的部分若不足need(整体模式下即请求长度)则不移动tail，数据仍留在FIFO中
+ */
+static ssize_t globalfifo_do_read(struct globalfifo_dev *dev, struct iov_iter *to, size_t need)
+{
+    struct globalfifo_ring *ring = globalfifo_ring(dev);
+    size_t count, copied;
+
+    if (dev->dgram) {
+        return globalfifo_dgram_read(ring, to);
+    }
+
+    /*环形缓冲区只需移动tail，剩余数据无需搬移，读取开销只与读取的字节数相关*/
+    count = min_t(size_t, iov_iter_count(to), globalfifo_ring_len(ring));
+    copied = globalfifo_copy_to_iter(ring->mem, ring->size, ring->ctrl->tail, to, count);
+    if (copied < globalfifo_need(ring, need)) {
+        return -EFAULT;
+    }
+    smp_store_release(&ring->ctrl->tail, ring->ctrl->tail + copied);
+
+    return copied;
+}
+
+/*
+ *读取成功后结束本次刷新；剩余的数据仍低于水位线时重新启动刷新定时器
+ */
+static void globalfifo_flush_done(struct globalfifo_dev *dev)
+{
+    unsigned int len;
+
+    if (!READ_ONCE(dev->flush_ns)) {
+        return;
+    }
+    WRITE_ONCE(dev->flush, false);
+    len = globalfifo_len(dev);
+    if (0 != len && len < READ_ONCE(dev->r_lowat)) {
+        globalfifo_flush_arm(dev);
+    }
+}
+
+/*
+ *在持有写端锁且空闲空间满足need的情况下写入，移动head并返回写入的字节数
+ */
+static ssize_t globalfifo_do_write(struct globalfifo_dev *dev, struct iov_iter *from, size_t need)
+{
+    struct globalfifo_ring *ring = globalfifo_ring(dev);
+    size_t count, copied;
+
+    if (dev->dgram) {
+        return globalfifo_dgram_write(ring, from);
+    }
+
+    count = min_t(size_t, iov_iter_count(from), ring->size - globalfifo_ring_len(ring));
+    copied = globalfifo_copy_from_iter(ring->mem, ring->size, ring->ctrl->head, from, count);
+    if (copied < globalfifo_need(ring, need)) {
+        return -EFAULT;
+    }
+    smp_store_release(&ring->ctrl->head, ring->ctrl->head + copied);
+
+    return copied;
+}
+
+/*
+ *检查并规整FIFO容量: 不足一页的按一页处理，再向上取整为2的幂；超过上限时返回0
+ *默认容量GLOBALFIFO_SIZE在16K/64K页的内核上小于一页，同样被提升到一页
+ */
+static unsigned int globalfifo_check_size(unsigned long size)
+{
+    if (size > GLOBALFIFO_MAX_SIZE) {
+        return 0;
+    }
+    return roundup_pow_of_two(max_t(unsigned long, size, GLOBALFIFO_MIN_SIZE));
+}
+
+/*
+ *申请控制页和环形缓冲区
+ *vmalloc_user申请的内存已清零，不要求物理连续，大容量时也能申请成功，并且可以通过remap_vmalloc_range映射
+ */
+static struct globalfifo_ring *globalfifo_alloc_ring(unsigned int size, int node)
+{
+    struct globalfifo_ring *ring;
+
+    /*数据区由vmalloc_user按申请者所在节点的内存策略分配，描述符放在设备所在节点*/
+    ring = kzalloc_node(sizeof(*ring), GFP_KERNEL, node);
+    if (!ring) {
+        return NULL;
+    }
+
+    ring->ctrl = vmalloc_user(GLOBALFIFO_CTRL_SIZE + size);
+    if (!ring->ctrl) {
+        kfree(ring);
+        return NULL;
+    }
+    ring->mem = (unsigned char *)ring->ctrl + GLOBALFIFO_CTRL_SIZE;
+    ring->size = size;
+    ring->ctrl->size = size;
+    ring->ctrl->data_offset = GLOBALFIFO_CTRL_SIZE;
+
+    return ring;
+}
+
+static void globalfifo_free_ring(struct globalfifo_ring *ring)
+{
+    if (ring) {
+        vfree(ring->ctrl);
+        kfree(ring);
+    }
+}
+
+/*
+ *调整FIFO容量，只允许在FIFO为空且没有被mmap时进行
+ */
+static int globalfifo_resize(struct globalfifo_dev *dev, unsigned long size)
+{
+    struct globalfifo_ring *ring, *old;
+    int ret = 0;
+
+    size = globalfifo_check_size(size);
+    if (!size) {
+        return -EINVAL;
+    }
+
+    ring = globalfifo_alloc_ring(size, dev->node);
+    if (!ring) {
+        return -ENOMEM;
+    }
+
+    mutex_lock(&dev->mutex);
+    globalfifo_lock_both(dev);
+    mutex_lock(&dev->mmap_lock);
+
+    old = globalfifo_ring(dev);
+    if (dev->mmap_count || 0 != globalfifo_ring_len(old)) {
+        ret = -EBUSY;
+    } else {
+        rcu_assign_pointer(dev->ring, ring);
+    }
+
+    mutex_unlock(&dev->mmap_lock);
+    globalfifo_unlock_both(dev);
+    mutex_unlock(&dev->mutex);
+
+    if (ret) {
+        globalfifo_free_ring(ring);
+        return ret;
+    }
+
+    synchronize_rcu();      /*等待poll等无锁访问者离开旧的环*/
+    globalfifo_free_ring(old);
+
+    wake_up_interruptible_poll(&dev->w_wait, EPOLLOUT | EPOLLWRNORM);
+    return 0;
+}
+
+/*
+ *切换数据报模式，FIFO中已有的数据按原来的格式存放，只允许在FIFO为空且没有被mmap时切换，多队列模式下不能切换
+ */
+static int globalfifo_set_dgram(struct globalfifo_dev *dev, bool dgram)
+{
+    int ret = 0;
+
+    mutex_lock(&dev->mutex);
+    globalfifo_lock_both(dev);
+    mutex_lock(&dev->mmap_lock);
+
+    if (dev->mmap_count || dev->mq || 0 != globalfifo_ring_len(globalfifo_ring(dev))) {
+        ret = -EBUSY;
+    } else {
+        /*
+         *流模式下读写后下标可能停在任意字节偏移，数据报的长度头要求记录从4字节对齐处开始，
+         *否则长度头会跨越数据区末尾；FIFO为空且持有两个单端锁，可以直接复位下标
+         */
+        globalfifo_ring(dev)->ctrl->head = globalfifo_ring(dev)->ctrl->tail = 0;
+        WRITE_ONCE(dev->dgram, dgram);
+    }
+
+    mutex_unlock(&dev->mmap_lock);
+    globalfifo_unlock_both(dev);
+    mutex_unlock(&dev->mutex);
+
+    return ret;
+}
+
+/*
+ *子环中的数据长度(包括记录头)，下标的发布与读取规则与主环相同
+ */
+static inline unsigned int globalfifo_mq_len(struct globalfifo_mq_ring *q)
+{
+    return smp_load_acquire(&q->head) - smp_load_acquire(&q->tail);
+}
+
+/*
+ *子环中还能写入的最长记录的数据长度，空闲空间是记录头大小的倍数，写入不超过它的记录总能放下
+ */
+static inline unsigned int globalfifo_mq_room(struct globalfifo_mq_ring *q)
+{
+    unsigned int space = q->size - globalfifo_mq_len(q);
+
+    return space > GLOBALFIFO_MQ_HDR ? space - GLOBALFIFO_MQ_HDR : 0;
+}
+
+/*
+ *与globalfifo_need()相同，超过子环所能容纳的最长记录的整体写入退回流模式
+ */
+static inline size_t globalfifo_mq_need(struct globalfifo_mq_ring *q, size_t need)
+{
+    return need > q->size - GLOBALFIFO_MQ_HDR ? 1 : need;
+}
+
+static inline struct globalfifo_mq_hdr *globalfifo_mq_hdr(struct globalfifo_mq_ring *q, unsigned int pos)
+{
+    return (struct globalfifo_mq_hdr *)(q->mem + (pos & (q->size - 1)));
+}
+
+/*
+ *取得cpu的子环，还没有时在该CPU的节点上创建；并发创建时只保留先发布的一个
+ */
+static struct globalfifo_mq_ring *globalfifo_mq_get(struct globalfifo_dev *dev, int cpu)
+{
+    struct globalfifo_mq_ring *q, *old;
+    int node = cpu_to_node(cpu);
+
+    q = smp_load_acquire(&dev->mq_rings[cpu]);
+    if (q) {
+        return q;
+    }
+
+    q = kzalloc_node(sizeof(*q), GFP_KERNEL, node);
+    if (!q) {
+        return NULL;
+    }
+    q->mem = kvmalloc_node(globalfifo_mq_size, GFP_KERNEL, node);
+    if (!q->mem) {
+        kfree(q);
+        return NULL;
+    }
+    q->size = globalfifo_mq_size;
+    mutex_init(&q->lock);
+
+    /*在设备的mutex下发布，切换模式时不会有新的子环出现，见globalfifo_set_mq()*/
+    mutex_lock(&dev->mutex);
+    old = cmpxchg(&dev->mq_rings[cpu], NULL, q);
+    mutex_unlock(&dev->mutex);
+    if (old) {
+        kvfree(q->mem);
+        kfree(q);
+        return old;
+    }
+    return q;
+}
+
+static void globalfifo_mq_free(struct globalfifo_dev *dev)
+{
+    int cpu;
+
+    if (!dev->mq_rings) {
+        return;
+    }
+    for_each_possible_cpu(cpu) {
+        if (dev->mq_rings[cpu]) {
+            kvfree(dev->mq_rings[cpu]->mem);
+            kfree(dev->mq_rings[cpu]);
+        }
+    }
+    kfree(dev->mq_rings);
+}
+
+/*
+ *读写条件: 任一子环中有数据即可读；当前CPU的子环(还没有创建时视为空)放得下need即可写
+ *写者睡眠期间可能迁移到其他CPU，每次检查都按当前所在的CPU计算
+ */
+static bool globalfifo_mq_readable(struct globalfifo_dev *dev)
+{
+    struct globalfifo_mq_ring *q;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        q = smp_load_acquire(&dev->mq_rings[cpu]);
+        if (q && 0 != globalfifo_mq_len(q)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool globalfifo_mq_writable(struct globalfifo_dev *dev, size_t need)
+{
+    struct globalfifo_mq_ring *q = smp_load_acquire(&dev->mq_rings[raw_smp_processor_id()]);
+
+    return !q || globalfifo_mq_room(q) >= globalfifo_mq_need(q, need);
+}
+
+/*
+ *清空所有子环，调用者需持有读端锁；与写者之间由子环的锁互斥
+ */
+static void globalfifo_mq_clear(struct globalfifo_dev *dev)
+{
+    struct globalfifo_mq_ring *q;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        q = smp_load_acquire(&dev->mq_rings[cpu]);
+        if (q) {
+            mutex_lock(&q->lock);
+            smp_store_release(&q->tail, q->head);
+            mutex_unlock(&q->lock);
+        }
+    }
+    dev->mq_cur = -1;
+    dev->mq_off = 0;
+}
+
+/*
+ *切换多队列模式
+ *要求FIFO为空、没有被mmap，并且设备只被调用者打开；共用这个文件的其他线程仍可能正在读写或睡眠，
+ *它们在取得所走路径的锁(mutex、读写端锁或子环的锁)或被唤醒后重新检查dev->mq，
+ *模式已变化时返回GLOBALFIFO_EMODE，按新的模式重新选择路径，不会把数据写入读者不再读取的环。
+ *多队列的写者只持有子环的锁: 先设置mq_switching，再依次取得并释放每个子环的锁，
+ *之后的写者看到mq_switching就会等待，正在发布的写者也已经完成；新的子环只在mutex下发布，不会遗漏。
+ *子环的锁在写入时可能因缺页而持有mm的mmap_lock，不能在dev->mmap_lock之内获取，也不同时持有多个。
+ */
+static int globalfifo_set_mq(struct globalfifo_dev *dev, unsigned long mode)
+{
+    struct globalfifo_mq_ring *q;
+    int ret = 0;
+    int cpu;
+
+    if (mode > GLOBALFIFO_MQ_TS) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&dev->mutex);
+    globalfifo_lock_both(dev);
+    WRITE_ONCE(dev->mq_switching, true);
+    for_each_possible_cpu(cpu) {
+        q = dev->mq_rings[cpu];
+        if (q) {
+            mutex_lock(&q->lock);
+            mutex_unlock(&q->lock);
+        }
+    }
+
+    mutex_lock(&dev->mmap_lock);
+    if (!list_is_singular(&dev->files) || dev->mmap_count || dev->dgram ||
+        0 != globalfifo_ring_len(globalfifo_ring(dev)) || globalfifo_mq_readable(dev)) {
+        ret = -EBUSY;
+    } else {
+        WRITE_ONCE(dev->mq, mode);
+        dev->mq_cur = -1;
+        dev->mq_off = 0;
+        globalfifo_spsc_update(dev);
+    }
+    mutex_unlock(&dev->mmap_lock);
+
+    /*写者以acquire语义读取mq_switching，看到清除后一定也看到新的模式*/
+    smp_store_release(&dev->mq_switching, false);
+    globalfifo_unlock_both(dev);
+    mutex_unlock(&dev->mutex);
+
+    /*唤醒按旧模式等待的读写者和切换期间暂停的写者*/
+    wake_up_interruptible(&dev->r_wait);
+    wake_up_interruptible(&dev->w_wait);
+    return ret;
+}
+
+/*
+ *处理FASYNC标志变更的函数
+ */
+static int globalfifo_fasync(int fd, struct file *filp, int mode)
+{
+    struct globalfifo_dev *dev = globalfifo_dev(filp);
+    return fasync_helper(fd, filp, mode, &dev->async_queue);
+}
+
+/*
+ *文件打开函数，对应于用户空间的open函数，用户空间调用open函数时，系统内部经过各种处理后，最终调用本函数
+ */
+static int globalfifo_open(struct inode *inode, struct file *filep)
+{
+    /*获取包含cdev结构体的globalfifo_dev结构体指针*/
+    struct globalfifo_dev *dev = container_of(inode->i_cdev, struct globalfifo_dev, cdev);
+    struct globalfifo_file *gf;
+
+    gf = kzalloc(sizeof(*gf), GFP_KERNEL);
+    if (!gf) {
+        return -ENOMEM;
+    }
+    gf->dev = dev;
+    gf->mode = filep->f_mode;
+    gf->rcvlowat = 1;
+    gf->sndlowat = 1;
+    filep->private_data = gf;
+    filep->f_mode |= FMODE_NOWAIT;  /*read_iter/write_iter支持IOCB_NOWAIT，io_uring可以先非阻塞地尝试*/
+
+    /*统计读写端数目，出现第二个读者或写者时退回加锁路径*/
+    mutex_lock(&dev->mutex);
+    if (filep->f_mode & FMODE_READ) {
+        dev->readers++;
+    }
+    if (filep->f_mode & FMODE_WRITE) {
+        dev->writers++;
+    }
+    globalfifo_spsc_update(dev);
+    list_add(&gf->list, &dev->files);
+    globalfifo_update_watermarks(dev);
+    mutex_unlock(&dev->mutex);
+
+    return 0;
+}
+
+/*
+ *文件释放函数
+ *release()完成与open()相反的工作，释放open()向内核申请的所有资源，实际使用过程中，需要注意两点： 
+ *1.close()并不完全是release() 
+ *  内核对每个file结构维护其被使用的计数，无论是fork还是dup，都不会创建新的数据结构，如fork和dup，
+ *  它们只是增加已有(由open()生成)结构中的计数，只有在file结构的计数为0时，close才会实质地调用release,
+ *  因此并不是每个close()系统调用都会引起对release()方法的调用
+ *2.内核自动关闭 
+ *  内核在进程退出时，会在内部使用close()系统调用自动关闭所有相关文件 
+ */
+static int globalfifo_release(struct inode *inode, struct file *filp)
+{
+    struct globalfifo_file *gf = filp->private_data;
+    struct globalfifo_dev *dev = gf->dev;
+
+    globalfifo_fasync(-1, filp, 0);
+
+    mutex_lock(&dev->mutex);
+    if (filp->f_mode & FMODE_READ) {
+        dev->readers--;
+    }
+    if (filp->f_mode & FMODE_WRITE) {
+        dev->writers--;
+    }
+    globalfifo_spsc_update(dev);
+    list_del(&gf->list);
+    globalfifo_update_watermarks(dev);
+    mutex_unlock(&dev->mutex);
+
+    kfree(gf);
+	return 0;
+}
+
+/*
+ *ioctl设备控制函数
+ */
+static long globalfifo_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+    struct globalfifo_file *gf = filep->private_data;
+	struct globalfifo_dev *dev = gf->dev;
+    struct globalfifo_ring *ring;
+    struct globalfifo_watermark wm;
+    int val;
+
+	switch(cmd) {
+    case MEM_CLEAR:
+        mutex_lock(&dev->mutex);
+        /*SPSC模式下读写操作不持有mutex，需同时取得两个单端锁*/
+        globalfifo_lock_both(dev);
+
+        /*
+         *FIFO中只有[tail, head)之间的数据可见，清空只需复位下标，与容量无关；
+         *不再对整个数据区memset，大容量时不会在持有锁期间长时间阻塞读写
+         */
+        ring = globalfifo_ring(dev);
+        ring->ctrl->head = ring->ctrl->tail = 0;
+        globalfifo_mq_clear(dev);
+        WRITE_ONCE(dev->flush, false);
+		printk(KERN_INFO "globalfifo is set to zero\n");
+
+        globalfifo_unlock_both(dev);
+        mutex_unlock(&dev->mutex);
+        wake_up_interruptible_poll(&dev->w_wait, EPOLLOUT | EPOLLWRNORM);
+		break;
+    case GLOBALFIFO_IOC_SET_SPSC:
+        mutex_lock(&dev->mutex);
+        dev->spsc = !!arg;
+        globalfifo_spsc_update(dev);
+        mutex_unlock(&dev->mutex);
+        break;
+    case GLOBALFIFO_IOC_GET_SPSC:
+        val = (dev->spsc ? GLOBALFIFO_SPSC_ON : 0) | (READ_ONCE(dev->spsc_active) ? GLOBALFIFO_SPSC_ACTIVE : 0);
+        return put_user(val, (int __user *)arg);
+    case GLOBALFIFO_IOC_DOORBELL:
+        /*mmap的生产者/消费者在用户空间直接更新head/tail，之后通过门铃唤醒对端*/
+        if (0 != globalfifo_len(dev)) {
+            globalfifo_wake_readers(dev);
+        }
+        if (0 != globalfifo_space(dev)) {
+            globalfifo_wake_writers(dev);
+        }
+        break;
+    case GLOBALFIFO_IOC_SET_SIZE:
+        return globalfifo_resize(dev, arg);
+    case GLOBALFIFO_IOC_GET_SIZE:
+        return put_user(globalfifo_capacity(dev), (unsigned int __user *)arg);
+    case GLOBALFIFO_IOC_SET_ATOMIC:
+        WRITE_ONCE(gf->atomic, !!arg);
+        break;
+    case GLOBALFIFO_IOC_GET_ATOMIC:
+        return put_user((int)READ_ONCE(gf->atomic), (int __user *)arg);
+    case GLOBALFIFO_IOC_SET_DGRAM:
+        return globalfifo_set_dgram(dev, !!arg);
+    case GLOBALFIFO_IOC_GET_DGRAM:
+        return put_user((int)READ_ONCE(dev->dgram), (int __user *)arg);
+    case GLOBALFIFO_IOC_SET_WATERMARK:
+        if (copy_from_user(&wm, (void __user *)arg, sizeof(wm))) {
+            return -EFAULT;
+        }
+        mutex_lock(&dev->mutex);
+        WRITE_ONCE(gf->rcvlowat, wm.rcvlowat ? wm.rcvlowat : 1);
+        WRITE_ONCE(gf->sndlowat, wm.sndlowat ? wm.sndlowat : 1);
+        WRITE_ONCE(gf->flush_us, wm.flush_us);
+        globalfifo_update_watermarks(dev);
+        mutex_unlock(&dev->mutex);
+        break;
+    case GLOBALFIFO_IOC_GET_WATERMARK:
+        wm.rcvlowat = READ_ONCE(gf->rcvlowat);
+        wm.sndlowat = READ_ONCE(gf->sndlowat);
+        wm.flush_us = READ_ONCE(gf->flush_us);
+        return copy_to_user((void __user *)arg, &wm, sizeof(wm)) ? -EFAULT : 0;
+    case GLOBALFIFO_IOC_SET_MQ:
+        return globalfifo_set_mq(dev, arg);
+    case GLOBALFIFO_IOC_GET_MQ:
+        return put_user(READ_ONCE(dev->mq), (int __user *)arg);
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ *SPSC模式的读取函数，数据路径上不获取mutex，只依靠head/tail的acquire/release顺序
+ */
+static ssize_t globalfifo_spsc_read(struct globalfifo_dev *dev, struct kiocb *iocb, struct iov_iter *to, size_t need, unsigned int lowat)
+{
+    ssize_t ret;
+
+    ret = globalfifo_side_lock_iocb(dev, GLOBALFIFO_RD_BUSY, iocb);
+    if (ret) {
+        return ret;
+    }
+
+    while (!READ_ONCE(dev->mq) && !globalfifo_readable(dev, need, lowat)) {
+        globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+        if (globalfifo_nonblock(iocb)) {
+            return -EAGAIN;
+        }
+        globalfifo_account_block(dev, GLOBALFIFO_STAT_READ, need);
+        if (wait_event_interruptible(dev->r_wait, READ_ONCE(dev->mq) || globalfifo_readable(dev, need, lowat))) {
+            return -ERESTARTSYS;
+        }
+        if (globalfifo_side_lock(dev, GLOBALFIFO_RD_BUSY)) {
+            return -ERESTARTSYS;
+        }
+    }
+    if (READ_ONCE(dev->mq)) {
+        globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+        return -GLOBALFIFO_EMODE;
+    }
+
+    ret = globalfifo_do_read(dev, to, need);
+    globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
 
-struct globalfifo_dev {
-	struct cdev cdev;                   /*字符设备结构体*/
-    unsigned int current_len;           /*记录当然FIFO中的数据长度*/
-	unsigned char mem[GLOBALFIFO_SIZE]; /*用于模拟读写操作的内存空间*/
-    struct mutex mutex;                 /*用于多用户(进程)访问时的控制，不能用自旋锁，因为读写操作中有调用可能导致阻塞的copy_to_user及copy_from_user; 只能使用互斥体*/
-    wait_queue_head_t r_wait;           /*定义读取等待队列头部*/
-    wait_queue_head_t w_wait;           /*定义写入等待队列头部*/
-    struct fasync_struct *async_queue;  /*异步通知*/
-};
+    if (ret > 0) {
+        globalfifo_flush_done(dev);
+        globalfifo_wake_writers(dev);
+    }
+    return ret;
+}
+
+/*
+ *SPSC模式的写入函数
+ */
+static ssize_t globalfifo_spsc_write(struct globalfifo_dev *dev, struct kiocb *iocb, struct iov_iter *from, size_t need, unsigned int lowat)
+{
+    ssize_t ret;
+
+    ret = globalfifo_side_lock_iocb(dev, GLOBALFIFO_WR_BUSY, iocb);
+    if (ret) {
+        return ret;
+    }
+
+    while (!READ_ONCE(dev->mq) && !globalfifo_writable(dev, need, lowat)) {
+        globalfifo_side_unlock(dev, GLOBALFIFO_WR_BUSY);
+        if (globalfifo_nonblock(iocb)) {
+            return -EAGAIN;
+        }
+        globalfifo_account_block(dev, GLOBALFIFO_STAT_WRITE, need);
+        if (wait_event_interruptible(dev->w_wait, READ_ONCE(dev->mq) || globalfifo_writable(dev, need, lowat))) {
+            return -ERESTARTSYS;
+        }
+        if (globalfifo_side_lock(dev, GLOBALFIFO_WR_BUSY)) {
+            return -ERESTARTSYS;
+        }
+    }
+    if (READ_ONCE(dev->mq)) {
+        globalfifo_side_unlock(dev, GLOBALFIFO_WR_BUSY);
+        return -GLOBALFIFO_EMODE;
+    }
 
-static struct globalfifo_dev *globalfifo_devp;
+    ret = globalfifo_do_write(dev, from, need);
+    globalfifo_side_unlock(dev, GLOBALFIFO_WR_BUSY);
+
+    if (ret > 0) {
+        globalfifo_wake_readers(dev);
+    }
+    return ret;
+}
 
 /*
- *处理FASYNC标志变更的函数
+ *多队列模式下选出下一条要读取的记录所在的子环，调用者需持有读端锁，没有数据时返回NULL
+ *上一次只读走一部分的记录优先，保证一条记录的数据在读者看来是连续的；
+ *轮转模式从mq_next开始找第一个非空的子环；时间戳模式取各子环第一条记录中时间戳最早的一条
  */
-static int globalfifo_fasync(int fd, struct file *filp, int mode)
+static struct globalfifo_mq_ring *globalfifo_mq_pick(struct globalfifo_dev *dev, int *cpup)
 {
-    struct globalfifo_dev *dev = filp->private_data;
-    return fasync_helper(fd, filp, mode, &dev->async_queue);
+    struct globalfifo_mq_ring *q, *best = NULL;
+    u64 stamp, best_stamp = 0;
+    unsigned int i;
+    int cpu;
+
+    if (dev->mq_cur >= 0) {
+        *cpup = dev->mq_cur;
+        return dev->mq_rings[dev->mq_cur];
+    }
+
+    if (GLOBALFIFO_MQ_RR == READ_ONCE(dev->mq)) {
+        for (i = 0; i < nr_cpu_ids; i++) {
+            cpu = (dev->mq_next + i) % nr_cpu_ids;
+            q = smp_load_acquire(&dev->mq_rings[cpu]);
+            if (q && 0 != globalfifo_mq_len(q)) {
+                *cpup = cpu;
+                return q;
+            }
+        }
+        return NULL;
+    }
+
+    for_each_possible_cpu(cpu) {
+        q = smp_load_acquire(&dev->mq_rings[cpu]);
+        if (!q || 0 == globalfifo_mq_len(q)) {
+            continue;
+        }
+        stamp = globalfifo_mq_hdr(q, q->tail)->stamp;
+        if (!best || stamp < best_stamp) {
+            best = q;
+            best_stamp = stamp;
+            *cpup = cpu;
+        }
+    }
+    return best;
 }
 
 /*
- *文件打开函数，对应于用户空间的open函数，用户空间调用open函数时，系统内部经过各种处理后，最终调用本函数
+ *多队列模式下在持有读端锁的情况下读取，从各子环依次取出记录填满iov_iter，返回读取的字节数
+ *子环中的记录头只由内核写入，可以信任
  */
-static int globalfifo_open(struct inode *inode, struct file *filep)
+static ssize_t globalfifo_mq_do_read(struct globalfifo_dev *dev, struct iov_iter *to)
 {
-    /*获取包含cdev结构体的globalfifo_dev结构体指针*/
-    struct globalfifo_dev *dev = container_of(inode->i_cdev, struct globalfifo_dev, cdev);
-    filep->private_data = dev;
-    return 0;
+    struct globalfifo_mq_ring *q;
+    struct globalfifo_mq_hdr *hdr;
+    unsigned int tail, rest;
+    size_t n, copied, total = 0;
+    int cpu;
+
+    while (0 != iov_iter_count(to) && (q = globalfifo_mq_pick(dev, &cpu))) {
+        tail = q->tail;
+        hdr = globalfifo_mq_hdr(q, tail);
+        rest = hdr->len - dev->mq_off;
+        n = min_t(size_t, rest, iov_iter_count(to));
+
+        copied = globalfifo_copy_to_iter(q->mem, q->size, tail + GLOBALFIFO_MQ_HDR + dev->mq_off, to, n);
+        total += copied;
+        if (copied < rest) {
+            /*记录只读走一部分，下一次读取从这里继续*/
+            dev->mq_cur = cpu;
+            dev->mq_off += copied;
+            if (copied < n) {
+                break;
+            }
+            continue;
+        }
+
+        dev->mq_cur = -1;
+        dev->mq_off = 0;
+        dev->mq_next = cpu + 1;
+        smp_store_release(&q->tail, tail + GLOBALFIFO_MQ_RECORD_SIZE(hdr->len));
+    }
+
+    return total ? total : -EFAULT;
 }
 
 /*
- *文件释放函数
- *release()完成与open()相反的工作，释放open()向内核申请的所有资源，实际使用过程中，需要注意两点： 
- *1.close()并不完全是release() 
- *  内核对每个file结构维护其被使用的计数，无论是fork还是dup，都不会创建新的数据结构，如fork和dup，
- *  它们只是增加已有(由open()生成)结构中的计数，只有在file结构的计数为0时，close才会实质地调用release,
- *  因此并不是每个close()系统调用都会引起对release()方法的调用
- *2.内核自动关闭 
- *  内核在进程退出时，会在内部使用close()系统调用自动关闭所有相关文件 
+ *多队列模式下数据或空间变化后唤醒对端，不再根据水位线判断
  */
-static int globalfifo_release(struct inode *inode, struct file *filp)
+static void globalfifo_mq_wake(struct globalfifo_dev *dev, bool writers)
 {
-    globalfifo_fasync(-1, filp, 0);
-	return 0;
+    wait_queue_head_t *wq = writers ? &dev->w_wait : &dev->r_wait;
+
+    if (wq_has_sleeper(wq)) {
+        trace_globalfifo_wake(globalfifo_minor(dev), writers, 0);
+        wake_up_interruptible_poll(wq, writers ? EPOLLOUT | EPOLLWRNORM : EPOLLIN | EPOLLRDNORM);
+    }
+    if (dev->async_queue) {
+        kill_fasync(&dev->async_queue, SIGIO, writers ? POLL_OUT : POLL_IN);
+    }
 }
 
 /*
- *ioctl设备控制函数
+ *多队列模式的读取函数，读者之间由读端锁互斥，不获取mutex
  */
-static long globalfifo_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+static ssize_t globalfifo_mq_read(struct globalfifo_dev *dev, struct kiocb *iocb, struct iov_iter *to)
 {
-	struct globalfifo_dev *dev = filep->private_data;
+    ssize_t ret;
 
-	switch(cmd) {
-    case MEM_CLEAR:
-        mutex_lock(&dev->mutex);
+    ret = globalfifo_side_lock_iocb(dev, GLOBALFIFO_RD_BUSY, iocb);
+    if (ret) {
+        return ret;
+    }
 
-		memset(dev->mem, 0, GLOBALFIFO_SIZE);
-        dev->current_len = 0;
-		printk(KERN_INFO "globalfifo is set to zero\n");
+    while (READ_ONCE(dev->mq) && !globalfifo_mq_readable(dev)) {
+        globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+        if (globalfifo_nonblock(iocb)) {
+            return -EAGAIN;
+        }
+        globalfifo_account_block(dev, GLOBALFIFO_STAT_READ, 1);
+        if (wait_event_interruptible(dev->r_wait, !READ_ONCE(dev->mq) || globalfifo_mq_readable(dev))) {
+            return -ERESTARTSYS;
+        }
+        if (globalfifo_side_lock(dev, GLOBALFIFO_RD_BUSY)) {
+            return -ERESTARTSYS;
+        }
+    }
+    if (!READ_ONCE(dev->mq)) {
+        globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+        return -GLOBALFIFO_EMODE;
+    }
 
-        mutex_unlock(&dev->mutex);
-		break;
-	default:
-		return -EINVAL;
-	}
+    ret = globalfifo_mq_do_read(dev, to);
+    globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
 
-	return 0;
+    if (ret > 0) {
+        globalfifo_mq_wake(dev, true);
+    }
+    return ret;
+}
+
+/*
+ *多队列模式的写入函数，只获取当前CPU子环的锁，写入的数据作为一条带时间戳的记录发布
+ *空间不足时写入能放下的部分，整体模式下等待至整条记录能放下
+ *申请子环可能睡眠，IOCB_NOWAIT时所在CPU还没有子环则返回EAGAIN，由阻塞的重试来申请
+ */
+static ssize_t globalfifo_mq_write(struct globalfifo_dev *dev, struct kiocb *iocb, struct iov_iter *from, size_t need)
+{
+    struct globalfifo_mq_ring *q;
+    struct globalfifo_mq_hdr *hdr;
+    unsigned int head;
+    size_t count, copied;
+
+    for (;;) {
+        if (globalfifo_nowait(iocb)) {
+            q = smp_load_acquire(&dev->mq_rings[raw_smp_processor_id()]);
+            if (!q || !mutex_trylock(&q->lock)) {
+                return -EAGAIN;
+            }
+        } else {
+            q = globalfifo_mq_get(dev, raw_smp_processor_id());
+            if (!q) {
+                return -ENOMEM;
+            }
+            if (mutex_lock_interruptible(&q->lock)) {
+                return -ERESTARTSYS;
+            }
+        }
+        /*切换模式期间不发布记录，等切换完成后按新的模式重新选择路径*/
+        if (smp_load_acquire(&dev->mq_switching)) {
+            mutex_unlock(&q->lock);
+            if (globalfifo_nonblock(iocb)) {
+                return -EAGAIN;
+            }
+            if (wait_event_interruptible(dev->w_wait, !smp_load_acquire(&dev->mq_switching))) {
+                return -ERESTARTSYS;
+            }
+            continue;
+        }
+        if (!READ_ONCE(dev->mq)) {
+            mutex_unlock(&q->lock);
+            return -GLOBALFIFO_EMODE;
+        }
+        if (globalfifo_mq_room(q) >= globalfifo_mq_need(q, need)) {
+            break;
+        }
+        mutex_unlock(&q->lock);
+
+        if (globalfifo_nonblock(iocb)) {
+            return -EAGAIN;
+        }
+        globalfifo_account_block(dev, GLOBALFIFO_STAT_WRITE, need);
+        if (wait_event_interruptible(dev->w_wait, !READ_ONCE(dev->mq) || globalfifo_mq_writable(dev, need))) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    head = q->head;
+    count = min_t(size_t, iov_iter_count(from), globalfifo_mq_room(q));
+    copied = globalfifo_copy_from_iter(q->mem, q->size, head + GLOBALFIFO_MQ_HDR, from, count);
+    if (copied < globalfifo_mq_need(q, need)) {
+        mutex_unlock(&q->lock);
+        return -EFAULT;
+    }
+    hdr = globalfifo_mq_hdr(q, head);
+    hdr->len = copied;
+    hdr->stamp = ktime_get_ns();
+    smp_store_release(&q->head, head + GLOBALFIFO_MQ_RECORD_SIZE(copied));
+    mutex_unlock(&q->lock);
+
+    globalfifo_mq_wake(dev, false);
+    return copied;
 }
 
 /*
  *读取设备函数
+ *read()和readv()都经由本函数，readv的所有缓冲区在一次加锁、一次唤醒中填充
  */
-static ssize_t globalfifo_read(struct file *filp, char __user * buf, size_t count, loff_t *ppos)
+static ssize_t globalfifo_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
     int ret = 0;
-    struct globalfifo_dev *dev = filp->private_data;    /*获取设备结构体指针*/
+    struct file *filp = iocb->ki_filp;
+    struct globalfifo_file *gf = filp->private_data;
+    struct globalfifo_dev *dev = gf->dev;               /*获取设备结构体指针*/
+    size_t count = iov_iter_count(to);
+    size_t need;
 
     DECLARE_WAITQUEUE(wait, current);
 
-    mutex_lock(&dev->mutex);
+    if (0 == count) {
+        return 0;
+    }
+
+    /*数据报模式下有一条完整的记录即可读取，记录由写者一次性发布*/
+    if (READ_ONCE(dev->dgram)) {
+        need = GLOBALFIFO_DGRAM_HDR;
+    } else {
+        need = READ_ONCE(gf->atomic) ? count : 1;
+    }
+
+retry:
+    if (READ_ONCE(dev->mq)) {
+        ret = globalfifo_mq_read(dev, iocb, to);
+        if (-GLOBALFIFO_EMODE == ret) {
+            goto retry;
+        }
+        globalfifo_account(dev, GLOBALFIFO_STAT_READ, count, ret);
+        return ret;
+    }
+
+    if (READ_ONCE(dev->spsc_active)) {
+        ret = globalfifo_spsc_read(dev, iocb, to, need, READ_ONCE(gf->rcvlowat));
+        if (-GLOBALFIFO_EMODE == ret) {
+            goto retry;
+        }
+        globalfifo_account(dev, GLOBALFIFO_STAT_READ, count, ret);
+        return ret;
+    }
+
+    /*模式切换期间SPSC路径上的读者可能仍未退出，同样需要持有读端锁*/
+    ret = globalfifo_lock_iocb(dev, GLOBALFIFO_RD_BUSY, iocb);
+    if (ret) {
+        globalfifo_account(dev, GLOBALFIFO_STAT_READ, count, ret);
+        return ret;
+    }
     add_wait_queue(&dev->r_wait, &wait);
 
-    while (0 == dev->current_len) {
-        if (filp->f_flags & O_NONBLOCK) {
+    /*SPSC路径的写者不持有mutex，必须先设置进程状态再检查条件，以免丢失唤醒*/
+    /*等待期间共用这个文件的线程可能切换了多队列模式，数据不再写入主环，每次被唤醒都要检查*/
+    while (set_current_state(TASK_INTERRUPTIBLE), !READ_ONCE(dev->mq) && !globalfifo_readable(dev, need, READ_ONCE(gf->rcvlowat))) {
+        if (globalfifo_nonblock(iocb)) {
             ret = -EAGAIN;
             goto out;
         }
-        __set_current_state(TASK_INTERRUPTIBLE);
+        globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
         mutex_unlock(&dev->mutex);
 
+        globalfifo_account_block(dev, GLOBALFIFO_STAT_READ, need);
         schedule();
         if (signal_pending(current)) {
             ret = -ERESTARTSYS;
@@ -123,97 +1509,136 @@ static ssize_t globalfifo_read(struct file *filp, char __user * buf, size_t coun
         }
 
         mutex_lock(&dev->mutex);
+        if (globalfifo_side_lock(dev, GLOBALFIFO_RD_BUSY)) {
+            ret = -ERESTARTSYS;
+            goto out_unlock;
+        }
     }
-
-    if (count > dev->current_len) {
-        count = dev->current_len;
-    }
-    
-    /*buf为用户空间指针，不能直接使用memcpy()等方法，内核空间不能直接访问用户空间*/
-    /*copy_to_user：完成数据从内核空间向用户空间的复制，可能引起阻塞*/
-    if (copy_to_user(buf, dev->mem, count)) {
-        ret = -EFAULT;
+    __set_current_state(TASK_RUNNING);
+    if (READ_ONCE(dev->mq)) {
+        ret = -GLOBALFIFO_EMODE;
         goto out;
-    } else {
-        memcpy(dev->mem, dev->mem + count, dev->current_len - count);
-        dev->current_len -= count;
-
-        printk(KERN_INFO "read %ld bytes, current_len: %d\n", count, dev->current_len);
-
-        wake_up_interruptible(&dev->w_wait);    /*读取数据后，FIFO中会空闲部分空间，唤醒写等待的进程，允许写入*/
+    }
 
-        if (dev->async_queue) {
-            kill_fasync(&dev->async_queue, SIGIO, POLL_OUT);
-            printk(KERN_DEBUG "%s kill SIGIO POLL_OUT: %d\n", __func__, POLL_OUT);
-        }
-        
-        ret = count;
+    /*用户空间缓冲区不能直接使用memcpy()等方法访问，copy_to_iter完成数据从内核空间向用户空间的复制，可能引起阻塞*/
+    ret = globalfifo_do_read(dev, to, need);
+    if (ret > 0) {
+        globalfifo_flush_done(dev);
+        globalfifo_wake_writers(dev);   /*读取数据后，FIFO中会空闲部分空间，空闲空间达到水位线时唤醒写等待的进程*/
     }
 out:
+    globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+out_unlock:
     mutex_unlock(&dev->mutex);
 out2:
     remove_wait_queue(&dev->r_wait, &wait);
     set_current_state(TASK_RUNNING);
+    if (-GLOBALFIFO_EMODE == ret) {
+        goto retry;
+    }
+    globalfifo_account(dev, GLOBALFIFO_STAT_READ, count, ret);
     return ret;
 }
 
 /*
  *写入设备函数
+ *writev()的所有缓冲区在一次加锁中写入FIFO，读者只被唤醒一次；整体模式下不会只写入其中一部分
  */
-static ssize_t globalfifo_write(struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
+static ssize_t globalfifo_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
     int ret = 0;
-    struct globalfifo_dev *dev = filp->private_data;
+    struct file *filp = iocb->ki_filp;
+    struct globalfifo_file *gf = filp->private_data;
+    struct globalfifo_dev *dev = gf->dev;
+    size_t count = iov_iter_count(from);
+    size_t need;
 
     DECLARE_WAITQUEUE(wait, current);
 
-    mutex_lock(&dev->mutex);
+    if (0 == count) {
+        return 0;
+    }
+
+    /*数据报模式下每次写入为一条记录，必须整体放入FIFO*/
+    if (READ_ONCE(dev->dgram)) {
+        need = GLOBALFIFO_RECORD_SIZE(count);
+        if (need > globalfifo_capacity(dev)) {
+            return -EMSGSIZE;
+        }
+    } else {
+        need = READ_ONCE(gf->atomic) ? count : 1;
+    }
+
+retry:
+    if (READ_ONCE(dev->mq)) {
+        ret = globalfifo_mq_write(dev, iocb, from, need);
+        if (-GLOBALFIFO_EMODE == ret) {
+            goto retry;
+        }
+        globalfifo_account(dev, GLOBALFIFO_STAT_WRITE, count, ret);
+        return ret;
+    }
+
+    if (READ_ONCE(dev->spsc_active)) {
+        ret = globalfifo_spsc_write(dev, iocb, from, need, READ_ONCE(gf->sndlowat));
+        if (-GLOBALFIFO_EMODE == ret) {
+            goto retry;
+        }
+        globalfifo_account(dev, GLOBALFIFO_STAT_WRITE, count, ret);
+        return ret;
+    }
+
+    ret = globalfifo_lock_iocb(dev, GLOBALFIFO_WR_BUSY, iocb);
+    if (ret) {
+        globalfifo_account(dev, GLOBALFIFO_STAT_WRITE, count, ret);
+        return ret;
+    }
     add_wait_queue(&dev->w_wait, &wait);
 
-    while (GLOBALFIFO_SIZE == dev->current_len) {
-        if (filp->f_flags & O_NONBLOCK) {
+    /*切换到多队列后主环为空，写入条件总是满足，因此先检查模式*/
+    while (set_current_state(TASK_INTERRUPTIBLE), !READ_ONCE(dev->mq) && !globalfifo_writable(dev, need, READ_ONCE(gf->sndlowat))) {
+        if (globalfifo_nonblock(iocb)) {
             ret = -EAGAIN;
             goto out;
         }
-        __set_current_state(TASK_INTERRUPTIBLE);
-
+        globalfifo_side_unlock(dev, GLOBALFIFO_WR_BUSY);
         mutex_unlock(&dev->mutex);
+
+        globalfifo_account_block(dev, GLOBALFIFO_STAT_WRITE, need);
         schedule();
         if (signal_pending(current)) {
             ret = -ERESTARTSYS;
             goto out2;
         }
-        mutex_lock(&dev->mutex);
-    }
 
-    if (count > GLOBALFIFO_SIZE - dev->current_len) {
-        count = GLOBALFIFO_SIZE - dev->current_len;
+        mutex_lock(&dev->mutex);
+        if (globalfifo_side_lock(dev, GLOBALFIFO_WR_BUSY)) {
+            ret = -ERESTARTSYS;
+            goto out_unlock;
+        }
     }
-    
-    /*将数据从用户空间拷贝的内核空间*/
-    if (copy_from_user(dev->mem + dev->current_len, buf, count)) {
-        ret = -EFAULT;
+    __set_current_state(TASK_RUNNING);
+    if (READ_ONCE(dev->mq)) {
+        ret = -GLOBALFIFO_EMODE;
         goto out;
-    } else {
-        dev->current_len += count;
-        printk(KERN_INFO "written %ld bytes, current_len: %d\n", count, dev->current_len);
-
-        wake_up_interruptible(&dev->r_wait);
+    }
 
-        if (dev->async_queue) {
-            kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
-            printk(KERN_DEBUG "%s kill SIGIO POLL_IN: %d\n", __func__, POLL_IN);
-        } else {
-            printk(KERN_DEBUG "%s kill SIGIO failure.\n", __func__);
-        }
-        
-        ret = count;
+    /*将数据从用户空间拷贝的内核空间*/
+    ret = globalfifo_do_write(dev, from, need);
+    if (ret > 0) {
+        globalfifo_wake_readers(dev);   /*数据达到水位线时唤醒读者，否则只启动刷新定时器*/
     }
 out:
+    globalfifo_side_unlock(dev, GLOBALFIFO_WR_BUSY);
+out_unlock:
     mutex_unlock(&dev->mutex);
 out2:
     remove_wait_queue(&dev->w_wait, &wait);
     set_current_state(TASK_RUNNING);
+    if (-GLOBALFIFO_EMODE == ret) {
+        goto retry;
+    }
+    globalfifo_account(dev, GLOBALFIFO_STAT_WRITE, count, ret);
     return ret;
 }
 
@@ -229,7 +1654,7 @@ static loff_t globalfifo_llseek(struct file *filep, loff_t offset, int orig)
             ret = -EINVAL;
             break;
         }
-        if ((unsigned int)offset > GLOBALFIFO_SIZE) {
+        if ((unsigned int)offset > globalfifo_capacity(globalfifo_dev(filep))) {
             ret = -EINVAL;
             break;
         }
@@ -237,7 +1662,7 @@ static loff_t globalfifo_llseek(struct file *filep, loff_t offset, int orig)
         ret = filep->f_pos;
         break;
     case 1:
-        if ((filep->f_pos + offset) > GLOBALFIFO_SIZE) {
+        if ((filep->f_pos + offset) > globalfifo_capacity(globalfifo_dev(filep))) {
             ret = -EINVAL;
             break;
         }
@@ -258,45 +1683,184 @@ static loff_t globalfifo_llseek(struct file *filep, loff_t offset, int orig)
 
 /*
  *轮询
+ *io_uring的读写以IOCB_NOWAIT返回EAGAIN后，通过这里把自己挂到r_wait/w_wait上(fast-poll)，
+ *被带有事件掩码的唤醒后在提交者的上下文中重试，未完成的请求不占用内核线程
  */
-static unsigned int globalfifo_poll(struct file *filp, poll_table *wait)
+static __poll_t globalfifo_poll(struct file *filp, poll_table *wait)
 {
-    unsigned int mask = 0;
-    struct globalfifo_dev *dev = filp->private_data;
-
-    mutex_lock(&dev->mutex);
+    __poll_t mask = 0;
+    struct globalfifo_file *gf = filp->private_data;
+    struct globalfifo_dev *dev = gf->dev;
+    struct globalfifo_ring *ring;
+    unsigned int len, space;
 
     poll_wait(filp, &dev->r_wait, wait);
     poll_wait(filp, &dev->w_wait, wait);
+    smp_mb();   /*与SPSC路径中wq_has_sleeper()的内存屏障配对，避免丢失唤醒*/
 
-    if (0 != dev->current_len) {
-        mask |= POLLIN | POLLRDNORM;
+    /*多队列模式下任一子环有数据即可读，调用者所在CPU的子环有空间即可写*/
+    if (READ_ONCE(dev->mq)) {
+        if (globalfifo_mq_readable(dev)) {
+            mask |= EPOLLIN | EPOLLRDNORM;
+        }
+        if (globalfifo_mq_writable(dev, 1)) {
+            mask |= EPOLLOUT | EPOLLWRNORM;
+        }
+        return mask;
     }
 
-    if (GLOBALFIFO_SIZE != dev->current_len) {
-        mask |= POLLOUT | POLLWRNORM;
+    /*head/tail只需读取一次快照，不必持有mutex，SPSC模式下poll同样无锁*/
+    rcu_read_lock();
+    ring = rcu_dereference(dev->ring);
+    len = globalfifo_ring_len(ring);
+    space = ring->size - len;
+    /*与read/write一样，数据量或空闲空间达到该文件的水位线才算就绪*/
+    if (0 != len && (len >= min(READ_ONCE(gf->rcvlowat), ring->size) || READ_ONCE(dev->flush))) {
+        mask |= EPOLLIN | EPOLLRDNORM;
     }
 
-    mutex_unlock(&dev->mutex);
+    /*数据报模式下至少要能放下长度头和1字节数据*/
+    if (space > (READ_ONCE(dev->dgram) ? GLOBALFIFO_DGRAM_HDR : 0) && space >= min(READ_ONCE(gf->sndlowat), ring->size)) {
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    }
+    rcu_read_unlock();
 
     return mask;
 }
 
+/*
+ *内存映射函数
+ *映射的第0页为控制页(struct globalfifo_ring_ctrl)，其后为环形缓冲区数据区，
+ *用户空间可以在不经过系统调用的情况下直接生产/消费数据
+ */
+static void globalfifo_vma_open(struct vm_area_struct *vma)
+{
+    struct globalfifo_dev *dev = vma->vm_private_data;
+
+    mutex_lock(&dev->mmap_lock);
+    dev->mmap_count++;
+    mutex_unlock(&dev->mmap_lock);
+}
+
+static void globalfifo_vma_close(struct vm_area_struct *vma)
+{
+    struct globalfifo_dev *dev = vma->vm_private_data;
+
+    mutex_lock(&dev->mmap_lock);
+    dev->mmap_count--;
+    mutex_unlock(&dev->mmap_lock);
+}
+
+static const struct vm_operations_struct globalfifo_vm_ops = {
+    .open   = globalfifo_vma_open,
+    .close  = globalfifo_vma_close,
+};
+
+static int globalfifo_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct globalfifo_dev *dev = globalfifo_dev(filp);
+    int ret;
+
+    /*私有映射写入时会产生COW副本，与内核看到的缓冲区不再是同一份*/
+    if (!(vma->vm_flags & VM_SHARED)) {
+        return -EINVAL;
+    }
+
+    /*映射存在期间环不能被替换，映射计数与调整容量由mmap_lock互斥*/
+    mutex_lock(&dev->mmap_lock);
+    if (dev->dgram || dev->mq) {
+        /*记录的长度头不能交给用户空间修改；多队列模式下数据不在主环中*/
+        mutex_unlock(&dev->mmap_lock);
+        return -EINVAL;
+    }
+    ret = remap_vmalloc_range(vma, globalfifo_ring(dev)->ctrl, vma->vm_pgoff);
+    if (!ret) {
+        vma->vm_ops = &globalfifo_vm_ops;
+        vma->vm_private_data = dev;
+        dev->mmap_count++;
+    }
+    mutex_unlock(&dev->mmap_lock);
+
+    return ret;
+}
+
 /*
  *文件操作的结构体
+ *splice/sendfile经由通用实现调用read_iter/write_iter: splice_read把数据从环复制到管道的页中，
+ *splice_write把管道中的页作为bvec类型的iov_iter交给write_iter，数据不再经过用户空间的缓冲区。
+ *tail移动后环中的空间立即被写者复用，不能把环的页直接借给管道，因此每个方向仍各有一次复制。
+ *每次splice_write相当于一次writev，数据报模式下管道中的数据成为一条记录。
  */
 static const struct file_operations globalfifo_fops = {
     .owner          = THIS_MODULE,
     .llseek         = globalfifo_llseek,
-    .read           = globalfifo_read,
-    .write          = globalfifo_write,
+    .read_iter      = globalfifo_read_iter,
+    .write_iter     = globalfifo_write_iter,
+    .splice_read    = generic_file_splice_read,
+    .splice_write   = iter_file_splice_write,
     .unlocked_ioctl = globalfifo_ioctl,
     .poll           = globalfifo_poll,
+    .mmap           = globalfifo_mmap,
     .fasync         = globalfifo_fasync,
     .open           = globalfifo_open,
     .release        = globalfifo_release,
 };
 
+/*
+ *统计计数通过sysfs导出: /sys/class/globalfifo_class/globalfifo_<n>/stats/下每个计数一个文件，
+ *读取时对所有CPU求和，不影响读写路径，生产环境下无需重新编译即可观察
+ */
+static u64 globalfifo_stat_sum(struct device *d, size_t offset)
+{
+    struct globalfifo_dev *dev = dev_get_drvdata(d);
+    u64 sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        sum += *(u64 *)((char *)per_cpu_ptr(dev->stats, cpu) + offset);
+    }
+    return sum;
+}
+
+#define GLOBALFIFO_STAT_ATTR(_name, _field)                                                         \
+static ssize_t _name##_show(struct device *d, struct device_attribute *attr, char *buf)            \
+{                                                                                                   \
+    return sprintf(buf, "%llu\n",                                                                   \
+                   (unsigned long long)globalfifo_stat_sum(d, offsetof(struct globalfifo_stats, _field)));  \
+}                                                                                                   \
+static DEVICE_ATTR_RO(_name)
+
+GLOBALFIFO_STAT_ATTR(reads, calls[GLOBALFIFO_STAT_READ]);
+GLOBALFIFO_STAT_ATTR(writes, calls[GLOBALFIFO_STAT_WRITE]);
+GLOBALFIFO_STAT_ATTR(read_bytes, bytes[GLOBALFIFO_STAT_READ]);
+GLOBALFIFO_STAT_ATTR(write_bytes, bytes[GLOBALFIFO_STAT_WRITE]);
+GLOBALFIFO_STAT_ATTR(read_blocks, blocks[GLOBALFIFO_STAT_READ]);
+GLOBALFIFO_STAT_ATTR(write_blocks, blocks[GLOBALFIFO_STAT_WRITE]);
+GLOBALFIFO_STAT_ATTR(read_eagain, eagain[GLOBALFIFO_STAT_READ]);
+GLOBALFIFO_STAT_ATTR(write_eagain, eagain[GLOBALFIFO_STAT_WRITE]);
+
+static struct attribute *globalfifo_stats_attrs[] = {
+    &dev_attr_reads.attr,
+    &dev_attr_writes.attr,
+    &dev_attr_read_bytes.attr,
+    &dev_attr_write_bytes.attr,
+    &dev_attr_read_blocks.attr,
+    &dev_attr_write_blocks.attr,
+    &dev_attr_read_eagain.attr,
+    &dev_attr_write_eagain.attr,
+    NULL,
+};
+
+static const struct attribute_group globalfifo_stats_group = {
+    .name   = "stats",
+    .attrs  = globalfifo_stats_attrs,
+};
+
+static const struct attribute_group *globalfifo_groups[] = {
+    &globalfifo_stats_group,
+    NULL,
+};
+
 /*
  *初始化字符设备结构体，并注册设备
  */
@@ -304,15 +1868,73 @@ static void globalfifo_setup_cdev(struct globalfifo_dev *dev, int index)
 {
     int err, devno = MKDEV(globalfifo_major, index);
 
+    /*cdev_add之后设备即可被打开，必须先初始化锁和等待队列*/
+    mutex_init(&dev->mutex);
+    mutex_init(&dev->mmap_lock);
+    init_waitqueue_head(&dev->r_wait);
+    init_waitqueue_head(&dev->w_wait);
+    INIT_LIST_HEAD(&dev->files);
+    dev->r_lowat = UINT_MAX;
+    dev->w_lowat = UINT_MAX;
+    hrtimer_init(&dev->flush_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->flush_timer.function = globalfifo_flush_timer;
+    dev->spsc = globalfifo_spsc;
+    dev->mq = globalfifo_mq;
+    dev->mq_cur = -1;
+    globalfifo_spsc_update(dev);
     cdev_init(&dev->cdev, &globalfifo_fops);
     dev->cdev.owner = THIS_MODULE;
     err = cdev_add(&dev->cdev, devno, 1);
     if (err) {
         printk(KERN_INFO "Error %d adding globalfifo_%d", err, index);
     }
-    mutex_init(&dev->mutex);
-    init_waitqueue_head(&dev->r_wait);
-    init_waitqueue_head(&dev->w_wait);
+}
+
+/*
+ *设备所在的NUMA节点: 各设备依次分布到各节点上，
+ *使绑定在不同节点上的生产者/消费者可以选用本地节点的设备
+ */
+static int globalfifo_dev_node(int index)
+{
+    return cpu_to_node(cpumask_local_spread(index, NUMA_NO_NODE));
+}
+
+/*
+ *在设备所在节点上申请设备结构体，并申请可映射到用户空间的控制页和环形缓冲区以及每CPU统计计数，
+ *多队列模式的子环在各CPU第一次写入时才申请，这里只申请索引数组
+ */
+static struct globalfifo_dev *globalfifo_alloc_dev(int index, unsigned int size)
+{
+    struct globalfifo_dev *dev;
+    int node = globalfifo_dev_node(index);
+
+    dev = kzalloc_node(sizeof(*dev), GFP_KERNEL, node);
+    if (!dev) {
+        return NULL;
+    }
+    dev->node = node;
+    RCU_INIT_POINTER(dev->ring, globalfifo_alloc_ring(size, node));
+    dev->stats = alloc_percpu(struct globalfifo_stats);
+    dev->mq_rings = kcalloc(nr_cpu_ids, sizeof(*dev->mq_rings), GFP_KERNEL);
+    if (!rcu_access_pointer(dev->ring) || !dev->stats || !dev->mq_rings) {
+        globalfifo_free_ring(rcu_access_pointer(dev->ring));
+        free_percpu(dev->stats);
+        kfree(dev->mq_rings);
+        kfree(dev);
+        return NULL;
+    }
+
+    return dev;
+}
+
+static void globalfifo_free_dev(struct globalfifo_dev *dev)
+{
+    if (dev) {
+        globalfifo_free_ring(rcu_access_pointer(dev->ring));
+        free_percpu(dev->stats);
+        globalfifo_mq_free(dev);
+        kfree(dev);
+    }
 }
 
 /*
@@ -324,6 +1946,17 @@ static int __init globalfifo_init(void)
     int ret, i;
     struct device *globalfifo_device = NULL;
     dev_t devno = MKDEV(globalfifo_major, 0);
+    unsigned int size = globalfifo_check_size(globalfifo_size);
+
+    if (!size) {
+        printk(KERN_ERR "globalfifo: invalid globalfifo_size %u\n", globalfifo_size);
+        return -EINVAL;
+    }
+    globalfifo_mq_size = globalfifo_check_size(globalfifo_mq_size);
+    if (!globalfifo_mq_size || globalfifo_mq < GLOBALFIFO_MQ_OFF || globalfifo_mq > GLOBALFIFO_MQ_TS) {
+        printk(KERN_ERR "globalfifo: invalid globalfifo_mq %d or globalfifo_mq_size\n", globalfifo_mq);
+        return -EINVAL;
+    }
 
     if (globalfifo_major) {  /*如果设备号为非0,则注册设备号*/
         ret = register_chrdev_region(devno, DEVICE_NUM, "globalfifo");
@@ -334,31 +1967,34 @@ static int __init globalfifo_init(void)
     if (ret < 0) {
         return ret;
     }
+
+    /*每个设备单独在所在节点上申请内存块，sysfs统计属性随设备文件一起创建，因此先于设备文件申请*/
+    for (i=0; i < DEVICE_NUM; i++) {
+        globalfifo_devp[i] = globalfifo_alloc_dev(i, size);
+        if (!globalfifo_devp[i]) {
+            ret = -ENOMEM;
+            goto malloc_err;
+        }
+    }
+
     /*注册设备类，使可以自动生成设备文件*/
     globalfifo_class = class_create(THIS_MODULE, "globalfifo_class");
     if (IS_ERR(globalfifo_class)) {
         ret = PTR_ERR(globalfifo_class);
-        goto class_err;
+        goto malloc_err;
     }
     for (i=0; i < DEVICE_NUM; i++) {
-        /*自动生成设备文件*/
-        globalfifo_device = device_create(globalfifo_class, NULL, MKDEV(globalfifo_major, i), NULL, "globalfifo_%d", i);
+        /*自动生成设备文件，并在其下创建stats属性组*/
+        globalfifo_device = device_create_with_groups(globalfifo_class, NULL, MKDEV(globalfifo_major, i),
+                                                      globalfifo_devp[i], globalfifo_groups, "globalfifo_%d", i);
         if (IS_ERR(globalfifo_device)) {
             ret = PTR_ERR(globalfifo_device);
             goto device_err;
         }
     }
-    
-    /*申请内存块*/
-    globalfifo_devp = kzalloc(sizeof(struct globalfifo_dev) * DEVICE_NUM, GFP_KERNEL);
-
-    if (!globalfifo_devp) {
-        ret = -ENOMEM;
-        goto malloc_err;
-    }
 
     for (i=0; i < DEVICE_NUM; i++) {
-        globalfifo_setup_cdev(globalfifo_devp + i, i);
+        globalfifo_setup_cdev(globalfifo_devp[i], i);
     }
 
 /*note 1:*/
@@ -391,22 +2027,22 @@ static int __init globalfifo_init(void)
 /*
 devfile_error:
     for (i=0; i < DEVICE_NUM; i++) {
-        cdev_del(&(globalfifo_devp +i)->cdev);
+        cdev_del(&globalfifo_devp[i]->cdev);
     }
-
-    kfree(globalfifo_devp);
 */
 /*end note 2*/
-malloc_err:
-    i = DEVICE_NUM;
-
 device_err:
     while (i--) {
-        device_destroy(globalfifo_class,MKDEV(globalfifo_major, i-1));
+        device_destroy(globalfifo_class, MKDEV(globalfifo_major, i));
     }
     class_destroy(globalfifo_class);
 
-class_err:
+malloc_err:
+    for (i=0; i < DEVICE_NUM; i++) {
+        globalfifo_free_dev(globalfifo_devp[i]);
+        globalfifo_devp[i] = NULL;
+    }
+
     unregister_chrdev_region(devno, DEVICE_NUM);
     return ret;
 }
@@ -420,16 +2056,19 @@ static void __exit globalfifo_exit(void)
 {
     int i;
     for (i=0; i < DEVICE_NUM; i++) {    /*从系统注销设备*/
-        cdev_del(&(globalfifo_devp +i)->cdev);
+        cdev_del(&globalfifo_devp[i]->cdev);
+        hrtimer_cancel(&globalfifo_devp[i]->flush_timer);
     }
 
-    kfree(globalfifo_devp);  /*释放内存块*/
-
-    unregister_chrdev_region(MKDEV(globalfifo_major, 0), DEVICE_NUM);    /*使用设备号*/
-    for (i=0; i < DEVICE_NUM; i++) {    /*删除设备文件*/
+    for (i=0; i < DEVICE_NUM; i++) {    /*删除设备文件，之后sysfs属性不再访问设备结构体*/
         device_destroy(globalfifo_class, MKDEV(globalfifo_major, i));
     }
     class_destroy(globalfifo_class); /*注销设备类*/
+
+    for (i=0; i < DEVICE_NUM; i++) {
+        globalfifo_free_dev(globalfifo_devp[i]);  /*释放内存块*/
+    }
+    unregister_chrdev_region(MKDEV(globalfifo_major, 0), DEVICE_NUM);    /*使用设备号*/
     printk("Bye, See you next time.\n");
 }
 module_exit(globalfifo_exit);
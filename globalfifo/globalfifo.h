@@ -0,0 +1,126 @@
+/*
+ * globalfifo ioctl definitions, shared by the driver and user space programs
+ *
+ * copyright (c) 2017 Nick Yan
+ *
+ * Licensed under GPLv2 or later
+ */
+
+#ifndef _GLOBALFIFO_H
+#define _GLOBALFIFO_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define GLOBALFIFO_IOC_MAGIC    'g'
+
+/*
+ *单生产者/单消费者(SPSC)模式
+ *SET_SPSC: arg为0关闭，非0开启
+ *GET_SPSC: 通过int指针返回GLOBALFIFO_SPSC_*标志的组合
+ */
+#define GLOBALFIFO_IOC_SET_SPSC     _IO(GLOBALFIFO_IOC_MAGIC, 1)
+#define GLOBALFIFO_IOC_GET_SPSC     _IOR(GLOBALFIFO_IOC_MAGIC, 2, int)
+
+#define GLOBALFIFO_SPSC_ON          0x1     /*已请求SPSC模式                    */
+#define GLOBALFIFO_SPSC_ACTIVE      0x2     /*读写端均不超过一个，无锁路径已生效*/
+
+/*
+ *门铃: 通过mmap直接更新head/tail后调用，唤醒在read/write/poll中等待的对端
+ */
+#define GLOBALFIFO_IOC_DOORBELL     _IO(GLOBALFIFO_IOC_MAGIC, 3)
+
+/*
+ *FIFO容量(字节)
+ *SET_SIZE: arg为新容量，不足一页时按一页处理，再向上取整为2的幂；超过1GB返回EINVAL，
+ *          FIFO非空或已被mmap时返回EBUSY
+ *GET_SIZE: 通过unsigned int指针返回当前容量
+ */
+#define GLOBALFIFO_IOC_SET_SIZE     _IO(GLOBALFIFO_IOC_MAGIC, 4)
+#define GLOBALFIFO_IOC_GET_SIZE     _IOR(GLOBALFIFO_IOC_MAGIC, 5, unsigned int)
+
+/*
+ *整体读写(对当前打开的文件生效)
+ *开启后，总长度不超过容量的read/write/readv/writev要么全部完成，要么不传输任何数据:
+ *阻塞模式下等待至数据/空间足够，非阻塞模式下返回EAGAIN。超过容量的请求仍按流方式部分完成。
+ *SET_ATOMIC: arg为0关闭，非0开启
+ *GET_ATOMIC: 通过int指针返回当前设置
+ */
+#define GLOBALFIFO_IOC_SET_ATOMIC   _IO(GLOBALFIFO_IOC_MAGIC, 6)
+#define GLOBALFIFO_IOC_GET_ATOMIC   _IOR(GLOBALFIFO_IOC_MAGIC, 7, int)
+
+/*
+ *数据报模式(对设备的所有打开者生效)
+ *每次write/writev写入一条记录，每次read/readv恰好读出一条记录；
+ *记录超过容量时write返回EMSGSIZE，读缓冲区放不下下一条记录时read返回EMSGSIZE且记录保留。
+ *只能在FIFO为空且没有被mmap时切换(否则返回EBUSY)，数据报模式下不能mmap。
+ *SET_DGRAM: arg为0关闭，非0开启
+ *GET_DGRAM: 通过int指针返回当前设置
+ */
+#define GLOBALFIFO_IOC_SET_DGRAM    _IO(GLOBALFIFO_IOC_MAGIC, 8)
+#define GLOBALFIFO_IOC_GET_DGRAM    _IOR(GLOBALFIFO_IOC_MAGIC, 9, int)
+
+/*
+ *水位线(对当前打开的文件生效)
+ *rcvlowat: 阻塞读等待至少有这么多数据(或整个FIFO已满)才返回，poll/epoll同样到此时才报告可读，
+ *          与SO_RCVLOWAT类似；写者只在数据量达到所有读端水位线的最小值时才唤醒读者
+ *sndlowat: 写端同理，空闲空间达到水位线才可写/被唤醒
+ *flush_us: 有数据但低于rcvlowat时最多等待的微秒数，到期后读端忽略水位线，0表示一直等待
+ *rcvlowat/sndlowat为0时按1处理，即默认行为
+ */
+struct globalfifo_watermark {
+    __u32 rcvlowat;
+    __u32 sndlowat;
+    __u32 flush_us;
+};
+
+#define GLOBALFIFO_IOC_SET_WATERMARK    _IOW(GLOBALFIFO_IOC_MAGIC, 10, struct globalfifo_watermark)
+#define GLOBALFIFO_IOC_GET_WATERMARK    _IOR(GLOBALFIFO_IOC_MAGIC, 11, struct globalfifo_watermark)
+
+/*
+ *多队列模式(对设备的所有打开者生效)
+ *每个CPU有一个独立的子环(容量由模块参数globalfifo_mq_size决定)，写者只写入所在CPU的子环，
+ *同一CPU上的写者之间才会竞争，不再争用设备的mutex和共享的head；读者依次从各子环取出数据。
+ *每次write/writev在子环中成为一条记录，整体模式下不超过子环容量的写入不会被拆开；
+ *读取按流方式进行，一次read可以拼接多条记录，也可以只读走一条记录的一部分，剩余部分在下一次read中先返回。
+ *多队列模式下水位线、刷新超时和整体读取不生效，不能mmap，不能切换数据报模式。
+ *只能在FIFO为空、没有被mmap且设备只被调用者打开时切换(否则返回EBUSY)。
+ *
+ *各模式下的顺序保证:
+ *  单队列(默认，包括SPSC): 所有写入按完成写入的先后构成一个全局FIFO
+ *  数据报: 同单队列，记录之间不会交错
+ *  GLOBALFIFO_MQ_RR: 只保证同一子环内的顺序，即同一CPU上完成的写入按先后读出；
+ *                    读者每读完一条记录就轮转到下一个CPU，不同CPU之间没有先后关系，
+ *                    写者线程在两次写入之间迁移到其他CPU时，这两次写入可能颠倒
+ *  GLOBALFIFO_MQ_TS: 记录在发布时打上单调时钟的时间戳，读者每次取各子环第一条记录中最早的一条；
+ *                    同一子环内的顺序严格保证，子环之间近似按时间排序，
+ *                    读者扫描期间才发布的更早的记录可能排在已读出的记录之后
+ *SET_MQ: arg为GLOBALFIFO_MQ_*之一
+ *GET_MQ: 通过int指针返回当前模式
+ */
+#define GLOBALFIFO_MQ_OFF           0       /*单队列                          */
+#define GLOBALFIFO_MQ_RR            1       /*多队列，读者按CPU轮转           */
+#define GLOBALFIFO_MQ_TS            2       /*多队列，读者按记录时间戳合并    */
+
+#define GLOBALFIFO_IOC_SET_MQ       _IO(GLOBALFIFO_IOC_MAGIC, 12)
+#define GLOBALFIFO_IOC_GET_MQ       _IOR(GLOBALFIFO_IOC_MAGIC, 13, int)
+
+/*
+ *mmap映射布局: 偏移0为控制页，偏移data_offset处开始为size字节的环形数据区
+ *head/tail为自由递增的下标，取模size后为数据区中的偏移，head - tail为数据长度。
+ *生产者写入数据后以release语义更新head，消费者以acquire语义读取head后再读数据，
+ *读完后以release语义更新tail；两者分别位于不同的cache line，避免生产者和消费者互相干扰。
+ *映射的用户与read()/write()调用者共享同一个环，同一端(生产或消费)只能有一个使用者。
+ */
+#define GLOBALFIFO_CACHELINE        64
+
+struct globalfifo_ring_ctrl {
+    __u32 head;
+    __u8  __pad0[GLOBALFIFO_CACHELINE - sizeof(__u32)];
+    __u32 tail;
+    __u8  __pad1[GLOBALFIFO_CACHELINE - sizeof(__u32)];
+    __u32 size;                 /*数据区大小(字节)，2的幂*/
+    __u32 data_offset;          /*数据区在映射中的偏移*/
+};
+
+#endif /* _GLOBALFIFO_H */
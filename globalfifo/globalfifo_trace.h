@@ -0,0 +1,115 @@
+/*
+ * globalfifo tracepoints
+ *
+ * copyright (c) 2017 Nick Yan
+ *
+ * Licensed under GPLv2 or later
+ */
+
+/*
+ *跟踪点，替代读写路径上的printk，未开启时只是一条不跳转的指令:
+ *  echo 1 > /sys/kernel/debug/tracing/events/globalfifo/enable
+ *  cat /sys/kernel/debug/tracing/trace_pipe
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM globalfifo
+
+#if !defined(_GLOBALFIFO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _GLOBALFIFO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ *一次read/write(readv/writev)调用结束，ret为返回值
+ */
+DECLARE_EVENT_CLASS(globalfifo_rw,
+
+    TP_PROTO(int minor, size_t count, ssize_t ret),
+
+    TP_ARGS(minor, count, ret),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(size_t, count)
+        __field(ssize_t, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->count = count;
+        __entry->ret = ret;
+    ),
+
+    TP_printk("minor=%d count=%zu ret=%zd", __entry->minor, __entry->count, __entry->ret)
+);
+
+DEFINE_EVENT(globalfifo_rw, globalfifo_read,
+    TP_PROTO(int minor, size_t count, ssize_t ret),
+    TP_ARGS(minor, count, ret)
+);
+
+DEFINE_EVENT(globalfifo_rw, globalfifo_write,
+    TP_PROTO(int minor, size_t count, ssize_t ret),
+    TP_ARGS(minor, count, ret)
+);
+
+/*
+ *读者/写者因数据或空闲空间不足进入睡眠，need为本次至少需要的字节数，len为当时的数据长度
+ */
+TRACE_EVENT(globalfifo_block,
+
+    TP_PROTO(int minor, bool write, size_t need, unsigned int len),
+
+    TP_ARGS(minor, write, need, len),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(bool, write)
+        __field(size_t, need)
+        __field(unsigned int, len)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->write = write;
+        __entry->need = need;
+        __entry->len = len;
+    ),
+
+    TP_printk("minor=%d %s need=%zu len=%u", __entry->minor,
+              __entry->write ? "write" : "read", __entry->need, __entry->len)
+);
+
+/*
+ *唤醒等待中的读者(write为false)或写者，len为唤醒时的数据长度
+ */
+TRACE_EVENT(globalfifo_wake,
+
+    TP_PROTO(int minor, bool write, unsigned int len),
+
+    TP_ARGS(minor, write, len),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(bool, write)
+        __field(unsigned int, len)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->write = write;
+        __entry->len = len;
+    ),
+
+    TP_printk("minor=%d %s len=%u", __entry->minor,
+              __entry->write ? "writers" : "readers", __entry->len)
+);
+
+#endif /* _GLOBALFIFO_TRACE_H */
+
+/*头文件不在include/trace/events下，需告诉define_trace.h从模块目录包含本文件*/
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE globalfifo_trace
+#include <trace/define_trace.h>
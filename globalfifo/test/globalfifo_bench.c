@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <sys/ioctl.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo读写吞吐测试
+ *先把FIFO预填充到(容量 - 单次传输长度)，再循环"写n字节、读n字节"，使FIFO始终接近满，
+ *这样每次read都面对一个几乎满的缓冲区，能体现读路径的开销是否与缓冲区中剩余数据量相关。
+ *分别在加载修改前后的globalfifo.ko时运行本程序，即可对比改动前后的结果。
+ *
+ *用法: globalfifo_bench [设备文件] [每种长度的测试秒数]
+ */
+
+#define FIFO_CLEAR      0x01
+#define FIFO_CAPACITY   4096    /*不支持GLOBALFIFO_IOC_GET_SIZE的旧驱动的容量*/
+
+static unsigned int capacity = FIFO_CAPACITY;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(int fd, size_t len, double seconds)
+{
+    static char buf[FIFO_CAPACITY];
+    size_t fill = capacity - len;
+    unsigned long long bytes = 0, calls = 0;
+    double start, elapsed;
+    ssize_t ret;
+
+    if (ioctl(fd, FIFO_CLEAR, 0) < 0) {
+        perror("ioctl(FIFO_CLEAR)");
+        return -1;
+    }
+    memset(buf, 'a', sizeof(buf));
+    while (fill) {
+        ret = write(fd, buf, fill < sizeof(buf) ? fill : sizeof(buf));
+        if (ret <= 0) {
+            perror("prefill");
+            return -1;
+        }
+        fill -= ret;
+    }
+
+    start = now_sec();
+    do {
+        int i;
+
+        for (i = 0; i < 1024; i++) {
+            ret = write(fd, buf, len);
+            if (ret != (ssize_t)len) {
+                perror("write");
+                return -1;
+            }
+            ret = read(fd, buf, len);
+            if (ret != (ssize_t)len) {
+                perror("read");
+                return -1;
+            }
+            bytes += len;
+            calls += 2;
+        }
+        elapsed = now_sec() - start;
+    } while (elapsed < seconds);
+
+    printf("%6zu B  %12.0f bytes/s  %12.0f syscalls/s\n", len, bytes / elapsed, calls / elapsed);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    size_t sizes[] = { 1, 64, 4096 };
+    unsigned int i;
+    int fd;
+
+    fd = open(path, O_RDWR | O_NONBLOCK);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", path);
+        return 1;
+    }
+
+    ioctl(fd, GLOBALFIFO_IOC_GET_SIZE, &capacity);
+    printf("globalfifo bench on %s (capacity %u), %.1f s per size\n", path, capacity, seconds);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (run(fd, sizes[i], seconds) < 0) {
+            break;
+        }
+    }
+
+    ioctl(fd, FIFO_CLEAR, 0);
+    close(fd);
+    return 0;
+}
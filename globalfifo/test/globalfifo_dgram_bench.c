@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo数据报模式测试: 16B~1KiB载荷下每秒传输的记录数
+ *  dgram : 开启GLOBALFIFO_IOC_SET_DGRAM，生产者每条记录一次write()，消费者每次read()恰好得到一条记录
+ *  stream: 字节流模式，生产者用整体模式的writev()写入4字节长度头和载荷，消费者大块read()后在用户空间重新分帧
+ *一个生产者线程和一个消费者线程，每种载荷长度传输相同数目的记录。
+ *
+ *用法: globalfifo_dgram_bench [设备文件] [每种长度的记录数]
+ */
+
+#define FIFO_CLEAR      0x01
+#define MAX_PAYLOAD     1024
+
+struct bench {
+    const char *path;
+    int dgram;
+    size_t payload;
+    long records;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer(void *arg)
+{
+    struct bench *b = arg;
+    char payload[MAX_PAYLOAD];
+    uint32_t hdr = b->payload;
+    struct iovec iov[2];
+    long i;
+    int fd;
+
+    fd = open(b->path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        return NULL;
+    }
+    /*字节流模式下开启整体写入，头和载荷不会只写入一部分*/
+    ioctl(fd, GLOBALFIFO_IOC_SET_ATOMIC, !b->dgram);
+
+    memset(payload, 'd', sizeof(payload));
+    for (i = 0; i < b->records; i++) {
+        ssize_t ret;
+
+        if (b->dgram) {
+            ret = write(fd, payload, b->payload);
+        } else {
+            iov[0].iov_base = &hdr;
+            iov[0].iov_len = sizeof(hdr);
+            iov[1].iov_base = payload;
+            iov[1].iov_len = b->payload;
+            ret = writev(fd, iov, 2) - sizeof(hdr);
+        }
+        if (ret != (ssize_t)b->payload) {
+            perror("write");
+            break;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+/*
+ *消费者，返回收到的记录数
+ */
+static long consume(struct bench *b)
+{
+    static char buf[64 << 10];
+    size_t have = 0, pos = 0;
+    long got = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = open(b->path, O_RDONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        return 0;
+    }
+
+    while (got < b->records) {
+        if (b->dgram) {
+            ret = read(fd, buf, MAX_PAYLOAD);
+            if (ret != (ssize_t)b->payload) {
+                perror("read");
+                break;
+            }
+            got++;
+            continue;
+        }
+
+        /*字节流模式: 把未处理完的部分移到缓冲区开头，再读入新数据后逐条分帧*/
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+        pos = 0;
+        ret = read(fd, buf + have, sizeof(buf) - have);
+        if (ret <= 0) {
+            perror("read");
+            break;
+        }
+        have += ret;
+        while (have - pos >= sizeof(uint32_t)) {
+            uint32_t len;
+
+            memcpy(&len, buf + pos, sizeof(len));
+            if (have - pos < sizeof(len) + len) {
+                break;
+            }
+            pos += sizeof(len) + len;
+            got++;
+        }
+    }
+
+    close(fd);
+    return got;
+}
+
+static void run(struct bench *b)
+{
+    double start, elapsed;
+    pthread_t tid;
+    long got;
+    int fd;
+
+    fd = open(b->path, O_RDWR);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        return;
+    }
+    ioctl(fd, FIFO_CLEAR, 0);
+    if (ioctl(fd, GLOBALFIFO_IOC_SET_DGRAM, b->dgram) < 0) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_DGRAM)");
+        close(fd);
+        return;
+    }
+
+    start = now_sec();
+    pthread_create(&tid, NULL, producer, b);
+    got = consume(b);
+    pthread_join(tid, NULL);
+    elapsed = now_sec() - start;
+
+    printf("%-6s %5zu B  %12.0f records/s  %8.1f MB/s\n", b->dgram ? "dgram" : "stream",
+           b->payload, got / elapsed, got * b->payload / elapsed / 1e6);
+
+    ioctl(fd, FIFO_CLEAR, 0);
+    ioctl(fd, GLOBALFIFO_IOC_SET_DGRAM, 0);
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t sizes[] = { 16, 64, 256, 1024 };
+    struct bench b;
+    unsigned int i;
+
+    b.path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    b.records = argc > 2 ? atol(argv[2]) : 1000000;
+
+    printf("globalfifo datagram bench on %s, %ld records per run\n", b.path, b.records);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        b.payload = sizes[i];
+        b.dgram = 1;
+        run(&b);
+        b.dgram = 0;
+        run(&b);
+    }
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "globalfifo_ring.h"
+
+/*
+ *globalfifo吞吐对比: read()/write()系统调用 与 mmap共享环
+ *一个生产者线程和一个消费者线程通过同一个设备传输指定字节数的数据，输出GB/s。
+ *  syscall : 生产者write()，消费者read()
+ *  mmap    : 双方通过gf_ring_write/gf_ring_read在用户空间复制数据，只在对端睡眠时按门铃
+ *  zerocopy: 生产者直接在环中填数据，消费者直接在环中校验数据，没有任何中间缓冲区
+ *
+ *用法: globalfifo_mmap_bench [设备文件] [传输MB数] [单次块大小]
+ */
+
+#define FIFO_CLEAR  0x01
+
+enum mode { MODE_SYSCALL, MODE_MMAP, MODE_ZEROCOPY };
+
+struct bench {
+    const char *path;
+    enum mode mode;
+    unsigned long long total;
+    size_t chunk;
+    unsigned long long checksum;    /*消费者计算的校验和，防止编译器把读取优化掉*/
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer(void *arg)
+{
+    struct bench *b = arg;
+    unsigned long long done = 0;
+    char *buf = malloc(b->chunk);
+    struct gf_ring ring;
+    int fd = -1;
+    ssize_t ret;
+
+    memset(buf, 'g', b->chunk);
+    if (MODE_SYSCALL == b->mode) {
+        fd = open(b->path, O_WRONLY);
+    } else if (gf_ring_open(&ring, b->path) < 0) {
+        perror("gf_ring_open");
+        goto out;
+    }
+
+    while (done < b->total) {
+        size_t n = b->total - done < b->chunk ? b->total - done : b->chunk;
+
+        if (MODE_SYSCALL == b->mode) {
+            ret = write(fd, buf, n);
+        } else if (MODE_MMAP == b->mode) {
+            ret = gf_ring_write(&ring, buf, n);
+        } else {
+            void *ptr;
+
+            ret = gf_ring_reserve(&ring, &ptr);
+            if (0 == ret) {
+                continue;   /*忙等，零拷贝测试关注的是纯数据路径*/
+            }
+            if ((size_t)ret > n) {
+                ret = n;
+            }
+            memset(ptr, 'g', ret);
+            gf_ring_commit(&ring, ret);
+        }
+        if (ret <= 0) {
+            perror("produce");
+            break;
+        }
+        done += ret;
+    }
+
+    if (MODE_SYSCALL == b->mode) {
+        close(fd);
+    } else {
+        gf_ring_close(&ring);
+    }
+out:
+    free(buf);
+    return NULL;
+}
+
+static void consume(struct bench *b)
+{
+    unsigned long long done = 0, sum = 0;
+    char *buf = malloc(b->chunk);
+    struct gf_ring ring;
+    int fd = -1;
+    ssize_t ret;
+
+    if (MODE_SYSCALL == b->mode) {
+        fd = open(b->path, O_RDONLY);
+    } else if (gf_ring_open(&ring, b->path) < 0) {
+        perror("gf_ring_open");
+        free(buf);
+        return;
+    }
+
+    while (done < b->total) {
+        if (MODE_SYSCALL == b->mode) {
+            ret = read(fd, buf, b->chunk);
+        } else if (MODE_MMAP == b->mode) {
+            ret = gf_ring_read(&ring, buf, b->chunk);
+        } else {
+            const void *ptr;
+
+            ret = gf_ring_peek(&ring, &ptr);
+            if (0 == ret) {
+                continue;
+            }
+            if ((size_t)ret > b->chunk) {
+                ret = b->chunk;
+            }
+            sum += ((const unsigned char *)ptr)[ret - 1];
+            gf_ring_release(&ring, ret);
+            done += ret;
+            continue;
+        }
+        if (ret <= 0) {
+            perror("consume");
+            break;
+        }
+        sum += (unsigned char)buf[ret - 1];
+        done += ret;
+    }
+    b->checksum = sum;
+
+    if (MODE_SYSCALL == b->mode) {
+        close(fd);
+    } else {
+        gf_ring_close(&ring);
+    }
+    free(buf);
+}
+
+static void run(struct bench *b, const char *name)
+{
+    pthread_t tid;
+    double start, elapsed;
+    int fd;
+
+    fd = open(b->path, O_RDWR);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        return;
+    }
+    ioctl(fd, FIFO_CLEAR, 0);
+    close(fd);
+
+    start = now_sec();
+    pthread_create(&tid, NULL, producer, b);
+    consume(b);
+    pthread_join(tid, NULL);
+    elapsed = now_sec() - start;
+
+    printf("%-9s %8.3f GB/s  (%llu bytes in %.3f s, chunk %zu B)\n",
+           name, b->total / elapsed / 1e9, b->total, elapsed, b->chunk);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench b;
+
+    b.path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    b.total = (argc > 2 ? strtoull(argv[2], NULL, 0) : 256) << 20;
+    b.chunk = argc > 3 ? strtoul(argv[3], NULL, 0) : 4096;
+
+    b.mode = MODE_SYSCALL;
+    run(&b, "syscall");
+    b.mode = MODE_MMAP;
+    run(&b, "mmap");
+    b.mode = MODE_ZEROCOPY;
+    run(&b, "zerocopy");
+
+    return 0;
+}
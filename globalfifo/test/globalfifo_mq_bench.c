@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo多生产者争用测试: 1~32个生产者线程(第i个绑定到CPU i % CPU数)向同一个设备写入64字节的消息，
+ *一个消费者线程大块读取，分别在单队列、多队列轮转(GLOBALFIFO_MQ_RR)、多队列时间戳(GLOBALFIFO_MQ_TS)模式下
+ *输出每秒写入的消息数。单队列模式下所有生产者争用设备的mutex和写端锁，多队列模式下只有绑定在同一CPU上的生产者争用。
+ *消费者检查每个生产者的消息序号连续: 生产者绑定在固定的CPU上，三种模式都保证同一生产者的消息按序。
+ *
+ *用法: globalfifo_mq_bench [设备文件] [每项测试秒数]
+ */
+
+#define FIFO_CLEAR      0x01
+#define MSG_SIZE        64
+#define MAX_PRODUCERS   32
+
+struct msg {
+    uint32_t producer;
+    uint32_t seq;
+    char payload[MSG_SIZE - 2 * sizeof(uint32_t)];
+};
+
+struct producer {
+    const char *path;
+    int id;
+    int cpu;
+    unsigned long sent;
+    pthread_t tid;
+};
+
+static volatile int stop;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *produce(void *arg)
+{
+    struct producer *p = arg;
+    struct msg m;
+    cpu_set_t set;
+    int fd;
+
+    CPU_ZERO(&set);
+    CPU_SET(p->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    fd = open(p->path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", p->path);
+        return NULL;
+    }
+    /*整体写入，单队列模式下消息不会被拆开后与其他生产者的数据交错*/
+    ioctl(fd, GLOBALFIFO_IOC_SET_ATOMIC, 1);
+
+    memset(&m, 'm', sizeof(m));
+    m.producer = p->id;
+    for (m.seq = 0; !stop; m.seq++) {
+        if (write(fd, &m, sizeof(m)) != sizeof(m)) {
+            perror("write");
+            break;
+        }
+    }
+    p->sent = m.seq;
+
+    close(fd);
+    return NULL;
+}
+
+struct consumer {
+    int fd;
+    volatile unsigned long total;       /*生产者全部退出后才确定*/
+    unsigned long got;
+    long errors;                        /*序号不连续的次数*/
+    pthread_t tid;
+};
+
+/*
+ *消费者，读到total条消息为止，阻塞读可能在最后一条消息之后一直等待，因此用非阻塞读加poll
+ */
+static void *consume(void *arg)
+{
+    static char buf[64 << 10];
+    struct consumer *c = arg;
+    uint32_t next[MAX_PRODUCERS] = { 0 };
+    struct pollfd pfd = { c->fd, POLLIN, 0 };
+    ssize_t ret, off;
+
+    while (c->got < c->total) {
+        ret = read(c->fd, buf, sizeof(buf));
+        if (ret < 0 && EAGAIN == errno) {
+            poll(&pfd, 1, 10);
+            continue;
+        }
+        if (ret <= 0 || ret % MSG_SIZE) {
+            perror("read");
+            break;
+        }
+        for (off = 0; off < ret; off += MSG_SIZE) {
+            struct msg *m = (struct msg *)(buf + off);
+
+            if (m->producer >= MAX_PRODUCERS || m->seq != next[m->producer]) {
+                c->errors++;
+            } else {
+                next[m->producer]++;
+            }
+            c->got++;
+        }
+    }
+    return NULL;
+}
+
+static void run(const char *path, int mode, int nproducers, int ncpus, double seconds)
+{
+    static const char *names[] = { "single", "mq-rr", "mq-ts" };
+    struct producer p[MAX_PRODUCERS];
+    struct consumer c;
+    unsigned long sent = 0;
+    double start, elapsed;
+    int i;
+
+    /*切换模式要求设备只被调用者打开，因此先切换模式，再启动生产者*/
+    c.fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (-1 == c.fd) {
+        printf("open device file %s error.\n", path);
+        return;
+    }
+    ioctl(c.fd, FIFO_CLEAR, 0);
+    if (ioctl(c.fd, GLOBALFIFO_IOC_SET_MQ, mode) < 0) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_MQ)");
+        close(c.fd);
+        return;
+    }
+    c.total = (unsigned long)-1;
+    c.got = 0;
+    c.errors = 0;
+
+    stop = 0;
+    start = now_sec();
+    pthread_create(&c.tid, NULL, consume, &c);
+    for (i = 0; i < nproducers; i++) {
+        p[i].path = path;
+        p[i].id = i;
+        p[i].cpu = i % ncpus;
+        p[i].sent = 0;
+        pthread_create(&p[i].tid, NULL, produce, &p[i]);
+    }
+
+    usleep(seconds * 1e6);
+    stop = 1;
+    for (i = 0; i < nproducers; i++) {
+        pthread_join(p[i].tid, NULL);
+        sent += p[i].sent;
+    }
+    elapsed = now_sec() - start;
+    c.total = sent;
+    pthread_join(c.tid, NULL);
+
+    printf("%-6s %2d producers  %12.0f msgs/s  %8.1f MB/s  %ld out of order\n", names[mode], nproducers,
+           sent / elapsed, sent * MSG_SIZE / elapsed / 1e6, c.errors);
+
+    ioctl(c.fd, FIFO_CLEAR, 0);
+    ioctl(c.fd, GLOBALFIFO_IOC_SET_MQ, GLOBALFIFO_MQ_OFF);
+    close(c.fd);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    double seconds = argc > 2 ? atof(argv[2]) : 1;
+    int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int modes[] = { GLOBALFIFO_MQ_OFF, GLOBALFIFO_MQ_RR, GLOBALFIFO_MQ_TS };
+    unsigned int i;
+    int n;
+
+    printf("globalfifo multi-producer bench on %s, %d CPUs, %.1f s per run\n", path, ncpus, seconds);
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        for (n = 1; n <= MAX_PRODUCERS; n *= 2) {
+            run(path, modes[i], n, ncpus, seconds);
+        }
+    }
+
+    return 0;
+}
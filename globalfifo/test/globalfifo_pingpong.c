@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo两线程乒乓延迟测试
+ *线程A写globalfifo_0、读globalfifo_1，线程B读globalfifo_0后把消息原样写入globalfifo_1，
+ *两个线程分别绑定到指定的CPU上。每个设备恰好一个读者一个写者，可分别测试加锁模式和SPSC模式。
+ *单向延迟取往返时间的一半，输出p50/p99。
+ *
+ *用法: globalfifo_pingpong [CPU_A] [CPU_B] [消息数] [消息长度]
+ */
+
+#define FIFO_CLEAR  0x01
+
+struct pingpong {
+    int a_out, a_in;    /*线程A: 写globalfifo_0, 读globalfifo_1*/
+    int b_in, b_out;    /*线程B: 读globalfifo_0, 写globalfifo_1*/
+    int cpu_a, cpu_b;
+    long messages;
+    size_t msg_len;
+    double *samples;
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        printf("warning: can not pin thread to cpu %d\n", cpu);
+    }
+}
+
+/*globalfifo是字节流，一次read可能只返回部分消息*/
+static int read_full(int fd, char *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        ret = read(fd, buf + done, len - done);
+        if (ret <= 0) {
+            return -1;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        ret = write(fd, buf + done, len - done);
+        if (ret <= 0) {
+            return -1;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+static void *echo_thread(void *arg)
+{
+    struct pingpong *pp = arg;
+    char *buf = malloc(pp->msg_len);
+    long i;
+
+    /*线程A出错时会取消本线程，此时本线程可能阻塞在read/write中*/
+    pthread_cleanup_push(free, buf);
+    pin_to_cpu(pp->cpu_b);
+    for (i = 0; i < pp->messages; i++) {
+        if (read_full(pp->b_in, buf, pp->msg_len) || write_full(pp->b_out, buf, pp->msg_len)) {
+            perror("echo");
+            break;
+        }
+    }
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int run(struct pingpong *pp, int spsc)
+{
+    pthread_t tid;
+    char *buf = malloc(pp->msg_len);
+    int state = 0;
+    long i;
+
+    ioctl(pp->a_out, FIFO_CLEAR, 0);
+    ioctl(pp->a_in, FIFO_CLEAR, 0);
+    if (ioctl(pp->a_out, GLOBALFIFO_IOC_SET_SPSC, spsc) < 0 || ioctl(pp->a_in, GLOBALFIFO_IOC_SET_SPSC, spsc) < 0) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_SPSC)");
+        free(buf);
+        return -1;
+    }
+    ioctl(pp->a_out, GLOBALFIFO_IOC_GET_SPSC, &state);
+
+    memset(buf, 'p', pp->msg_len);
+    pthread_create(&tid, NULL, echo_thread, pp);
+    pin_to_cpu(pp->cpu_a);
+
+    for (i = 0; i < pp->messages; i++) {
+        double start = now_ns();
+
+        if (write_full(pp->a_out, buf, pp->msg_len) || read_full(pp->a_in, buf, pp->msg_len)) {
+            perror("pingpong");
+            break;
+        }
+        pp->samples[i] = (now_ns() - start) / 2;
+    }
+    /*中途出错时回声线程还在等待不会再到来的消息，取消后才能回收*/
+    if (i < pp->messages) {
+        pthread_cancel(tid);
+    }
+    pthread_join(tid, NULL);
+
+    if (0 == i) {
+        free(buf);
+        return -1;
+    }
+    qsort(pp->samples, i, sizeof(double), cmp_double);
+    printf("%-7s (active: %s)  %ld msgs of %zu B  p50 %8.0f ns  p99 %8.0f ns\n",
+           spsc ? "spsc" : "locked", (state & GLOBALFIFO_SPSC_ACTIVE) ? "yes" : "no",
+           i, pp->msg_len, pp->samples[i / 2], pp->samples[i * 99 / 100]);
+
+    free(buf);
+    return i < pp->messages ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct pingpong pp;
+
+    pp.cpu_a = argc > 1 ? atoi(argv[1]) : 0;
+    pp.cpu_b = argc > 2 ? atoi(argv[2]) : 1;
+    pp.messages = argc > 3 ? atol(argv[3]) : 100000;
+    pp.msg_len = argc > 4 ? strtoul(argv[4], NULL, 0) : 64;
+
+    pp.a_out = open("/dev/globalfifo_0", O_WRONLY);
+    pp.b_in = open("/dev/globalfifo_0", O_RDONLY);
+    pp.b_out = open("/dev/globalfifo_1", O_WRONLY);
+    pp.a_in = open("/dev/globalfifo_1", O_RDONLY);
+    if (pp.a_out < 0 || pp.b_in < 0 || pp.b_out < 0 || pp.a_in < 0) {
+        printf("open device file /dev/globalfifo_0 or /dev/globalfifo_1 error.\n");
+        return 1;
+    }
+
+    pp.samples = malloc(sizeof(double) * pp.messages);
+    if (!pp.samples) {
+        return 1;
+    }
+
+    printf("globalfifo ping-pong, cpu %d <-> cpu %d\n", pp.cpu_a, pp.cpu_b);
+    run(&pp, 0);
+    run(&pp, 1);
+    ioctl(pp.a_out, GLOBALFIFO_IOC_SET_SPSC, 0);
+    ioctl(pp.a_in, GLOBALFIFO_IOC_SET_SPSC, 0);
+
+    free(pp.samples);
+    close(pp.a_out);
+    close(pp.b_in);
+    close(pp.b_out);
+    close(pp.a_in);
+    return 0;
+}
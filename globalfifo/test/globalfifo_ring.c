@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "globalfifo_ring.h"
+
+#define load_acquire(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define full_barrier()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+int gf_ring_open(struct gf_ring *ring, const char *path)
+{
+    struct globalfifo_ring_ctrl *ctrl;
+    long page = sysconf(_SC_PAGESIZE);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = open(path, O_RDWR);
+    if (-1 == ring->fd) {
+        return -1;
+    }
+
+    /*先只映射控制页，得到数据区大小后再映射整个环*/
+    ctrl = mmap(NULL, page, PROT_READ, MAP_SHARED, ring->fd, 0);
+    if (MAP_FAILED == ctrl) {
+        goto err;
+    }
+    ring->size = ctrl->size;
+    ring->map_len = ctrl->data_offset + ctrl->size;
+    munmap(ctrl, page);
+
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (MAP_FAILED == ring->map) {
+        goto err;
+    }
+    ring->ctrl = ring->map;
+    ring->data = (unsigned char *)ring->map + ring->ctrl->data_offset;
+    return 0;
+
+err:
+    close(ring->fd);
+    return -1;
+}
+
+void gf_ring_close(struct gf_ring *ring)
+{
+    munmap(ring->map, ring->map_len);
+    close(ring->fd);
+}
+
+size_t gf_ring_reserve(struct gf_ring *ring, void **ptr)
+{
+    unsigned int head = ring->ctrl->head;
+    unsigned int space = ring->size - (head - load_acquire(&ring->ctrl->tail));
+    unsigned int off = head & (ring->size - 1);
+
+    *ptr = ring->data + off;
+    return space < ring->size - off ? space : ring->size - off;
+}
+
+void gf_ring_commit(struct gf_ring *ring, size_t len)
+{
+    unsigned int head = ring->ctrl->head;
+
+    store_release(&ring->ctrl->head, head + len);
+    /*
+     *发布head后再检查tail: 若消费者已读到发布前的head(即看到FIFO为空)，它可能正在poll中睡眠，
+     *需要按门铃；这里的全屏障与内核poll中的屏障配对，保证两者至少有一方看到对方的更新
+     */
+    full_barrier();
+    if (ring->ctrl->tail == head) {
+        ioctl(ring->fd, GLOBALFIFO_IOC_DOORBELL, 0);
+    }
+}
+
+size_t gf_ring_peek(struct gf_ring *ring, const void **ptr)
+{
+    unsigned int tail = ring->ctrl->tail;
+    unsigned int len = load_acquire(&ring->ctrl->head) - tail;
+    unsigned int off = tail & (ring->size - 1);
+
+    *ptr = ring->data + off;
+    return len < ring->size - off ? len : ring->size - off;
+}
+
+void gf_ring_release(struct gf_ring *ring, size_t len)
+{
+    unsigned int tail = ring->ctrl->tail;
+
+    store_release(&ring->ctrl->tail, tail + len);
+    full_barrier();
+    /*释放前FIFO是满的，生产者可能在等待空间*/
+    if (ring->ctrl->head - tail == ring->size) {
+        ioctl(ring->fd, GLOBALFIFO_IOC_DOORBELL, 0);
+    }
+}
+
+static int gf_ring_wait(struct gf_ring *ring, short events)
+{
+    struct pollfd pfd = { .fd = ring->fd, .events = events };
+
+    return poll(&pfd, 1, -1) < 0 ? -1 : 0;
+}
+
+ssize_t gf_ring_write(struct gf_ring *ring, const void *buf, size_t len)
+{
+    size_t done = 0, n;
+    void *ptr;
+
+    while (done < len) {
+        n = gf_ring_reserve(ring, &ptr);
+        if (0 == n) {
+            if (done) {
+                break;
+            }
+            if (gf_ring_wait(ring, POLLOUT)) {
+                return -1;
+            }
+            continue;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(ptr, (const char *)buf + done, n);
+        gf_ring_commit(ring, n);
+        done += n;
+    }
+    return done;
+}
+
+ssize_t gf_ring_read(struct gf_ring *ring, void *buf, size_t len)
+{
+    size_t done = 0, n;
+    const void *ptr;
+
+    while (done < len) {
+        n = gf_ring_peek(ring, &ptr);
+        if (0 == n) {
+            if (done) {
+                break;
+            }
+            if (gf_ring_wait(ring, POLLIN)) {
+                return -1;
+            }
+            continue;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy((char *)buf + done, ptr, n);
+        gf_ring_release(ring, n);
+        done += n;
+    }
+    return done;
+}
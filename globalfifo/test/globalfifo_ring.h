@@ -0,0 +1,45 @@
+/*
+ * globalfifo_ring: user space access to the mmap-ed globalfifo ring
+ *
+ * copyright (c) 2017 Nick Yan
+ *
+ * Licensed under GPLv2 or later
+ */
+
+#ifndef _GLOBALFIFO_RING_H
+#define _GLOBALFIFO_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "../globalfifo.h"
+
+struct gf_ring {
+    int fd;
+    void *map;
+    size_t map_len;
+    struct globalfifo_ring_ctrl *ctrl;
+    unsigned char *data;
+    unsigned int size;
+};
+
+/*打开设备并映射控制页和数据区，成功返回0*/
+int gf_ring_open(struct gf_ring *ring, const char *path);
+void gf_ring_close(struct gf_ring *ring);
+
+/*
+ *零拷贝接口
+ *reserve返回head处连续可写的字节数并通过ptr返回地址，填好数据后调用commit发布；
+ *peek返回tail处连续可读的字节数，处理完后调用release归还空间。
+ *commit/release只在对端可能正在睡眠时才会调用门铃ioctl
+ */
+size_t gf_ring_reserve(struct gf_ring *ring, void **ptr);
+void gf_ring_commit(struct gf_ring *ring, size_t len);
+size_t gf_ring_peek(struct gf_ring *ring, const void **ptr);
+void gf_ring_release(struct gf_ring *ring, size_t len);
+
+/*复制接口，没有空间/数据时通过poll()睡眠，返回实际传输的字节数*/
+ssize_t gf_ring_write(struct gf_ring *ring, const void *buf, size_t len);
+ssize_t gf_ring_read(struct gf_ring *ring, void *buf, size_t len);
+
+#endif /* _GLOBALFIFO_RING_H */
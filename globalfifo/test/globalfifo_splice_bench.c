@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo转发测试: 一个生产者线程向设备写入总共1GB数据，主线程把设备中的数据转发到本地文件
+ *  read+write: read()到用户缓冲区，再write()到文件
+ *  splice:     splice()从设备到管道，再从管道到文件，数据不经过用户空间
+ *  sendfile:   sendfile()从设备直接到文件，内核内部同样经由管道完成
+ *输出转发的吞吐量和转发线程消耗的CPU时间(用户态+内核态)，最后删除输出文件。
+ *
+ *用法: globalfifo_splice_bench [设备文件] [输出文件] [转发的MB数]
+ */
+
+#define FIFO_CLEAR      0x01
+#define FIFO_SIZE       (1 << 20)   /*测试期间把FIFO容量调到1MB，结束后恢复*/
+#define CHUNK           (64 << 10)  /*每次转发的最大长度，与管道的默认容量相同*/
+
+enum { MODE_RW, MODE_SPLICE, MODE_SENDFILE };
+
+struct bench {
+    const char *path;
+    const char *out;
+    unsigned long long total;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_sec(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void *producer(void *arg)
+{
+    struct bench *b = arg;
+    static char buf[CHUNK];
+    unsigned long long sent = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = open(b->path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        return NULL;
+    }
+
+    memset(buf, 's', sizeof(buf));
+    while (sent < b->total) {
+        ret = write(fd, buf, b->total - sent < sizeof(buf) ? b->total - sent : sizeof(buf));
+        if (ret <= 0) {
+            perror("write");
+            break;
+        }
+        sent += ret;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+/*
+ *从设备转发total字节到文件，返回实际转发的字节数
+ */
+static unsigned long long forward(int mode, int in, int out, unsigned long long total)
+{
+    static char buf[CHUNK];
+    unsigned long long done = 0;
+    int pipefd[2];
+    ssize_t ret, n;
+
+    if (MODE_SPLICE == mode && pipe(pipefd) < 0) {
+        perror("pipe");
+        return 0;
+    }
+
+    while (done < total) {
+        size_t len = total - done < CHUNK ? total - done : CHUNK;
+
+        if (MODE_RW == mode) {
+            ret = read(in, buf, len);
+            if (ret > 0 && write(out, buf, ret) != ret) {
+                ret = -1;
+            }
+        } else if (MODE_SPLICE == mode) {
+            ret = splice(in, NULL, pipefd[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            for (n = 0; ret > 0 && n < ret; ) {
+                ssize_t m = splice(pipefd[0], NULL, out, NULL, ret - n, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+                if (m <= 0) {
+                    ret = -1;
+                    break;
+                }
+                n += m;
+            }
+        } else {
+            ret = sendfile(out, in, NULL, len);
+        }
+        if (ret <= 0) {
+            perror("forward");
+            break;
+        }
+        done += ret;
+    }
+
+    if (MODE_SPLICE == mode) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    return done;
+}
+
+static void run(struct bench *b, int mode)
+{
+    static const char *names[] = { "read+write", "splice", "sendfile" };
+    unsigned long long done;
+    double start, elapsed, cpu;
+    pthread_t tid;
+    int in, out;
+
+    in = open(b->path, O_RDONLY);
+    if (-1 == in) {
+        printf("open device file %s error.\n", b->path);
+        return;
+    }
+    out = open(b->out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (-1 == out) {
+        perror(b->out);
+        close(in);
+        return;
+    }
+
+    start = now_sec();
+    cpu = thread_cpu_sec();
+    pthread_create(&tid, NULL, producer, b);
+    done = forward(mode, in, out, b->total);
+    cpu = thread_cpu_sec() - cpu;
+    elapsed = now_sec() - start;
+    pthread_join(tid, NULL);
+
+    printf("%-10s %8.1f MB/s  forwarder cpu %6.2f s  (%llu bytes)\n", names[mode],
+           done / elapsed / 1e6, cpu, done);
+
+    close(out);
+    close(in);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench b;
+    unsigned int size = 0;
+    int fd, mode;
+
+    b.path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    b.out = argc > 2 ? argv[2] : "globalfifo_splice.out";
+    b.total = (argc > 3 ? atoll(argv[3]) : 1024) << 20;
+
+    fd = open(b.path, O_RDWR);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b.path);
+        return 1;
+    }
+    ioctl(fd, FIFO_CLEAR, 0);
+    ioctl(fd, GLOBALFIFO_IOC_GET_SIZE, &size);
+    if (ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, FIFO_SIZE) < 0) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_SIZE)");
+    }
+
+    printf("globalfifo splice bench: %llu MB from %s to %s\n", b.total >> 20, b.path, b.out);
+    for (mode = MODE_RW; mode <= MODE_SENDFILE; mode++) {
+        run(&b, mode);
+    }
+    unlink(b.out);
+
+    if (size) {
+        ioctl(fd, FIFO_CLEAR, 0);
+        ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, size);
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo生产者阻塞时间与容量的关系
+ *生产者每隔period毫秒突发写入burst字节(阻塞写)，消费者每次读4KiB，
+ *并且每100ms"打嗝"一次(睡眠hiccup毫秒)，模拟偶尔被调度出去的消费者。
+ *对每种容量统计生产者花在突发写上的时间: 总阻塞时间、单次最大阻塞时间、阻塞时间占比。
+ *容量足以吸收一次突发加上消费者的停顿时，生产者几乎不会阻塞。
+ *
+ *用法: globalfifo_stall_bench [设备文件] [每种容量的测试秒数] [突发字节数] [突发间隔ms] [打嗝ms]
+ */
+
+#define FIFO_CLEAR  0x01
+#define READ_CHUNK  4096
+
+struct stall {
+    const char *path;
+    double seconds;
+    size_t burst;
+    double period;      /*秒*/
+    double hiccup;      /*秒*/
+    volatile int stop;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_sec(double sec)
+{
+    struct timespec ts;
+
+    if (sec <= 0) {
+        return;
+    }
+    ts.tv_sec = (time_t)sec;
+    ts.tv_nsec = (long)((sec - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+static void *consumer(void *arg)
+{
+    struct stall *s = arg;
+    char buf[READ_CHUNK];
+    double next_hiccup = now_sec() + 0.1;
+    int fd;
+
+    /*非阻塞读，这样生产者结束后消费者可以退出*/
+    fd = open(s->path, O_RDONLY | O_NONBLOCK);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", s->path);
+        return NULL;
+    }
+
+    while (!s->stop) {
+        if (read(fd, buf, sizeof(buf)) <= 0) {
+            usleep(100);
+        }
+        if (now_sec() >= next_hiccup) {
+            sleep_sec(s->hiccup);
+            next_hiccup = now_sec() + 0.1;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static int run(struct stall *s, unsigned int size)
+{
+    char *buf = malloc(s->burst);
+    double start, end, next, total = 0, max = 0;
+    unsigned int actual = 0;
+    long bursts = 0;
+    pthread_t tid;
+    int fd;
+
+    fd = open(s->path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", s->path);
+        free(buf);
+        return -1;
+    }
+    ioctl(fd, FIFO_CLEAR, 0);
+    if (ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, size) < 0) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_SIZE)");
+        close(fd);
+        free(buf);
+        return -1;
+    }
+    ioctl(fd, GLOBALFIFO_IOC_GET_SIZE, &actual);
+
+    memset(buf, 's', s->burst);
+    s->stop = 0;
+    pthread_create(&tid, NULL, consumer, s);
+
+    start = next = now_sec();
+    while (next - start < s->seconds) {
+        double t0, stall;
+        size_t done = 0;
+
+        sleep_sec(next - now_sec());
+        t0 = now_sec();
+        while (done < s->burst) {
+            ssize_t ret = write(fd, buf + done, s->burst - done);
+
+            if (ret <= 0) {
+                perror("write");
+                goto out;
+            }
+            done += ret;
+        }
+        stall = now_sec() - t0;
+        total += stall;
+        if (stall > max) {
+            max = stall;
+        }
+        bursts++;
+        next += s->period;
+    }
+out:
+    end = now_sec();
+    s->stop = 1;
+    pthread_join(tid, NULL);
+
+    printf("%8u B  %5ld bursts  total stall %8.3f ms  max stall %8.3f ms  stall %5.1f%%\n",
+           actual, bursts, total * 1e3, max * 1e3, total / (end - start) * 100);
+
+    ioctl(fd, FIFO_CLEAR, 0);
+    close(fd);
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int sizes[] = { 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20 };
+    struct stall s;
+    unsigned int i, orig = 0;
+    int fd;
+
+    s.path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    s.seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    s.burst = argc > 3 ? strtoul(argv[3], NULL, 0) : 64 << 10;
+    s.period = (argc > 4 ? atof(argv[4]) : 10) / 1e3;
+    s.hiccup = (argc > 5 ? atof(argv[5]) : 20) / 1e3;
+
+    /*记下原来的容量，测试完成后恢复*/
+    fd = open(s.path, O_RDONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", s.path);
+        return 1;
+    }
+    ioctl(fd, GLOBALFIFO_IOC_GET_SIZE, &orig);
+
+    printf("globalfifo stall bench on %s: %zu B burst every %.0f ms, consumer hiccup %.0f ms every 100 ms\n",
+           s.path, s.burst, s.period * 1e3, s.hiccup * 1e3);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (run(&s, sizes[i]) < 0) {
+            break;
+        }
+    }
+
+    if (orig) {
+        ioctl(fd, FIFO_CLEAR, 0);
+        ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, orig);
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+/*
+ *按固定间隔输出设备sysfs统计计数的增量，类似vmstat
+ *计数位于/sys/class/<类名>/<设备名>/stats/下，每个文件一个计数，globalmem的设备同样适用:
+ *  globalfifo_stat /sys/class/globalmem_class/globalmem_0
+ *
+ *用法: globalfifo_stat [sysfs设备目录] [间隔秒数] [次数，0表示一直输出]
+ */
+
+#define MAX_STATS       32
+
+struct stat_file {
+    char name[sizeof(((struct dirent *)0)->d_name)];    /*与目录项的名字一样大，复制时不会截断*/
+    unsigned long long last;
+};
+
+static int read_stat(const char *dir, const char *name, unsigned long long *val)
+{
+    char path[512];
+    FILE *fp;
+    int ret;
+
+    snprintf(path, sizeof(path), "%s/stats/%s", dir, name);
+    fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    ret = fscanf(fp, "%llu", val) == 1 ? 0 : -1;
+    fclose(fp);
+    return ret;
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(((const struct stat_file *)a)->name, ((const struct stat_file *)b)->name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = argc > 1 ? argv[1] : "/sys/class/globalfifo_class/globalfifo_0";
+    int interval = argc > 2 ? atoi(argv[2]) : 1;
+    long count = argc > 3 ? atol(argv[3]) : 0;
+    struct stat_file stats[MAX_STATS];
+    char path[512];
+    struct dirent *de;
+    DIR *d;
+    int n = 0, i;
+    long iter;
+
+    snprintf(path, sizeof(path), "%s/stats", dir);
+    d = opendir(path);
+    if (!d) {
+        printf("open %s error.\n", path);
+        return 1;
+    }
+    while ((de = readdir(d)) != NULL && n < MAX_STATS) {
+        if ('.' == de->d_name[0]) {
+            continue;
+        }
+        snprintf(stats[n].name, sizeof(stats[n].name), "%s", de->d_name);
+        n++;
+    }
+    closedir(d);
+    qsort(stats, n, sizeof(stats[0]), cmp_name);
+
+    for (i = 0; i < n; i++) {
+        if (read_stat(dir, stats[i].name, &stats[i].last)) {
+            stats[i].last = 0;
+        }
+        printf("%14s", stats[i].name);
+    }
+    printf("\n");
+
+    for (iter = 0; 0 == count || iter < count; iter++) {
+        sleep(interval);
+        for (i = 0; i < n; i++) {
+            unsigned long long val;
+
+            if (read_stat(dir, stats[i].name, &val)) {
+                val = stats[i].last;
+            }
+            printf("%14llu", val - stats[i].last);
+            stats[i].last = val;
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return 0;
+}
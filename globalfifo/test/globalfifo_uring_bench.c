@@ -0,0 +1,417 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/io_uring.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo异步读取测试: 每个次设备(/dev/globalfifo_0~9)一个生产者线程持续写入msg字节的消息，
+ *一个消费者线程从全部次设备读取，比较两种方式:
+ *  epoll+read: 非阻塞打开，epoll_wait等待可读后逐个read直到EAGAIN
+ *  io_uring:   始终保持depth个IORING_OP_READ请求在途(平均分配到各次设备)，每完成一个立即重新提交
+ *驱动支持IOCB_NOWAIT并在唤醒时带上EPOLLIN，io_uring在设备为空时挂在等待队列上(fast poll)，
+ *不需要为每个在途请求占用一个io-wq内核线程。测试期间统计iou-wrk线程数的最大值以确认这一点。
+ *输出每秒完成的读取数、吞吐量和消费者线程消耗的CPU时间。
+ *
+ *没有依赖liburing，直接使用io_uring_setup/io_uring_enter系统调用和mmap的SQ/CQ环。
+ *
+ *用法: globalfifo_uring_bench [消息长度] [在途请求数] [每项测试秒数]
+ */
+
+#define FIFO_CLEAR      0x01
+#define NDEV            10
+
+struct uring {
+    int fd;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned int to_submit;
+};
+
+struct bench {
+    int rfd[NDEV];
+    size_t msg;
+    unsigned int depth;
+    volatile int stop;
+    volatile unsigned long long total;  /*生产者全部退出后才确定*/
+    unsigned long long got;             /*消费者读到的字节数*/
+    unsigned long long reads;           /*消费者完成的读取次数*/
+    double cpu;
+};
+
+struct producer {
+    struct bench *b;
+    int minor;
+    unsigned long long sent;
+    pthread_t tid;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_sec(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int uring_init(struct uring *r, unsigned int entries)
+{
+    struct io_uring_params p;
+    void *sq, *cq;
+    size_t sq_len, cq_len;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_len = cq_len = sq_len > cq_len ? sq_len : cq_len;
+    }
+    sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == sq) {
+        perror("mmap sq ring");
+        close(r->fd);
+        return -1;
+    }
+    cq = sq;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == cq) {
+            perror("mmap cq ring");
+            close(r->fd);
+            return -1;
+        }
+    }
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == r->sqes) {
+        perror("mmap sqes");
+        close(r->fd);
+        return -1;
+    }
+
+    r->sq_head = (unsigned int *)((char *)sq + p.sq_off.head);
+    r->sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)((char *)sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+    r->cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)((char *)cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+    r->to_submit = 0;
+    return 0;
+}
+
+/*
+ *把一个读请求放入SQ，由下一次uring_wait一起提交；在途请求数不超过SQ容量，SQ不会满
+ */
+static void uring_prep_read(struct uring *r, int fd, void *buf, size_t len, unsigned long long data)
+{
+    unsigned int tail = *r->sq_tail;
+    unsigned int idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->off = 0;           /*驱动忽略文件位置*/
+    sqe->user_data = data;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+}
+
+/*
+ *提交SQ中的请求并等待至少一个完成
+ */
+static int uring_wait(struct uring *r)
+{
+    int ret;
+
+    ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0 && EINTR != errno) {
+        perror("io_uring_enter");
+        return -1;
+    }
+    if (ret > 0) {
+        r->to_submit -= ret < (int)r->to_submit ? (unsigned int)ret : r->to_submit;
+    }
+    return 0;
+}
+
+static void *produce(void *arg)
+{
+    struct producer *p = arg;
+    char path[32], *buf;
+    int fd;
+
+    snprintf(path, sizeof(path), "/dev/globalfifo_%d", p->minor);
+    fd = open(path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", path);
+        return NULL;
+    }
+
+    buf = malloc(p->b->msg);
+    memset(buf, 'u', p->b->msg);
+    while (!p->b->stop) {
+        ssize_t ret = write(fd, buf, p->b->msg);
+
+        if (ret <= 0) {
+            perror("write");
+            break;
+        }
+        p->sent += ret;
+    }
+
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+static void *consume_epoll(void *arg)
+{
+    struct bench *b = arg;
+    struct epoll_event ev[NDEV];
+    char *buf = malloc(b->msg);
+    double cpu = thread_cpu_sec();
+    int epfd, i, n;
+
+    epfd = epoll_create1(0);
+    for (i = 0; i < NDEV; i++) {
+        ev[0].events = EPOLLIN;
+        ev[0].data.fd = b->rfd[i];
+        epoll_ctl(epfd, EPOLL_CTL_ADD, b->rfd[i], &ev[0]);
+    }
+
+    while (b->got < b->total) {
+        n = epoll_wait(epfd, ev, NDEV, 10);
+        for (i = 0; i < n; i++) {
+            ssize_t ret;
+
+            while ((ret = read(ev[i].data.fd, buf, b->msg)) > 0) {
+                b->got += ret;
+                b->reads++;
+            }
+            if (ret < 0 && EAGAIN != errno) {
+                perror("read");
+                goto out;
+            }
+        }
+    }
+
+out:
+    b->cpu = thread_cpu_sec() - cpu;
+    close(epfd);
+    free(buf);
+    return NULL;
+}
+
+static void *consume_uring(void *arg)
+{
+    struct bench *b = arg;
+    struct uring r;
+    char *bufs = malloc((size_t)b->depth * b->msg);
+    double cpu = thread_cpu_sec();
+    unsigned int i;
+
+    if (uring_init(&r, b->depth) < 0) {
+        free(bufs);
+        return NULL;
+    }
+    for (i = 0; i < b->depth; i++) {
+        uring_prep_read(&r, b->rfd[i % NDEV], bufs + (size_t)i * b->msg, b->msg, i);
+    }
+
+    while (b->got < b->total) {
+        unsigned int head, tail;
+
+        if (uring_wait(&r) < 0) {
+            break;
+        }
+        head = *r.cq_head;
+        tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+
+            i = cqe->user_data;
+            if (cqe->res < 0) {
+                fprintf(stderr, "read minor %u: %s\n", i % NDEV, strerror(-cqe->res));
+                b->total = 0;
+                break;
+            }
+            b->got += cqe->res;
+            b->reads++;
+            uring_prep_read(&r, b->rfd[i % NDEV], bufs + (size_t)i * b->msg, b->msg, i);
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    b->cpu = thread_cpu_sec() - cpu;
+    /*关闭io_uring时取消仍在途的读请求*/
+    close(r.fd);
+    free(bufs);
+    return NULL;
+}
+
+/*
+ *当前进程中io-wq工作线程(iou-wrk-*)的数目
+ */
+static int count_io_workers(void)
+{
+    DIR *dir = opendir("/proc/self/task");
+    struct dirent *de;
+    char path[300], comm[32];
+    int n = 0;
+
+    if (!dir) {
+        return -1;
+    }
+    while ((de = readdir(dir))) {
+        FILE *f;
+
+        if ('.' == de->d_name[0]) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/self/task/%s/comm", de->d_name);
+        f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        if (fgets(comm, sizeof(comm), f) && !strncmp(comm, "iou-wrk", 7)) {
+            n++;
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    return n;
+}
+
+static void run(struct bench *b, int uring, double seconds)
+{
+    struct producer p[NDEV];
+    unsigned long long sent = 0;
+    double start, elapsed, t;
+    char path[32], *kick;
+    pthread_t tid;
+    int i, workers = 0, n;
+
+    for (i = 0; i < NDEV; i++) {
+        snprintf(path, sizeof(path), "/dev/globalfifo_%d", i);
+        b->rfd[i] = open(path, O_RDONLY | (uring ? 0 : O_NONBLOCK));
+        if (-1 == b->rfd[i]) {
+            printf("open device file %s error.\n", path);
+            while (i--) {
+                close(b->rfd[i]);
+            }
+            return;
+        }
+        ioctl(b->rfd[i], FIFO_CLEAR, 0);
+    }
+    b->stop = 0;
+    b->total = (unsigned long long)-1;
+    b->got = 0;
+    b->reads = 0;
+    b->cpu = 0;
+
+    start = now_sec();
+    pthread_create(&tid, NULL, uring ? consume_uring : consume_epoll, b);
+    for (i = 0; i < NDEV; i++) {
+        p[i].b = b;
+        p[i].minor = i;
+        p[i].sent = 0;
+        pthread_create(&p[i].tid, NULL, produce, &p[i]);
+    }
+
+    for (t = 0; t < seconds; t += 0.1) {
+        usleep(100000);
+        n = count_io_workers();
+        workers = n > workers ? n : workers;
+    }
+    b->stop = 1;
+    for (i = 0; i < NDEV; i++) {
+        pthread_join(p[i].tid, NULL);
+        sent += p[i].sent;
+    }
+    elapsed = now_sec() - start;
+    b->total = sent;
+
+    /*
+     *消费者可能已经读完全部数据并在io_uring_enter中等待，向每个设备再写一条消息使在途的读请求完成，
+     *消费者随后发现已读够total字节而退出，多写的消息在最后清除
+     */
+    kick = calloc(1, b->msg);
+    for (i = 0; i < NDEV; i++) {
+        int fd;
+
+        snprintf(path, sizeof(path), "/dev/globalfifo_%d", i);
+        fd = open(path, O_WRONLY | O_NONBLOCK);
+        if (fd >= 0) {
+            /*FIFO已满(EAGAIN)说明还有数据未读，不需要唤醒*/
+            if (write(fd, kick, b->msg) < 0 && EAGAIN != errno) {
+                perror("write");
+            }
+            close(fd);
+        }
+    }
+    free(kick);
+    pthread_join(tid, NULL);
+
+    printf("%-10s %12.0f reads/s  %8.1f MB/s  consumer cpu %6.2f s  max %d io-wq workers\n",
+           uring ? "io_uring" : "epoll+read", b->reads / elapsed, b->got / elapsed / 1e6, b->cpu, workers);
+
+    for (i = 0; i < NDEV; i++) {
+        ioctl(b->rfd[i], FIFO_CLEAR, 0);
+        close(b->rfd[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench b;
+    double seconds;
+
+    b.msg = argc > 1 ? atoi(argv[1]) : 64;
+    b.depth = argc > 2 ? atoi(argv[2]) : 4096;
+    seconds = argc > 3 ? atof(argv[3]) : 2;
+    if (!b.msg || b.depth < NDEV) {
+        printf("usage: %s [msg size] [depth >= %d] [seconds]\n", argv[0], NDEV);
+        return 1;
+    }
+
+    printf("globalfifo async read bench: %d devices, %zu byte messages, %u reads in flight, %.1f s per run\n",
+           NDEV, b.msg, b.depth, seconds);
+    run(&b, 0, seconds);
+    run(&b, 1, seconds);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo唤醒合并测试
+ *生产者以小块(默认64字节)持续写入，消费者以64KiB缓冲区阻塞读取，
+ *统计每传输1MB时消费者被唤醒的次数(返回数据的read调用数)以及双方的上下文切换次数。
+ *分别在不设置水位线和设置rcvlowat/sndlowat/flush_us的情况下运行，对比两者的差别。
+ *
+ *用法: globalfifo_wakeup_test [设备文件] [传输MB数] [单次写入长度] [rcvlowat] [flush_us]
+ */
+
+#define FIFO_CLEAR      0x01
+#define FIFO_SIZE       (64 << 10)
+
+struct wakeup {
+    const char *path;
+    unsigned long long total;
+    size_t chunk;
+    struct globalfifo_watermark rd_wm;
+    struct globalfifo_watermark wr_wm;
+    long nvcsw, nivcsw;         /*生产者线程的上下文切换次数*/
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void thread_csw(long *nvcsw, long *nivcsw)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    *nvcsw = ru.ru_nvcsw;
+    *nivcsw = ru.ru_nivcsw;
+}
+
+static void *producer(void *arg)
+{
+    struct wakeup *w = arg;
+    unsigned long long done = 0;
+    char *buf = malloc(w->chunk);
+    long v0, i0;
+    int fd;
+
+    fd = open(w->path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", w->path);
+        free(buf);
+        return NULL;
+    }
+    ioctl(fd, GLOBALFIFO_IOC_SET_WATERMARK, &w->wr_wm);
+
+    memset(buf, 'w', w->chunk);
+    thread_csw(&v0, &i0);
+    while (done < w->total) {
+        ssize_t ret = write(fd, buf, w->chunk);
+
+        if (ret <= 0) {
+            perror("write");
+            break;
+        }
+        done += ret;
+    }
+    thread_csw(&w->nvcsw, &w->nivcsw);
+    w->nvcsw -= v0;
+    w->nivcsw -= i0;
+
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static void run(struct wakeup *w, const char *name)
+{
+    static char buf[64 << 10];
+    unsigned long long done = 0, reads = 0;
+    double start, elapsed, mb = w->total / 1048576.0;
+    long v0, i0, v1, i1;
+    pthread_t tid;
+    int fd;
+
+    fd = open(w->path, O_RDONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", w->path);
+        return;
+    }
+    ioctl(fd, FIFO_CLEAR, 0);
+    ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, FIFO_SIZE);
+    if (ioctl(fd, GLOBALFIFO_IOC_SET_WATERMARK, &w->rd_wm) < 0) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_WATERMARK)");
+        close(fd);
+        return;
+    }
+
+    start = now_sec();
+    pthread_create(&tid, NULL, producer, w);
+    thread_csw(&v0, &i0);
+    while (done < w->total) {
+        ssize_t ret = read(fd, buf, sizeof(buf));
+
+        if (ret <= 0) {
+            perror("read");
+            break;
+        }
+        done += ret;
+        reads++;
+    }
+    thread_csw(&v1, &i1);
+    pthread_join(tid, NULL);
+    elapsed = now_sec() - start;
+
+    printf("%-9s %8.1f MB/s  reader wakeups/MB %8.1f  reader csw/MB %8.1f  writer csw/MB %8.1f\n",
+           name, mb / elapsed, reads / mb, (v1 - v0 + i1 - i0) / mb, (w->nvcsw + w->nivcsw) / mb);
+
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    struct wakeup w;
+
+    memset(&w, 0, sizeof(w));
+    w.path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    w.total = (argc > 2 ? strtoull(argv[2], NULL, 0) : 64) << 20;
+    w.chunk = argc > 3 ? strtoul(argv[3], NULL, 0) : 64;
+
+    printf("globalfifo wakeup test on %s: %llu MB in %zu B writes, capacity %d B\n",
+           w.path, w.total >> 20, w.chunk, FIFO_SIZE);
+
+    run(&w, "default");
+
+    w.rd_wm.rcvlowat = argc > 4 ? strtoul(argv[4], NULL, 0) : FIFO_SIZE / 2;
+    w.rd_wm.flush_us = argc > 5 ? strtoul(argv[5], NULL, 0) : 1000;
+    w.wr_wm.sndlowat = FIFO_SIZE / 4;
+    run(&w, "watermark");
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include "../globalfifo.h"
+
+/*
+ *globalfifo批量写入测试: N次write() 与 一次N段writev() 对比
+ *每条消息由4字节长度头和载荷组成，生产者每批发送N条消息:
+ *  write : 每条消息的头和载荷各一次write()，每批2N次系统调用、2N次加锁和唤醒
+ *  writev: 一批消息的2N个段通过一次writev()写入，一次加锁、一次唤醒
+ *  atomic: 同writev，并开启GLOBALFIFO_IOC_SET_ATOMIC，每批要么全部写入要么等待
+ *消费者线程以大块read()读取并丢弃数据，输出每秒消息数。
+ *
+ *用法: globalfifo_writev_bench [设备文件] [每批消息数N] [载荷长度] [每种方式的测试秒数]
+ */
+
+#define FIFO_CLEAR      0x01
+#define FIFO_SIZE       (256 << 10)     /*容量足够容纳一整批消息*/
+#define MAX_BATCH       512             /*writev最多IOV_MAX(1024)个段*/
+
+enum mode { MODE_WRITE, MODE_WRITEV, MODE_ATOMIC };
+
+struct bench {
+    const char *path;
+    int batch;
+    size_t payload;
+    double seconds;
+    volatile int stop;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *consumer(void *arg)
+{
+    struct bench *b = arg;
+    static char buf[64 << 10];
+    int fd;
+
+    fd = open(b->path, O_RDONLY | O_NONBLOCK);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        return NULL;
+    }
+    while (!b->stop) {
+        if (read(fd, buf, sizeof(buf)) <= 0) {
+            usleep(10);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+/*globalfifo是字节流，非整体模式下一次写入可能只完成一部分*/
+static int write_full(int fd, const char *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        ret = write(fd, buf + done, len - done);
+        if (ret <= 0) {
+            return -1;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+static int writev_full(int fd, struct iovec *iov, int cnt)
+{
+    ssize_t ret;
+
+    while (cnt > 0) {
+        ret = writev(fd, iov, cnt);
+        if (ret <= 0) {
+            return -1;
+        }
+        /*跳过已完整写入的段，调整部分写入的段*/
+        while (cnt > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return 0;
+}
+
+static void run(struct bench *b, enum mode mode, const char *name)
+{
+    uint32_t *hdr = malloc(sizeof(uint32_t) * b->batch);
+    char *payload = malloc(b->payload);
+    struct iovec *iov = malloc(sizeof(struct iovec) * 2 * b->batch);
+    unsigned long long msgs = 0;
+    double start, elapsed;
+    pthread_t tid;
+    int fd, i;
+
+    fd = open(b->path, O_WRONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b->path);
+        goto out;
+    }
+    ioctl(fd, FIFO_CLEAR, 0);
+    ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, FIFO_SIZE);
+    if (ioctl(fd, GLOBALFIFO_IOC_SET_ATOMIC, MODE_ATOMIC == mode) < 0 && MODE_ATOMIC == mode) {
+        perror("ioctl(GLOBALFIFO_IOC_SET_ATOMIC)");
+        close(fd);
+        goto out;
+    }
+
+    memset(payload, 'v', b->payload);
+    for (i = 0; i < b->batch; i++) {
+        hdr[i] = b->payload;
+    }
+
+    b->stop = 0;
+    pthread_create(&tid, NULL, consumer, b);
+
+    start = now_sec();
+    do {
+        if (MODE_WRITE == mode) {
+            for (i = 0; i < b->batch; i++) {
+                if (write_full(fd, (char *)&hdr[i], sizeof(hdr[i])) || write_full(fd, payload, b->payload)) {
+                    perror("write");
+                    goto stop;
+                }
+            }
+        } else {
+            for (i = 0; i < b->batch; i++) {
+                iov[2 * i].iov_base = &hdr[i];
+                iov[2 * i].iov_len = sizeof(hdr[i]);
+                iov[2 * i + 1].iov_base = payload;
+                iov[2 * i + 1].iov_len = b->payload;
+            }
+            if (writev_full(fd, iov, 2 * b->batch)) {
+                perror("writev");
+                goto stop;
+            }
+        }
+        msgs += b->batch;
+        elapsed = now_sec() - start;
+    } while (elapsed < b->seconds);
+stop:
+    elapsed = now_sec() - start;
+    b->stop = 1;
+    pthread_join(tid, NULL);
+
+    printf("%-7s %12.0f msgs/s  %8.1f MB/s\n", name, msgs / elapsed,
+           msgs * (sizeof(uint32_t) + b->payload) / elapsed / 1e6);
+
+    ioctl(fd, GLOBALFIFO_IOC_SET_ATOMIC, 0);
+    ioctl(fd, FIFO_CLEAR, 0);
+    close(fd);
+out:
+    free(hdr);
+    free(payload);
+    free(iov);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench b;
+    unsigned int orig = 0;
+    int fd;
+
+    b.path = argc > 1 ? argv[1] : "/dev/globalfifo_0";
+    b.batch = argc > 2 ? atoi(argv[2]) : 16;
+    b.payload = argc > 3 ? strtoul(argv[3], NULL, 0) : 60;
+    b.seconds = argc > 4 ? atof(argv[4]) : 2.0;
+    if (b.batch < 1 || b.batch > MAX_BATCH) {
+        b.batch = MAX_BATCH;
+    }
+
+    /*记下原来的容量，测试完成后恢复*/
+    fd = open(b.path, O_RDONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", b.path);
+        return 1;
+    }
+    ioctl(fd, GLOBALFIFO_IOC_GET_SIZE, &orig);
+
+    printf("globalfifo writev bench on %s: batches of %d msgs, 4 B header + %zu B payload\n",
+           b.path, b.batch, b.payload);
+    run(&b, MODE_WRITE, "write");
+    run(&b, MODE_WRITEV, "writev");
+    run(&b, MODE_ATOMIC, "atomic");
+
+    if (orig) {
+        ioctl(fd, FIFO_CLEAR, 0);
+        ioctl(fd, GLOBALFIFO_IOC_SET_SIZE, orig);
+    }
+    close(fd);
+    return 0;
+}
@@ -13,22 +13,286 @@
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/device.h>
+#include <linux/topology.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
+#include <linux/preempt.h>
+#include <linux/mm.h>
+#include <linux/huge_mm.h>
+#include <linux/pfn_t.h>
+#include <linux/sched.h>
+#include <linux/xarray.h>
+#include <linux/bitops.h>
+#include <linux/log2.h>
 
-#define GLOBALMEM_SIZE			0x1000  /*全局内存大小，用于模拟读写操作的内存区域*/
+#include "globalmem.h"
+
+#define CREATE_TRACE_POINTS
+#include "globalmem_trace.h"
+
+#define GLOBALMEM_SIZE			0x1000  /*全局内存默认大小，用于模拟读写操作的内存区域*/
 #define MEM_CLEAR				0x1     /*ioctl操作命令                      */
 #define GLOBALMEM_MAJOR			230     /*主设备号                           */
 #define DEVICE_NUM              10      /*设备数目                           */
+#define GLOBALMEM_READ_RETRY    4       /*读者因并发写入重试的次数上限，超过后改为持有互斥体读取*/
+#define GLOBALMEM_BOUNCE_SIZE   PAGE_SIZE   /*写者中转缓冲区大小，更长的写入分段发布*/
+#define GLOBALMEM_STRIPES       32      /*每个设备的锁条带数，不超过BITS_PER_LONG*/
 
 static int globalmem_major = GLOBALMEM_MAJOR;
 module_param(globalmem_major, int, S_IRUGO);    /*声明insmod时的参数*/
 
+static unsigned long globalmem_size = GLOBALMEM_SIZE;
+module_param(globalmem_size, ulong, S_IRUGO);   /*每个设备的区域大小，可以为数GB，只有写入过的页才占用内存*/
+
+static unsigned long globalmem_stripe_size = PAGE_SIZE;
+module_param(globalmem_stripe_size, ulong, S_IRUGO);    /*条带单元大小，向上取整为不小于一页的2的幂*/
+
+static bool globalmem_hugepage;
+module_param(globalmem_hugepage, bool, S_IRUGO);    /*以大页(PMD大小)为单位申请存储并以PMD映射，区域大小向上取整为大页的整数倍*/
+
+/*
+ *每CPU统计计数，数组下标为GLOBALMEM_STAT_READ/GLOBALMEM_STAT_WRITE，读取sysfs属性时对所有CPU求和
+ */
+#define GLOBALMEM_STAT_READ     0
+#define GLOBALMEM_STAT_WRITE    1
+
+struct globalmem_stats {
+    u64 calls[2];                       /*read/write调用次数*/
+    u64 bytes[2];                       /*成功读写的字节数*/
+    u64 blocks[2];                      /*互斥体已被持有、需要睡眠等待的次数*/
+    u64 read_retries;                   /*读取期间遇到并发写入而重新读取的次数*/
+};
+
+/*
+ *数据区单独申请，不与设备结构体放在一起；读写路径上频繁修改的互斥体从新的cache line开始，
+ *不与只读字段共享cache line。每个设备单独申请，不再与相邻设备的数据区相邻。
+ *
+ *数据区由整页组成，可以mmap到用户空间直接读写: 每块为2^order个物理连续的页，
+ *普通情况下order为0，开启globalmem_hugepage时每块为一个PMD大小的复合页，映射时整块以PMD映射，减少TLB缺失。
+ *各块按块号存放在xarray中，第一次写入(或mmap缺页)时才申请，从未写过的空洞读出全0且不占内存，
+ *因此区域可以远大于实际写入的数据量。块一旦申请就保留到模块卸载，mmap的映射始终有效。
+ *
+ *数据区按条带单元(stripe_size)划分，第u个单元由stripes[u % GLOBALMEM_STRIPES]保护，
+ *每个条带有自己的互斥体和修改序号:
+ *读者不获取任何锁，按单元分段复制，每段只在该单元所属条带的seq前后两次读取之间复制，seq发生变化则重新读取，
+ *多个读者之间不写任何共享的cache line，可以线性扩展；
+ *写者先按地址顺序获取写入范围涉及的所有条带的互斥体，范围不重叠的写者落在不同条带上时可以并行，
+ *重叠的写者之间仍然整体互斥；持有互斥体期间先把用户数据复制到中转缓冲区(可能缺页睡眠)，
+ *再在对应条带的seq写临界区内拷入数据区，写临界区内不会睡眠，读者最多重试一个memcpy的时间。
+ *不跨条带单元、不超过GLOBALMEM_BOUNCE_SIZE的写入对读者是原子的。mmap的用户直接访问数据区，不受seq保护。
+ */
+struct globalmem_stripe {
+    seqcount_t seq;                     /*本条带各单元的修改序号，只有持有mutex的写者修改*/
+    struct mutex mutex;                 /*写者之间的互斥，写操作中有可能阻塞的copy_from_user，只能使用互斥体*/
+} ____cacheline_aligned_in_smp;
+
 struct globalmem_dev {
 	struct cdev cdev;                   /*字符设备结构体*/
-	unsigned char mem[GLOBALMEM_SIZE];  /*用于模拟读写操作的内存空间*/
-    struct mutex mutex;                 /*用于多用户(进程)访问时的控制，不能用自旋锁，因为读写操作中有调用可能导致阻塞的copy_to_user及copy_from_user; 只能使用互斥体*/
+    struct xarray pages;                /*已申请的各块，以块号为索引，读者在RCU下无锁查找*/
+    unsigned long size;                 /*数据区大小，为块大小的整数倍*/
+    atomic_long_t nr_chunks;            /*已申请的块数*/
+    unsigned int order;                 /*每块的阶*/
+    unsigned int stripe_shift;          /*条带单元大小的对数*/
+    int node;                           /*设备结构体和数据区所在的NUMA节点*/
+    struct globalmem_stats __percpu *stats;     /*每CPU统计计数，通过sysfs导出*/
+    struct globalmem_stripe stripes[GLOBALMEM_STRIPES];    /*各条带单独占用cache line*/
 };
 
-static struct globalmem_dev *globalmem_devp;
+/*
+ *各条带的互斥体会被同一写者同时持有，每个条带使用单独的lockdep类，按条带号递增的顺序获取
+ */
+static struct lock_class_key globalmem_stripe_keys[GLOBALMEM_STRIPES];
+
+static struct globalmem_dev *globalmem_devp[DEVICE_NUM];
+
+static inline unsigned long globalmem_chunk_size(struct globalmem_dev *dev)
+{
+    return PAGE_SIZE << dev->order;
+}
+
+/*
+ *数据区偏移off所在的块号及块内偏移
+ */
+static inline unsigned long globalmem_chunk_index(struct globalmem_dev *dev, unsigned long off)
+{
+    return off >> (PAGE_SHIFT + dev->order);
+}
+
+static inline unsigned long globalmem_chunk_offset(struct globalmem_dev *dev, unsigned long off)
+{
+    return off & (globalmem_chunk_size(dev) - 1);
+}
+
+/*
+ *偏移off所在条带单元的剩余字节数及所属条带
+ */
+static inline unsigned long globalmem_stripe_left(struct globalmem_dev *dev, unsigned long off)
+{
+    return (1UL << dev->stripe_shift) - (off & ((1UL << dev->stripe_shift) - 1));
+}
+
+static inline struct globalmem_stripe *globalmem_stripe(struct globalmem_dev *dev, unsigned long off)
+{
+    return &dev->stripes[(off >> dev->stripe_shift) % GLOBALMEM_STRIPES];
+}
+
+/*
+ *[p, p + count)涉及的条带，按位表示；跨越的单元数不少于条带数时涉及全部条带
+ */
+static unsigned long globalmem_stripe_mask(struct globalmem_dev *dev, unsigned long p, unsigned long count)
+{
+    unsigned long first = p >> dev->stripe_shift;
+    unsigned long last = (p + count - 1) >> dev->stripe_shift;
+    unsigned long unit, mask = 0;
+
+    if (last - first >= GLOBALMEM_STRIPES - 1) {
+        return GENMASK(GLOBALMEM_STRIPES - 1, 0);
+    }
+    for (unit = first; unit <= last; unit++) {
+        mask |= 1UL << (unit % GLOBALMEM_STRIPES);
+    }
+    return mask;
+}
+
+/*
+ *取得块号为index的块，尚未申请时申请一块已清零的块，可能睡眠，内存不足时返回NULL
+ *并发申请同一块时以先装入xarray的为准，其余的释放掉，因此调用者不需要持有任何锁
+ */
+static struct page *globalmem_get_chunk(struct globalmem_dev *dev, unsigned long index)
+{
+    gfp_t gfp = GFP_KERNEL | __GFP_ZERO;
+    struct page *page, *old;
+
+    page = xa_load(&dev->pages, index);
+    if (page) {
+        return page;
+    }
+
+    if (dev->order) {
+        gfp |= __GFP_COMP | __GFP_NOWARN;
+    }
+    page = alloc_pages_node(dev->node, gfp, dev->order);
+    if (!page) {
+        return NULL;
+    }
+    /*xarray装入时带有写屏障，读者看到这一块时清零已经完成*/
+    old = xa_cmpxchg(&dev->pages, index, NULL, page, GFP_KERNEL);
+    if (old) {
+        __free_pages(page, dev->order);
+        return xa_is_err(old) ? NULL : old;
+    }
+    atomic_long_inc(&dev->nr_chunks);
+    return page;
+}
+
+/*
+ *保证[p, p + count)涉及的块都已申请，写者在进入seq写临界区之前调用
+ */
+static int globalmem_populate(struct globalmem_dev *dev, unsigned long p, unsigned long count)
+{
+    unsigned long index, last = globalmem_chunk_index(dev, p + count - 1);
+
+    for (index = globalmem_chunk_index(dev, p); index <= last; index++) {
+        if (!globalmem_get_chunk(dev, index)) {
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/*
+ *数据区在块之间不连续，跨块的复制按块分段进行，尚未申请的块按全0复制给用户，不申请内存
+ *globalmem_copy_to_user返回未能复制的字节数，与copy_to_user一致
+ */
+static unsigned long globalmem_copy_to_user(struct globalmem_dev *dev, char __user *buf, unsigned long p, unsigned long count)
+{
+    while (count) {
+        unsigned long off = globalmem_chunk_offset(dev, p);
+        unsigned long n = min(count, globalmem_chunk_size(dev) - off);
+        struct page *page = xa_load(&dev->pages, globalmem_chunk_index(dev, p));
+
+        if (page ? copy_to_user(buf, page_address(page) + off, n) : clear_user(buf, n)) {
+            return count;
+        }
+        buf += n;
+        p += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/*
+ *拷入数据区，涉及的块已由globalmem_populate申请好
+ */
+static void globalmem_copy_in(struct globalmem_dev *dev, unsigned long p, const void *src, unsigned long count)
+{
+    while (count) {
+        unsigned long off = globalmem_chunk_offset(dev, p);
+        unsigned long n = min(count, globalmem_chunk_size(dev) - off);
+        struct page *page = xa_load(&dev->pages, globalmem_chunk_index(dev, p));
+
+        memcpy(page_address(page) + off, src, n);
+        src += n;
+        p += n;
+        count -= n;
+    }
+}
+
+/*
+ *从偏移p开始查找第一个已申请(data为true)或未申请(data为false)的块，返回其起始偏移，
+ *找不到时返回dev->size，与SEEK_HOLE把区域末尾视为空洞的约定一致
+ */
+static unsigned long globalmem_find_chunk(struct globalmem_dev *dev, unsigned long p, bool data)
+{
+    unsigned long nr = globalmem_chunk_index(dev, dev->size - 1);
+    unsigned long index = globalmem_chunk_index(dev, p);
+    unsigned long next = index;
+    struct page *page;
+
+    page = xa_find(&dev->pages, &next, nr, XA_PRESENT);
+    if (data) {
+        return page ? max(p, next << (PAGE_SHIFT + dev->order)) : dev->size;
+    }
+
+    /*跳过从index开始连续已申请的块*/
+    while (page && next == index) {
+        index++;
+        page = xa_find_after(&dev->pages, &next, nr, XA_PRESENT);
+    }
+    return index > nr ? dev->size : max(p, index << (PAGE_SHIFT + dev->order));
+}
+
+/*
+ *在内核中读取不跨页的一段，用于范围复制的源，返回源是否已申请；源为空洞时读出全0
+ */
+static bool globalmem_snapshot(struct globalmem_dev *dev, void *dst, unsigned long p, unsigned long count)
+{
+    struct globalmem_stripe *stripe = globalmem_stripe(dev, p);
+    struct page *page = xa_load(&dev->pages, globalmem_chunk_index(dev, p));
+    unsigned int seq, retry = 0;
+    void *addr;
+
+    if (!page) {
+        memset(dst, 0, count);
+        return false;
+    }
+
+    addr = page_address(page) + globalmem_chunk_offset(dev, p);
+    do {
+        seq = read_seqcount_begin(&stripe->seq);
+        memcpy(dst, addr, count);
+        if (!read_seqcount_retry(&stripe->seq, seq)) {
+            return true;
+        }
+        this_cpu_inc(dev->stats->read_retries);
+    } while (++retry < GLOBALMEM_READ_RETRY);
+
+    mutex_lock(&stripe->mutex);
+    memcpy(dst, addr, count);
+    mutex_unlock(&stripe->mutex);
+    return true;
+}
 
 /*
  *文件打开函数，对应于用户空间的open函数，用户空间调用open函数时，系统内部经过各种处理后，最终调用本函数
@@ -38,6 +302,12 @@ static int globalmem_open(struct inode *inode, struct file *filep)
     /*获取包含cdev结构体的globalmem_dev结构体指针*/
     struct globalmem_dev *dev = container_of(inode->i_cdev, struct globalmem_dev, cdev);
     filep->private_data = dev;
+    /*
+     *字符设备默认不对f_pos加锁，多个线程共用一个fd调用read/write时会互相覆盖文件位置；
+     *加上FMODE_ATOMIC_POS后由VFS在read/write/lseek期间持有f_pos_lock，位置的推进是原子的。
+     *pread/pwrite使用调用者给出的位置，不涉及f_pos，不受影响，多个线程可以完全并行
+     */
+    filep->f_mode |= FMODE_ATOMIC_POS;
     return 0;
 }
 
@@ -56,22 +326,173 @@ static int globalmem_release(struct inode *inode, struct file *filep)
 	return 0;
 }
 
+/*
+ *按条带号递增的顺序获取mask中各条带的互斥体，先尝试不睡眠地获取，失败时记录一次阻塞
+ */
+static void globalmem_lock(struct globalmem_dev *dev, unsigned long mask, int dir)
+{
+    unsigned int i;
+
+    for_each_set_bit(i, &mask, GLOBALMEM_STRIPES) {
+        struct mutex *mutex = &dev->stripes[i].mutex;
+
+        if (!mutex_trylock(mutex)) {
+            this_cpu_inc(dev->stats->blocks[dir]);
+            trace_globalmem_block(MINOR(dev->cdev.dev), GLOBALMEM_STAT_WRITE == dir);
+            mutex_lock(mutex);
+        }
+    }
+}
+
+static void globalmem_unlock(struct globalmem_dev *dev, unsigned long mask)
+{
+    unsigned int i;
+
+    for_each_set_bit(i, &mask, GLOBALMEM_STRIPES) {
+        mutex_unlock(&dev->stripes[i].mutex);
+    }
+}
+
+/*
+ *范围清零/填充/复制，按页分段进行: 每段只持有目标页所属条带的互斥体，段与段之间释放互斥体并允许调度，
+ *整个操作期间读者最多等待一页的复制，其他条带上的写者不受影响；范围操作整体不是原子的。
+ *空洞不申请内存: 清零时直接跳到下一个已申请的块，复制时源和目标都是空洞的页跳过。
+ *每段完成后检查信号，被打断时返回-EINTR，已完成的字节数记录在r->done中
+ */
+static int globalmem_range_op(struct globalmem_dev *dev, unsigned int cmd, struct globalmem_range *r)
+{
+    struct globalmem_dev *src = dev;
+    bool backward = false;
+    unsigned char *buf;
+    unsigned long i;
+    int ret = 0;
+
+    r->done = 0;
+    if (r->off >= dev->size || r->len > dev->size - r->off) {
+        return r->len ? -EINVAL : 0;
+    }
+    if (GLOBALMEM_IOC_COPY == cmd) {
+        if (r->src_minor >= DEVICE_NUM) {
+            return -ENODEV;
+        }
+        src = globalmem_devp[r->src_minor];
+        if (r->src_off >= src->size || r->len > src->size - r->src_off) {
+            return -EINVAL;
+        }
+        /*同一设备上源在目标之前且有重叠时从后向前复制，与memmove相同*/
+        backward = src == dev && r->src_off < r->off && r->off - r->src_off < r->len;
+    } else if (GLOBALMEM_IOC_FILL == cmd) {
+        if (0 == r->pattern_len || r->pattern_len > GLOBALMEM_PATTERN_MAX) {
+            return -EINVAL;
+        }
+    }
+
+    /*填充时按图案预先铺满一页多一点，每段从与偏移对应的相位开始取*/
+    buf = kmalloc(PAGE_SIZE + GLOBALMEM_PATTERN_MAX, GFP_KERNEL);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < PAGE_SIZE + GLOBALMEM_PATTERN_MAX; i++) {
+        buf[i] = GLOBALMEM_IOC_FILL == cmd ? r->pattern[i % r->pattern_len] : 0;
+    }
+
+    while (r->done < r->len) {
+        unsigned long left = r->len - r->done;
+        unsigned long p, s, n;
+        struct globalmem_stripe *stripe;
+        struct page *page;
+        bool data = true;
+
+        /*每段在目标和源中都不跨页*/
+        if (!backward) {
+            p = r->off + r->done;
+            s = r->src_off + r->done;
+            n = min(left, PAGE_SIZE - offset_in_page(p));
+            if (GLOBALMEM_IOC_COPY == cmd) {
+                n = min(n, PAGE_SIZE - offset_in_page(s));
+            }
+        } else {
+            p = r->off + left;
+            s = r->src_off + left;
+            n = min3(left, offset_in_page(p) ? offset_in_page(p) : PAGE_SIZE,
+                     offset_in_page(s) ? offset_in_page(s) : PAGE_SIZE);
+            p -= n;
+            s -= n;
+        }
+
+        if (GLOBALMEM_IOC_CLEAR == cmd) {
+            unsigned long next = globalmem_find_chunk(dev, p, true);
+
+            if (next > p) {     /*空洞无需清零*/
+                r->done += min(next - p, left);
+                continue;
+            }
+        } else if (GLOBALMEM_IOC_COPY == cmd) {
+            data = globalmem_snapshot(src, buf, s, n);
+        }
+
+        stripe = globalmem_stripe(dev, p);
+        globalmem_lock(dev, 1UL << (stripe - dev->stripes), GLOBALMEM_STAT_WRITE);
+        page = xa_load(&dev->pages, globalmem_chunk_index(dev, p));
+        if (page || data) {
+            page = globalmem_get_chunk(dev, globalmem_chunk_index(dev, p));
+            if (!page) {
+                mutex_unlock(&stripe->mutex);
+                ret = -ENOMEM;
+                break;
+            }
+            preempt_disable();
+            write_seqcount_begin(&stripe->seq);
+            memcpy(page_address(page) + globalmem_chunk_offset(dev, p),
+                   GLOBALMEM_IOC_FILL == cmd ? buf + (p - r->off) % r->pattern_len : buf, n);
+            write_seqcount_end(&stripe->seq);
+            preempt_enable();
+        }
+        mutex_unlock(&stripe->mutex);
+
+        r->done += n;
+        if (r->done < r->len && signal_pending(current)) {
+            ret = -EINTR;
+            break;
+        }
+        cond_resched();
+    }
+
+    kfree(buf);
+    return ret;
+}
+
 /*
  *ioctl设备控制函数
  */
 static long golbalmem_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 {
 	struct globalmem_dev *dev = filep->private_data;
+    struct globalmem_range r;
+    long ret;
 
 	switch(cmd) {
     case MEM_CLEAR:
-        mutex_lock(&dev->mutex);
-
-		memset(dev->mem, 0, GLOBALMEM_SIZE);
+        /*整个区域的范围清零，逐页进行，不再在整个清零期间阻塞读写*/
+        memset(&r, 0, sizeof(r));
+        r.len = dev->size;
+        ret = globalmem_range_op(dev, GLOBALMEM_IOC_CLEAR, &r);
+        if (ret) {
+            return ret;
+        }
 		printk(KERN_INFO "globalmem is set to zero\n");
-
-        mutex_unlock(&dev->mutex);
 		break;
+    case GLOBALMEM_IOC_CLEAR:
+    case GLOBALMEM_IOC_FILL:
+    case GLOBALMEM_IOC_COPY:
+        if (copy_from_user(&r, (void __user *)arg, sizeof(r))) {
+            return -EFAULT;
+        }
+        ret = globalmem_range_op(dev, cmd, &r);
+        if (put_user(r.done, &((struct globalmem_range __user *)arg)->done)) {
+            return -EFAULT;
+        }
+        return ret;
 	default:
 		return -EINVAL;
 	}
@@ -79,6 +500,49 @@ static long golbalmem_ioctl(struct file *filep, unsigned int cmd, unsigned long
 	return 0;
 }
 
+/*
+ *一次读写调用结束后更新统计计数并触发跟踪点
+ */
+static void globalmem_account(struct globalmem_dev *dev, int dir, loff_t pos, size_t size, ssize_t ret)
+{
+    this_cpu_inc(dev->stats->calls[dir]);
+    if (ret > 0) {
+        this_cpu_add(dev->stats->bytes[dir], ret);
+    }
+
+    if (GLOBALMEM_STAT_READ == dir) {
+        trace_globalmem_read(MINOR(dev->cdev.dev), pos, size, ret);
+    } else {
+        trace_globalmem_write(MINOR(dev->cdev.dev), pos, size, ret);
+    }
+}
+
+/*
+ *读取不跨条带单元的一段，返回未能复制的字节数
+ *copy_to_user：完成数据从内核空间向用户空间的复制，可能缺页睡眠，期间有写入时seq会改变，重新复制即可
+ */
+static unsigned long globalmem_read_unit(struct globalmem_dev *dev, char __user *buf, unsigned long p, unsigned long count)
+{
+    struct globalmem_stripe *stripe = globalmem_stripe(dev, p);
+    unsigned int seq, retry = 0;
+    unsigned long left;
+
+    do {
+        seq = read_seqcount_begin(&stripe->seq);
+        left = globalmem_copy_to_user(dev, buf, p, count);
+        if (!read_seqcount_retry(&stripe->seq, seq)) {
+            return left;
+        }
+        this_cpu_inc(dev->stats->read_retries);
+    } while (++retry < GLOBALMEM_READ_RETRY);
+
+    /*写入过于频繁时持有互斥体读取，读者不会因为不断重试而饿死*/
+    globalmem_lock(dev, 1UL << (stripe - dev->stripes), GLOBALMEM_STAT_READ);
+    left = globalmem_copy_to_user(dev, buf, p, count);
+    mutex_unlock(&stripe->mutex);
+    return left;
+}
+
 /*
  *读取设备函数
  */
@@ -86,32 +550,37 @@ static ssize_t globalmem_read(struct file *filep, char __user * buf, size_t size
 {
     unsigned long p = *ppos;
     unsigned int count = size;
+    unsigned int done = 0;
     int ret = 0;
     struct globalmem_dev *dev = filep->private_data;    /*获取设备结构体指针*/
 
-    if (p >= GLOBALMEM_SIZE) {  /*若操作范围大于本设备最大空间，则直接返回*/
-        return 0;
+    if (p >= dev->size) {  /*若操作范围大于本设备最大空间，则直接返回*/
+        goto out;
     }
 
-    if (count > GLOBALMEM_SIZE - p) {   /*若读取数据量大于设备内剩余数据量，则设置读取数据量为设备内剩余数据量*/
-        count = GLOBALMEM_SIZE - p;
+    if (count > dev->size - p) {   /*若读取数据量大于设备内剩余数据量，则设置读取数据量为设备内剩余数据量*/
+        count = dev->size - p;
     }
 
-    mutex_lock(&dev->mutex);
+    /*buf为用户空间指针，不能直接使用memcpy()等方法，内核空间不能直接访问用户空间；按条带单元分段读取*/
+    while (done < count) {
+        unsigned int n = min_t(unsigned long, count - done, globalmem_stripe_left(dev, p + done));
+
+        if (globalmem_read_unit(dev, buf + done, p + done, n)) {
+            break;
+        }
+        done += n;
+    }
 
-    /*buf为用户空间指针，不能直接使用memcpy()等方法，内核空间不能直接访问用户空间*/
-    /*copy_to_user：完成数据从内核空间向用户空间的复制*/
-    if (copy_to_user(buf, dev->mem + p, count)) {
+    if (0 == done && 0 != count) {
         ret = -EFAULT;
     } else {
-        *ppos += count;
-        ret = count;
-
-        printk(KERN_INFO "read %u bytes from %lu\n", count, p);
+        *ppos += done;
+        ret = done;
     }
 
-    mutex_unlock(&dev->mutex);
-
+out:
+    globalmem_account(dev, GLOBALMEM_STAT_READ, p, size, ret);
     return ret;
 }
 
@@ -122,39 +591,79 @@ static ssize_t globalmem_write(struct file *filep, const char __user *buf, size_
 {
     unsigned long p = *ppos;
     unsigned int count = size;
-    int ret = 0;
+    unsigned int done = 0;
+    unsigned long mask;
+    unsigned char *bounce;
+    int ret = 0, err = -EFAULT;
     struct globalmem_dev *dev = filep->private_data;
 
-    if (p > GLOBALMEM_SIZE) {   /*若操作范围大于本设备最大空间，则直接返回*/
-        return 0;
+    if (p >= dev->size || 0 == count) {   /*若操作范围大于本设备最大空间，则直接返回*/
+        goto out;
     }
 
-    if (count > GLOBALMEM_SIZE - p) {   /*若读取数据量大于设备内剩余数据量，则设置读取数据量为设备内剩余数据量*/
-        count = GLOBALMEM_SIZE - p;
+    if (count > dev->size - p) {   /*若读取数据量大于设备内剩余数据量，则设置读取数据量为设备内剩余数据量*/
+        count = dev->size - p;
     }
 
-    mutex_lock(&dev->mutex);
+    /*中转缓冲区由每次写入单独申请，不同条带上的写者不共用*/
+    bounce = kmalloc(min_t(unsigned int, count, GLOBALMEM_BOUNCE_SIZE), GFP_KERNEL);
+    if (!bounce) {
+        ret = -ENOMEM;
+        goto out;
+    }
 
-    /*将数据从用户空间拷贝的内核空间*/
-    if (copy_from_user(dev->mem + p, buf, count)) {
-        ret = -EFAULT;
-    } else {
-        *ppos += count;
-        ret = count;
+    /*整个写入范围涉及的条带全部持有，与重叠的写者之间整体互斥*/
+    mask = globalmem_stripe_mask(dev, p, count);
+    globalmem_lock(dev, mask, GLOBALMEM_STAT_WRITE);
 
-        printk(KERN_INFO "written %u bytes from %lu\n", count, p);
+    /*
+     *将数据从用户空间拷贝的内核空间，先拷入中转缓冲区，缺页睡眠时读者不受影响
+     *每段不超过GLOBALMEM_BOUNCE_SIZE且不跨条带单元，在所属条带上单独发布
+     */
+    while (done < count) {
+        unsigned int n = min_t(unsigned long, min_t(unsigned int, count - done, GLOBALMEM_BOUNCE_SIZE),
+                               globalmem_stripe_left(dev, p + done));
+        struct globalmem_stripe *stripe = globalmem_stripe(dev, p + done);
+
+        if (copy_from_user(bounce, buf + done, n)) {
+            break;
+        }
+        /*空洞所在的块在这里申请，可能睡眠，不能放到写临界区内*/
+        err = globalmem_populate(dev, p + done, n);
+        if (err) {
+            break;
+        }
+        /*写临界区内不能被抢占，否则同一CPU上的读者会一直等待seq变为偶数*/
+        preempt_disable();
+        write_seqcount_begin(&stripe->seq);
+        globalmem_copy_in(dev, p + done, bounce, n);
+        write_seqcount_end(&stripe->seq);
+        preempt_enable();
+        done += n;
     }
 
-    mutex_unlock(&dev->mutex);
+    globalmem_unlock(dev, mask);
+    kfree(bounce);
 
+    if (0 == done) {
+        ret = err;
+    } else {
+        *ppos += done;
+        ret = done;
+    }
+
+out:
+    globalmem_account(dev, GLOBALMEM_STAT_WRITE, p, size, ret);
     return ret;
 }
 
 /*
  *文件定位函数
+ *SEEK_DATA/SEEK_HOLE以块为粒度: 申请过的块即为数据，即使内容为0；从未写过的块为空洞
  */
 static loff_t globalmem_llseek(struct file *filep, loff_t offset, int orig)
 {
+    struct globalmem_dev *dev = filep->private_data;
     loff_t ret = 0;
     switch (orig) {
     case 0:
@@ -162,15 +671,15 @@ static loff_t globalmem_llseek(struct file *filep, loff_t offset, int orig)
             ret = -EINVAL;
             break;
         }
-        if ((unsigned int)offset > GLOBALMEM_SIZE) {
+        if ((unsigned long)offset > dev->size) {
             ret = -EINVAL;
             break;
         }
-        filep->f_pos = (unsigned int)offset;
+        filep->f_pos = offset;
         ret = filep->f_pos;
         break;
     case 1:
-        if ((filep->f_pos + offset) > GLOBALMEM_SIZE) {
+        if ((filep->f_pos + offset) > dev->size) {
             ret = -EINVAL;
             break;
         }
@@ -181,6 +690,27 @@ static loff_t globalmem_llseek(struct file *filep, loff_t offset, int orig)
         filep->f_pos += offset;
         ret = filep->f_pos;
         break;
+    case SEEK_END:
+        if (offset > 0 || offset < -(loff_t)dev->size) {
+            ret = -EINVAL;
+            break;
+        }
+        filep->f_pos = dev->size + offset;
+        ret = filep->f_pos;
+        break;
+    case SEEK_DATA:
+    case SEEK_HOLE:
+        if (offset < 0 || (unsigned long)offset >= dev->size) {
+            ret = -ENXIO;
+            break;
+        }
+        ret = globalmem_find_chunk(dev, offset, SEEK_DATA == orig);
+        if (SEEK_DATA == orig && ret == dev->size) {
+            ret = -ENXIO;   /*offset之后已没有数据*/
+            break;
+        }
+        filep->f_pos = ret;
+        break;
     default:
         ret = -EINVAL;
         break;
@@ -189,6 +719,99 @@ static loff_t globalmem_llseek(struct file *filep, loff_t offset, int orig)
     return ret;
 }
 
+/*
+ *内存映射
+ *数据区的页在设备存在期间一直有效，映射按页帧(VM_PFNMAP)建立，不对页做引用计数；
+ *缺页时才建立对应页的映射，空洞在缺页时申请，大页模式下以PMD整块映射
+ */
+static vm_fault_t globalmem_vm_fault(struct vm_fault *vmf)
+{
+    struct globalmem_dev *dev = vmf->vma->vm_private_data;
+    unsigned long off = vmf->pgoff << PAGE_SHIFT;
+    struct page *page;
+
+    if (off >= dev->size) {
+        return VM_FAULT_SIGBUS;
+    }
+    page = globalmem_get_chunk(dev, globalmem_chunk_index(dev, off));
+    if (!page) {
+        return VM_FAULT_OOM;
+    }
+    return vmf_insert_pfn(vmf->vma, vmf->address, page_to_pfn(page) + (globalmem_chunk_offset(dev, off) >> PAGE_SHIFT));
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static vm_fault_t globalmem_vm_huge_fault(struct vm_fault *vmf, enum page_entry_size pe_size)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    struct globalmem_dev *dev = vma->vm_private_data;
+    unsigned long addr = vmf->address & HPAGE_PMD_MASK;
+    unsigned long off = (vma->vm_pgoff << PAGE_SHIFT) + (addr - vma->vm_start);
+    struct page *page;
+
+    /*只有虚拟地址和数据区偏移都按大页对齐、并且整块都在vma内时才能以PMD映射，否则退回按页映射*/
+    if (PE_SIZE_PMD != pe_size || HPAGE_PMD_ORDER != dev->order ||
+        addr < vma->vm_start || addr + HPAGE_PMD_SIZE > vma->vm_end ||
+        (off & ~HPAGE_PMD_MASK) || off >= dev->size) {
+        return VM_FAULT_FALLBACK;
+    }
+    page = globalmem_get_chunk(dev, globalmem_chunk_index(dev, off));
+    if (!page) {
+        return VM_FAULT_OOM;
+    }
+    return vmf_insert_pfn_pmd(vmf, page_to_pfn_t(page), vmf->flags & FAULT_FLAG_WRITE);
+}
+
+/*
+ *大页模式下把映射地址对齐到大页边界，否则PMD映射永远无法生效
+ */
+static unsigned long globalmem_get_unmapped_area(struct file *filep, unsigned long addr, unsigned long len,
+                                                 unsigned long pgoff, unsigned long flags)
+{
+    struct globalmem_dev *dev = filep->private_data;
+    unsigned long ret;
+
+    if (HPAGE_PMD_ORDER != dev->order || addr || len < HPAGE_PMD_SIZE || ((pgoff << PAGE_SHIFT) & ~HPAGE_PMD_MASK)) {
+        return current->mm->get_unmapped_area(filep, addr, len, pgoff, flags);
+    }
+
+    ret = current->mm->get_unmapped_area(filep, 0, len + HPAGE_PMD_SIZE, pgoff, flags);
+    if (IS_ERR_VALUE(ret)) {
+        return current->mm->get_unmapped_area(filep, addr, len, pgoff, flags);
+    }
+    return round_up(ret, HPAGE_PMD_SIZE);
+}
+#endif
+
+static const struct vm_operations_struct globalmem_vm_ops = {
+    .fault      = globalmem_vm_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    .huge_fault = globalmem_vm_huge_fault,
+#endif
+};
+
+static int globalmem_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+    struct globalmem_dev *dev = filep->private_data;
+
+    /*私有映射写入时会产生COW副本，与其他进程看到的不再是同一份数据*/
+    if (!(vma->vm_flags & VM_SHARED)) {
+        return -EINVAL;
+    }
+    if (vma->vm_pgoff > dev->size >> PAGE_SHIFT ||
+        vma_pages(vma) > (dev->size >> PAGE_SHIFT) - vma->vm_pgoff) {
+        return -EINVAL;
+    }
+
+    vma->vm_flags |= VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP;
+    if (dev->order) {
+        vma->vm_flags |= VM_HUGEPAGE;
+    }
+    vma->vm_ops = &globalmem_vm_ops;
+    vma->vm_private_data = dev;
+    return 0;
+}
+
 /*
  *文件操作的结构体
  */
@@ -198,18 +821,90 @@ static const struct file_operations globalmem_fops = {
     .read           = globalmem_read,
     .write          = globalmem_write,
     .unlocked_ioctl = golbalmem_ioctl,
+    .mmap           = globalmem_mmap,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    .get_unmapped_area = globalmem_get_unmapped_area,
+#endif
     .open           = globalmem_open,
     .release        = globalmem_release,
 };
 
+/*
+ *统计计数通过sysfs导出: /sys/class/globalmem_class/globalmem_<n>/stats/下每个计数一个文件
+ */
+static u64 globalmem_stat_sum(struct device *d, size_t offset)
+{
+    struct globalmem_dev *dev = dev_get_drvdata(d);
+    u64 sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        sum += *(u64 *)((char *)per_cpu_ptr(dev->stats, cpu) + offset);
+    }
+    return sum;
+}
+
+#define GLOBALMEM_STAT_ATTR(_name, _field)                                                          \
+static ssize_t _name##_show(struct device *d, struct device_attribute *attr, char *buf)            \
+{                                                                                                   \
+    return sprintf(buf, "%llu\n",                                                                   \
+                   (unsigned long long)globalmem_stat_sum(d, offsetof(struct globalmem_stats, _field)));    \
+}                                                                                                   \
+static DEVICE_ATTR_RO(_name)
+
+GLOBALMEM_STAT_ATTR(reads, calls[GLOBALMEM_STAT_READ]);
+GLOBALMEM_STAT_ATTR(writes, calls[GLOBALMEM_STAT_WRITE]);
+GLOBALMEM_STAT_ATTR(read_bytes, bytes[GLOBALMEM_STAT_READ]);
+GLOBALMEM_STAT_ATTR(write_bytes, bytes[GLOBALMEM_STAT_WRITE]);
+GLOBALMEM_STAT_ATTR(read_blocks, blocks[GLOBALMEM_STAT_READ]);
+GLOBALMEM_STAT_ATTR(write_blocks, blocks[GLOBALMEM_STAT_WRITE]);
+GLOBALMEM_STAT_ATTR(read_retries, read_retries);
+
+/*
+ *已申请的数据区字节数，即设备实际占用的内存
+ */
+static ssize_t resident_bytes_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct globalmem_dev *dev = dev_get_drvdata(d);
+
+    return sprintf(buf, "%lu\n", atomic_long_read(&dev->nr_chunks) * globalmem_chunk_size(dev));
+}
+static DEVICE_ATTR_RO(resident_bytes);
+
+static struct attribute *globalmem_stats_attrs[] = {
+    &dev_attr_reads.attr,
+    &dev_attr_writes.attr,
+    &dev_attr_read_bytes.attr,
+    &dev_attr_write_bytes.attr,
+    &dev_attr_read_blocks.attr,
+    &dev_attr_write_blocks.attr,
+    &dev_attr_read_retries.attr,
+    &dev_attr_resident_bytes.attr,
+    NULL,
+};
+
+static const struct attribute_group globalmem_stats_group = {
+    .name   = "stats",
+    .attrs  = globalmem_stats_attrs,
+};
+
+static const struct attribute_group *globalmem_groups[] = {
+    &globalmem_stats_group,
+    NULL,
+};
+
 /*
  *初始化字符设备结构体，并注册设备
  */
 static void globalmem_setup_cdev(struct globalmem_dev *dev, int index)
 {
-    int err, devno = MKDEV(globalmem_major, index);
+    int i, err, devno = MKDEV(globalmem_major, index);
 
-    mutex_init(&dev->mutex);
+    for (i = 0; i < GLOBALMEM_STRIPES; i++) {   /*cdev_add之后设备即可被打开，必须先初始化互斥体*/
+        mutex_init(&dev->stripes[i].mutex);
+        lockdep_set_class(&dev->stripes[i].mutex, &globalmem_stripe_keys[i]);
+        seqcount_init(&dev->stripes[i].seq);
+    }
     cdev_init(&dev->cdev, &globalmem_fops);
     dev->cdev.owner = THIS_MODULE;
     err = cdev_add(&dev->cdev, devno, 1);
@@ -218,6 +913,85 @@ static void globalmem_setup_cdev(struct globalmem_dev *dev, int index)
     }
 }
 
+/*
+ *设备所在的NUMA节点: 各设备依次分布到各节点上，
+ *使绑定在不同节点上的进程可以选用本地节点的设备
+ */
+static int globalmem_dev_node(int index)
+{
+    return cpu_to_node(cpumask_local_spread(index, NUMA_NO_NODE));
+}
+
+static void globalmem_free_pages(struct globalmem_dev *dev)
+{
+    unsigned long index;
+    struct page *page;
+
+    xa_for_each(&dev->pages, index, page) {
+        __free_pages(page, dev->order);
+    }
+    xa_destroy(&dev->pages);
+    atomic_long_set(&dev->nr_chunks, 0);
+}
+
+/*
+ *按order设置块大小，区域大小向上取整为块大小的整数倍，块在第一次写入时才申请
+ */
+static void globalmem_init_pages(struct globalmem_dev *dev, unsigned int order)
+{
+    xa_init(&dev->pages);
+    dev->order = order;
+    dev->size = ALIGN(globalmem_size, PAGE_SIZE << order);
+}
+
+/*
+ *在设备所在节点上申请设备结构体和数据区
+ */
+static struct globalmem_dev *globalmem_alloc_dev(int index)
+{
+    struct globalmem_dev *dev;
+    int node = globalmem_dev_node(index);
+    bool huge = false;
+
+    dev = kzalloc_node(sizeof(*dev), GFP_KERNEL, node);
+    if (!dev) {
+        return NULL;
+    }
+    dev->node = node;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    if (globalmem_hugepage) {
+        /*先申请第一块，试探当前是否还能申请到大页，申请不到时退回普通页*/
+        globalmem_init_pages(dev, HPAGE_PMD_ORDER);
+        huge = globalmem_get_chunk(dev, 0) != NULL;
+        if (!huge) {
+            printk(KERN_WARNING "globalmem_%d: no huge pages, falling back to normal pages\n", index);
+        }
+    }
+#endif
+    if (!huge) {
+        globalmem_init_pages(dev, 0);
+    }
+    dev->stripe_shift = max_t(unsigned int, PAGE_SHIFT, order_base_2(globalmem_stripe_size));
+    dev->stats = alloc_percpu(struct globalmem_stats);
+    if (!dev->stats) {
+        globalmem_free_pages(dev);
+        kfree(dev);
+        return NULL;
+    }
+
+    return dev;
+}
+
+static void globalmem_free_dev(struct globalmem_dev *dev)
+{
+    if (dev) {
+        globalmem_free_pages(dev);
+        free_percpu(dev->stats);
+        kfree(dev);
+    }
+}
+
 /*
  *设备驱动模块加载函数
  */
@@ -237,31 +1011,39 @@ static int __init globalmem_init(void)
     if (ret < 0) {
         return ret;
     }
+
+    if (0 == globalmem_size) {
+        ret = -EINVAL;
+        goto malloc_err;
+    }
+
+    /*每个设备单独申请内存块，sysfs统计属性随设备文件一起创建，因此先于设备文件申请*/
+    for (i=0; i < DEVICE_NUM; i++) {
+        globalmem_devp[i] = globalmem_alloc_dev(i);
+        if (!globalmem_devp[i]) {
+            ret = -ENOMEM;
+            goto malloc_err;
+        }
+    }
+
     /*注册设备类，使可以自动生成设备文件*/
     globalmem_class = class_create(THIS_MODULE, "globalmem_class");
     if (IS_ERR(globalmem_class)) {
         ret = PTR_ERR(globalmem_class);
-        goto class_err;
+        goto malloc_err;
     }
     for (i=0; i < DEVICE_NUM; i++) {
-        /*自动生成设备文件*/
-        globalmem_device = device_create(globalmem_class, NULL, MKDEV(globalmem_major, i), NULL, "globalmem_%d", i);
+        /*自动生成设备文件，并在其下创建stats属性组*/
+        globalmem_device = device_create_with_groups(globalmem_class, NULL, MKDEV(globalmem_major, i),
+                                                     globalmem_devp[i], globalmem_groups, "globalmem_%d", i);
         if (IS_ERR(globalmem_device)) {
             ret = PTR_ERR(globalmem_device);
             goto device_err;
         }
     }
-    
-    /*申请内存块*/
-    globalmem_devp = kzalloc(sizeof(struct globalmem_dev) * DEVICE_NUM, GFP_KERNEL);
-
-    if (!globalmem_devp) {
-        ret = -ENOMEM;
-        goto malloc_err;
-    }
 
     for (i=0; i < DEVICE_NUM; i++) {
-        globalmem_setup_cdev(globalmem_devp + i, i);
+        globalmem_setup_cdev(globalmem_devp[i], i);
     }
 
 /*note 1:*/
@@ -294,22 +1076,22 @@ static int __init globalmem_init(void)
 /*
 devfile_error:
     for (i=0; i < DEVICE_NUM; i++) {
-        cdev_del(&(globalmem_devp +i)->cdev);
+        cdev_del(&globalmem_devp[i]->cdev);
     }
-
-    kfree(globalmem_devp);
 */
 /*end note 2*/
-malloc_err:
-    i = DEVICE_NUM;
-
 device_err:
     while (i--) {
-        device_destroy(globalmem_class,MKDEV(globalmem_major, i-1));
+        device_destroy(globalmem_class, MKDEV(globalmem_major, i));
     }
     class_destroy(globalmem_class);
 
-class_err:
+malloc_err:
+    for (i=0; i < DEVICE_NUM; i++) {
+        globalmem_free_dev(globalmem_devp[i]);
+        globalmem_devp[i] = NULL;
+    }
+
     unregister_chrdev_region(devno, DEVICE_NUM);
     return ret;
 }
@@ -323,16 +1105,18 @@ static void __exit globalmem_exit(void)
 {
     int i;
     for (i=0; i < DEVICE_NUM; i++) {    /*从系统注销设备*/
-        cdev_del(&(globalmem_devp +i)->cdev);
+        cdev_del(&globalmem_devp[i]->cdev);
     }
 
-    kfree(globalmem_devp);  /*释放内存块*/
-
-    unregister_chrdev_region(MKDEV(globalmem_major, 0), DEVICE_NUM);    /*使用设备号*/
-    for (i=0; i < DEVICE_NUM; i++) {    /*删除设备文件*/
+    for (i=0; i < DEVICE_NUM; i++) {    /*删除设备文件，之后sysfs属性不再访问设备结构体*/
         device_destroy(globalmem_class, MKDEV(globalmem_major, i));
     }
     class_destroy(globalmem_class); /*注销设备类*/
+
+    for (i=0; i < DEVICE_NUM; i++) {
+        globalmem_free_dev(globalmem_devp[i]);  /*释放内存块*/
+    }
+    unregister_chrdev_region(MKDEV(globalmem_major, 0), DEVICE_NUM);    /*使用设备号*/
     printk("Bye, See you next time.\n");
 }
 module_exit(globalmem_exit);
@@ -0,0 +1,46 @@
+/*
+ * globalmem ioctl definitions, shared by the driver and user space programs
+ *
+ * copyright (c) 2017 Nick Yan
+ *
+ * Licensed under GPLv2 or later
+ */
+
+#ifndef _GLOBALMEM_H
+#define _GLOBALMEM_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define GLOBALMEM_IOC_MAGIC     'm'
+
+#define GLOBALMEM_PATTERN_MAX   16      /*填充图案的最大长度*/
+
+/*
+ *范围操作的参数
+ *范围操作按页分段进行，每段只持有该页所属条带的锁，段与段之间释放锁，
+ *操作期间读者最多等待一页的复制；整个操作不是原子的，其他写者可能在段与段之间修改数据。
+ *操作可被信号打断(返回EINTR)，无论成功与否，done都返回已完成的字节数。
+ */
+struct globalmem_range {
+    __u64 off;                  /*目标起始偏移*/
+    __u64 len;                  /*长度*/
+    __u64 src_off;              /*COPY: 源起始偏移*/
+    __u32 src_minor;            /*COPY: 源设备的次设备号，可以与目标相同*/
+    __u32 pattern_len;          /*FILL: 图案长度，1~GLOBALMEM_PATTERN_MAX*/
+    __u8  pattern[GLOBALMEM_PATTERN_MAX];   /*FILL: 目标偏移off + i处写入pattern[i % pattern_len]*/
+    __u64 done;                 /*返回: 已完成的字节数*/
+};
+
+/*
+ *CLEAR: 把[off, off + len)清零，从未写过的空洞保持为空洞，不申请内存
+ *FILL:  把[off, off + len)按图案重复填充
+ *COPY:  把源设备[src_off, src_off + len)复制到本设备[off, off + len)，
+ *       同一设备上源与目标重叠时结果与memmove相同；源和目标都是空洞的部分跳过
+ *超出设备区域时返回EINVAL
+ */
+#define GLOBALMEM_IOC_CLEAR     _IOWR(GLOBALMEM_IOC_MAGIC, 1, struct globalmem_range)
+#define GLOBALMEM_IOC_FILL      _IOWR(GLOBALMEM_IOC_MAGIC, 2, struct globalmem_range)
+#define GLOBALMEM_IOC_COPY      _IOWR(GLOBALMEM_IOC_MAGIC, 3, struct globalmem_range)
+
+#endif /* _GLOBALMEM_H */
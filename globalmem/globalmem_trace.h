@@ -0,0 +1,86 @@
+/*
+ * globalmem tracepoints
+ *
+ * copyright (c) 2017 Nick Yan
+ *
+ * Licensed under GPLv2 or later
+ */
+
+/*
+ *跟踪点，替代读写路径上的printk:
+ *  echo 1 > /sys/kernel/debug/tracing/events/globalmem/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM globalmem
+
+#if !defined(_GLOBALMEM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _GLOBALMEM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ *一次read/write调用结束，pos为起始偏移，ret为返回值
+ */
+DECLARE_EVENT_CLASS(globalmem_rw,
+
+    TP_PROTO(int minor, loff_t pos, size_t count, ssize_t ret),
+
+    TP_ARGS(minor, pos, count, ret),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(loff_t, pos)
+        __field(size_t, count)
+        __field(ssize_t, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->pos = pos;
+        __entry->count = count;
+        __entry->ret = ret;
+    ),
+
+    TP_printk("minor=%d pos=%lld count=%zu ret=%zd", __entry->minor,
+              (long long)__entry->pos, __entry->count, __entry->ret)
+);
+
+DEFINE_EVENT(globalmem_rw, globalmem_read,
+    TP_PROTO(int minor, loff_t pos, size_t count, ssize_t ret),
+    TP_ARGS(minor, pos, count, ret)
+);
+
+DEFINE_EVENT(globalmem_rw, globalmem_write,
+    TP_PROTO(int minor, loff_t pos, size_t count, ssize_t ret),
+    TP_ARGS(minor, pos, count, ret)
+);
+
+/*
+ *互斥体已被其他进程持有，读者/写者需要睡眠等待
+ */
+TRACE_EVENT(globalmem_block,
+
+    TP_PROTO(int minor, bool write),
+
+    TP_ARGS(minor, write),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(bool, write)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->write = write;
+    ),
+
+    TP_printk("minor=%d %s", __entry->minor, __entry->write ? "write" : "read")
+);
+
+#endif /* _GLOBALMEM_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE globalmem_trace
+#include <trace/define_trace.h>
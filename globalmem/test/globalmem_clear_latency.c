@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include "../globalmem.h"
+
+/*
+ *globalmem清零期间的读延迟测试
+ *先用FILL把区域[0, 区域大小)填满(全部页都已申请)，然后一个读者线程不停地在区域内随机pread，
+ *主线程依次执行以下操作，统计每个操作进行期间读者的最大延迟和p99.9延迟:
+ *  idle      不做任何操作，作为基准
+ *  MEM_CLEAR 旧的整体清零命令，现在同样逐页进行
+ *  CLEAR     范围清零
+ *  FILL      范围填充
+ *  COPY      把前一半复制到后一半
+ *清零在持有锁期间完成时，读者的最大延迟接近整个清零的耗时；逐页进行时应只比基准高出一页复制的时间。
+ *较大的区域需要加载模块时指定globalmem_size。
+ *
+ *用法: globalmem_clear_latency [设备文件] [区域大小] [单次读取长度]
+ */
+
+#define MEM_CLEAR       0x1
+#define MAX_SAMPLES     (1 << 22)
+
+static int fd, minor;
+static size_t region, len;
+static volatile int stop, recording;
+static volatile unsigned long iters;
+static uint64_t *samples;
+static unsigned long nsamples;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void *read_work(void *arg)
+{
+    char *buf = malloc(len);
+    unsigned int seed = 1;
+
+    (void)arg;
+    while (!stop) {
+        off_t off = ((off_t)rand_r(&seed) * 4096) % (region - len + 1);
+        uint64_t t0 = now_ns(), t1;
+
+        if (pread(fd, buf, len, off) != (ssize_t)len) {
+            perror("pread");
+            stop = 1;
+            break;
+        }
+        t1 = now_ns();
+        if (recording && nsamples < MAX_SAMPLES) {
+            samples[nsamples++] = t1 - t0;
+        }
+        iters++;
+    }
+    free(buf);
+    return NULL;
+}
+
+static int range_op(unsigned long cmd, struct globalmem_range *r)
+{
+    if (ioctl(fd, cmd, r)) {
+        perror("ioctl");
+        return -1;
+    }
+    return 0;
+}
+
+static int fill(unsigned char val)
+{
+    struct globalmem_range r;
+
+    memset(&r, 0, sizeof(r));
+    r.len = region;
+    r.pattern_len = 1;
+    r.pattern[0] = val;
+    return range_op(GLOBALMEM_IOC_FILL, &r);
+}
+
+/*
+ *执行一个操作并输出其耗时以及期间读者的延迟分布
+ */
+static void phase(const char *name, int op)
+{
+    struct globalmem_range r;
+    uint64_t t0, t1;
+    int ret = 0;
+
+    memset(&r, 0, sizeof(r));
+    r.len = region;
+    nsamples = 0;
+    __sync_synchronize();
+    recording = 1;
+    t0 = now_ns();
+    switch (op) {
+    case 0:
+        usleep(200000);
+        break;
+    case 1:
+        ret = ioctl(fd, MEM_CLEAR, 0);
+        break;
+    case 2:
+        ret = range_op(GLOBALMEM_IOC_CLEAR, &r);
+        break;
+    case 3:
+        r.pattern_len = 4;
+        memcpy(r.pattern, "\x01\x02\x03\x04", 4);
+        ret = range_op(GLOBALMEM_IOC_FILL, &r);
+        break;
+    case 4:
+        r.len = region / 2;
+        r.off = region / 2;
+        r.src_minor = minor;
+        ret = range_op(GLOBALMEM_IOC_COPY, &r);
+        break;
+    }
+    t1 = now_ns();
+    recording = 0;
+    __sync_synchronize();
+    {   /*等读者完成当前这次读取，之后不会再写samples*/
+        unsigned long seen = iters;
+
+        while (iters - seen < 2 && !stop) {
+            sched_yield();
+        }
+    }
+
+    if (ret) {
+        printf("%-10s failed\n", name);
+        return;
+    }
+    if (0 == nsamples) {
+        printf("%-10s %12.3f %10s\n", name, (t1 - t0) / 1e6, "0");
+        return;
+    }
+    qsort(samples, nsamples, sizeof(samples[0]), cmp_u64);
+    printf("%-10s %12.3f %10lu %10llu %10llu %10llu\n", name, (t1 - t0) / 1e6, nsamples,
+           (unsigned long long)samples[nsamples / 2], (unsigned long long)samples[nsamples * 999 / 1000],
+           (unsigned long long)samples[nsamples - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalmem_0";
+    const char *names[] = { "idle", "MEM_CLEAR", "CLEAR", "FILL", "COPY" };
+    pthread_t tid;
+    struct globalmem_range r;
+    int op;
+
+    region = argc > 2 ? strtoul(argv[2], NULL, 0) : 64 << 20;
+    len = argc > 3 ? strtoul(argv[3], NULL, 0) : 4096;
+    if (len > region) {
+        printf("read length %zu larger than region %zu\n", len, region);
+        return 1;
+    }
+    if (1 != sscanf(path, "/dev/globalmem_%d", &minor)) {
+        minor = 0;
+    }
+
+    fd = open(path, O_RDWR);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", path);
+        return 1;
+    }
+    samples = malloc(MAX_SAMPLES * sizeof(*samples));
+
+    printf("globalmem read latency during bulk operations on %s, %zu B region, %zu B per pread\n",
+           path, region, len);
+    printf("%-10s %12s %10s %10s %10s %10s\n", "op", "time(ms)", "reads", "p50(ns)", "p99.9(ns)", "max(ns)");
+    pthread_create(&tid, NULL, read_work, NULL);
+    for (op = 0; op < 5; op++) {
+        if (fill(0x5a)) {   /*每个操作前重新填满，保证所有页都已申请*/
+            return 1;
+        }
+        phase(names[op], op);
+    }
+    stop = 1;
+    pthread_join(tid, NULL);
+
+    /*简单检查范围操作的结果*/
+    memset(&r, 0, sizeof(r));
+    r.off = region / 2;
+    r.len = region / 2;
+    if (fill(0x11) || range_op(GLOBALMEM_IOC_CLEAR, &r)) {
+        return 1;
+    }
+    {
+        unsigned char a = 0, b = 0xff;
+
+        if (pread(fd, &a, 1, 0) != 1 || pread(fd, &b, 1, region - 1) != 1 || 0x11 != a || 0 != b) {
+            printf("range check failed: first 0x%02x, last 0x%02x\n", a, b);
+            return 1;
+        }
+    }
+    printf("range check ok\n");
+
+    free(samples);
+    close(fd);
+    return 0;
+}
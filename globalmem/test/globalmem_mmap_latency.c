@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <sys/mman.h>
+
+/*
+ *globalmem随机访问延迟测试: pread与mmap对比
+ *在设备区域内随机选取8字节对齐的位置，分别用pread和直接访问mmap映射读取8字节，
+ *逐次用clock_gettime计时并扣除计时本身的开销，输出平均值、p50、p99(纳秒)。
+ *开始前先通过映射写入一段数据，再用pread读回，检查两条路径看到的内容一致。
+ *加载模块时指定globalmem_hugepage=1可让映射使用2MB大页，对比TLB缺失的影响。
+ *
+ *用法: globalmem_mmap_latency [设备文件] [区域大小，0表示使用设备大小，大页时为2097152] [次数]
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ *测量两次连续clock_gettime之间的最小间隔，作为每次计时需要扣除的开销
+ */
+static uint64_t timer_overhead(void)
+{
+    uint64_t best = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        uint64_t t0 = now_ns(), t1 = now_ns();
+
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+        }
+    }
+    return best;
+}
+
+static void report(const char *name, uint64_t *lat, unsigned long n, uint64_t overhead)
+{
+    unsigned long i;
+    double sum = 0;
+
+    for (i = 0; i < n; i++) {
+        lat[i] = lat[i] > overhead ? lat[i] - overhead : 0;
+        sum += lat[i];
+    }
+    qsort(lat, n, sizeof(lat[0]), cmp_u64);
+    printf("%-6s %10.1f %10llu %10llu\n", name, sum / n,
+           (unsigned long long)lat[n / 2], (unsigned long long)lat[n * 99 / 100]);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalmem_0";
+    size_t size = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+    unsigned long iters = argc > 3 ? strtoul(argv[3], NULL, 0) : 1000000;
+    volatile uint64_t *map;
+    uint64_t *lat, *offs, overhead, val, sink = 0;
+    unsigned long i;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", path);
+        return 1;
+    }
+    if (0 == size) {   /*驱动不支持SEEK_END时按默认的一页大小测试*/
+        off_t end = lseek(fd, 0, SEEK_END);
+
+        size = end > 0 ? (size_t)end : 4096;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == map) {
+        perror("mmap");
+        return 1;
+    }
+
+    /*一致性检查: 映射写入，pread读回*/
+    for (i = 0; i < size / 8; i++) {
+        map[i] = 0x9e3779b97f4a7c15ull * (i + 1);
+    }
+    for (i = 0; i < size / 8; i++) {
+        if (pread(fd, &val, 8, i * 8) != 8 || val != 0x9e3779b97f4a7c15ull * (i + 1)) {
+            printf("mismatch at offset %lu\n", i * 8);
+            return 1;
+        }
+    }
+
+    lat = malloc(iters * sizeof(*lat));
+    offs = malloc(iters * sizeof(*offs));
+    srand(1);
+    for (i = 0; i < iters; i++) {
+        offs[i] = ((uint64_t)rand() * 8) % size & ~7ull;
+    }
+    overhead = timer_overhead();
+
+    printf("globalmem random 8 B access on %s, %zu B region, %lu ops, timer overhead %llu ns\n",
+           path, size, iters, (unsigned long long)overhead);
+    printf("%-6s %10s %10s %10s\n", "path", "avg(ns)", "p50(ns)", "p99(ns)");
+
+    for (i = 0; i < iters; i++) {
+        uint64_t t0 = now_ns();
+
+        if (pread(fd, &val, 8, offs[i]) != 8) {
+            perror("pread");
+            return 1;
+        }
+        lat[i] = now_ns() - t0;
+        sink += val;
+    }
+    report("pread", lat, iters, overhead);
+
+    for (i = 0; i < iters; i++) {
+        uint64_t t0 = now_ns();
+
+        sink += map[offs[i] / 8];
+        lat[i] = now_ns() - t0;
+    }
+    report("mmap", lat, iters, overhead);
+
+    if (0 == sink) {
+        printf("\n");
+    }
+    free(lat);
+    free(offs);
+    munmap((void *)map, size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ *globalmem读扩展性测试
+ *1、2、4、8、16个线程同时对同一个次设备pread相同的区域，输出合计读吞吐及相对单线程的倍数。
+ *读者之间不再互斥，理想情况下吞吐随线程数(不超过CPU数)线性增长。
+ *可选地再开一个写者线程不断写入整块相同字节的数据，读者检查读到的每一块是否都由同一字节组成，
+ *统计读到新旧数据混杂(torn)的次数，正确实现下应为0。
+ *
+ *用法: globalmem_read_scale [设备文件] [每轮秒数] [单次长度] [是否开启写者0/1]
+ */
+
+#define MAX_THREADS     16
+
+struct reader {
+    pthread_t tid;
+    int cpu;
+    int fd;
+    size_t len;
+    double seconds;
+    int check;
+    unsigned long long ops;
+    unsigned long long torn;
+};
+
+static volatile int stop_writer;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *read_work(void *arg)
+{
+    struct reader *r = arg;
+    char *buf = malloc(r->len);
+    double start, elapsed;
+
+    pin(r->cpu);
+    start = now_sec();
+    do {
+        int i;
+
+        for (i = 0; i < 256; i++) {
+            size_t k;
+
+            if (pread(r->fd, buf, r->len, 0) != (ssize_t)r->len) {
+                perror("pread");
+                goto out;
+            }
+            r->ops++;
+            if (!r->check) {
+                continue;
+            }
+            for (k = 1; k < r->len; k++) {
+                if (buf[k] != buf[0]) {
+                    r->torn++;
+                    break;
+                }
+            }
+        }
+        elapsed = now_sec() - start;
+    } while (elapsed < r->seconds);
+out:
+    free(buf);
+    return NULL;
+}
+
+static void *write_work(void *arg)
+{
+    struct reader *w = arg;
+    char *buf = malloc(w->len);
+    unsigned char val = 0;
+
+    while (!stop_writer) {
+        memset(buf, val++, w->len);
+        if (pwrite(w->fd, buf, w->len, 0) != (ssize_t)w->len) {
+            perror("pwrite");
+            break;
+        }
+        w->ops++;
+    }
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalmem_0";
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    size_t len = argc > 3 ? strtoul(argv[3], NULL, 0) : 4096;
+    int writer = argc > 4 ? atoi(argv[4]) : 0;
+    int counts[] = { 1, 2, 4, 8, 16 };
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    struct reader r[MAX_THREADS], w;
+    double base = 0;
+    unsigned int c;
+    char *buf;
+    int i;
+
+    /*先写入一块一致的数据，保证读者一开始读到的就是整块相同的字节*/
+    w.fd = open(path, O_RDWR);
+    if (-1 == w.fd) {
+        printf("open device file %s error.\n", path);
+        return 1;
+    }
+    w.len = len;
+    buf = calloc(1, len);
+    if (pwrite(w.fd, buf, len, 0) != (ssize_t)len) {
+        perror("pwrite");
+        return 1;
+    }
+    free(buf);
+
+    printf("globalmem read scaling on %s, %zu B per pread, %.1f s per run, writer %s\n",
+           path, len, seconds, writer ? "on" : "off");
+    printf("threads %12s %12s %9s %8s %12s\n", "reads/s", "MB/s", "scaling", "torn", "writes/s");
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        int n = counts[c];
+        unsigned long long ops = 0, torn = 0;
+        double start, elapsed;
+
+        for (i = 0; i < n; i++) {
+            r[i].fd = open(path, O_RDONLY);
+            if (-1 == r[i].fd) {
+                printf("open device file %s error.\n", path);
+                return 1;
+            }
+            r[i].cpu = i % ncpu;
+            r[i].len = len;
+            r[i].seconds = seconds;
+            r[i].check = writer;
+            r[i].ops = 0;
+            r[i].torn = 0;
+        }
+
+        w.ops = 0;
+        stop_writer = 0;
+        if (writer) {
+            pthread_create(&w.tid, NULL, write_work, &w);
+        }
+        start = now_sec();
+        for (i = 0; i < n; i++) {
+            pthread_create(&r[i].tid, NULL, read_work, &r[i]);
+        }
+        for (i = 0; i < n; i++) {
+            pthread_join(r[i].tid, NULL);
+            ops += r[i].ops;
+            torn += r[i].torn;
+            close(r[i].fd);
+        }
+        elapsed = now_sec() - start;
+        stop_writer = 1;
+        if (writer) {
+            pthread_join(w.tid, NULL);
+        }
+
+        if (1 == n) {
+            base = ops / elapsed;
+        }
+        printf("%7d %12.0f %12.1f %8.2fx %8llu %12.0f\n", n, ops / elapsed, ops * len / elapsed / 1e6,
+               ops / elapsed / base, torn, w.ops / elapsed);
+    }
+
+    close(w.fd);
+    return 0;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ *globalmem并行扫描测试
+ *所有线程共用一个fd，把整个区域(lseek SEEK_END得到的大小)分成与线程数相同的段，每个线程扫描自己的一段:
+ *  pread   直接按位置读取，不需要任何用户态的锁
+ *  locked  旧的做法，lseek+read必须在同一把用户态锁内完成，否则文件位置会被其他线程改掉
+ *  data    先用SEEK_DATA/SEEK_HOLE找出段内的数据区间，只对数据区间pread，稀疏区域上跳过空洞
+ *            (lseek会修改共用的f_pos，因此这一步仍然需要加锁，但查找远比读取少)
+ *分别输出1、2、4、8、16个线程时的合计扫描吞吐(按整个区域大小计算)，以及data模式实际读取的字节数。
+ *
+ *用法: globalmem_scan [设备文件] [单次读取长度]
+ */
+
+#define MAX_THREADS     16
+
+enum { MODE_PREAD, MODE_LOCKED, MODE_DATA };
+
+struct scanner {
+    pthread_t tid;
+    int cpu;
+    int fd;
+    int mode;
+    off_t start;
+    off_t end;
+    size_t len;
+    unsigned long long bytes;
+    unsigned long long sum;
+};
+
+static pthread_mutex_t pos_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ *读取[off, end)，对读到的数据做简单的求和，防止读取被当作无用操作
+ */
+static int scan_range(struct scanner *s, char *buf, off_t off, off_t end)
+{
+    while (off < end) {
+        size_t n = end - off < (off_t)s->len ? (size_t)(end - off) : s->len;
+        ssize_t ret, k;
+
+        if (MODE_LOCKED == s->mode) {
+            pthread_mutex_lock(&pos_lock);
+            lseek(s->fd, off, SEEK_SET);
+            ret = read(s->fd, buf, n);
+            pthread_mutex_unlock(&pos_lock);
+        } else {
+            ret = pread(s->fd, buf, n, off);
+        }
+        if (ret <= 0) {
+            perror("read");
+            return -1;
+        }
+        for (k = 0; k < ret; k += 64) {
+            s->sum += buf[k];
+        }
+        s->bytes += ret;
+        off += ret;
+    }
+    return 0;
+}
+
+static void *scan_work(void *arg)
+{
+    struct scanner *s = arg;
+    char *buf = malloc(s->len);
+    off_t off = s->start;
+
+    pin(s->cpu);
+    if (MODE_DATA != s->mode) {
+        scan_range(s, buf, s->start, s->end);
+        free(buf);
+        return NULL;
+    }
+
+    while (off < s->end) {
+        off_t data, hole;
+
+        pthread_mutex_lock(&pos_lock);
+        data = lseek(s->fd, off, SEEK_DATA);
+        hole = data < 0 ? -1 : lseek(s->fd, data, SEEK_HOLE);
+        pthread_mutex_unlock(&pos_lock);
+        if (data < 0 || data >= s->end) {   /*段内已没有数据*/
+            break;
+        }
+        if (hole > s->end) {
+            hole = s->end;
+        }
+        if (scan_range(s, buf, data, hole)) {
+            break;
+        }
+        off = hole;
+    }
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalmem_0";
+    size_t len = argc > 2 ? strtoul(argv[2], NULL, 0) : 65536;
+    const char *names[] = { "pread", "locked", "data" };
+    int counts[] = { 1, 2, 4, 8, 16 };
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    struct scanner s[MAX_THREADS];
+    off_t size;
+    unsigned int c;
+    int fd, mode, i;
+
+    fd = open(path, O_RDONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", path);
+        return 1;
+    }
+    size = lseek(fd, 0, SEEK_END);
+    if (size <= 0) {
+        perror("lseek");
+        return 1;
+    }
+
+    printf("globalmem parallel scan on %s, %lld B region, %zu B per read\n", path, (long long)size, len);
+    printf("%-7s %7s %12s %14s\n", "mode", "threads", "MB/s", "bytes read");
+    for (mode = MODE_PREAD; mode <= MODE_DATA; mode++) {
+        for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            int n = counts[c];
+            off_t slice = (size / n + 4095) & ~(off_t)4095;
+            unsigned long long bytes = 0;
+            double start, elapsed;
+
+            for (i = 0; i < n; i++) {
+                s[i].cpu = i % ncpu;
+                s[i].fd = fd;
+                s[i].mode = mode;
+                s[i].start = i * slice < size ? i * slice : size;
+                s[i].end = s[i].start + slice < size ? s[i].start + slice : size;
+                s[i].len = len;
+                s[i].bytes = 0;
+                s[i].sum = 0;
+            }
+
+            start = now_sec();
+            for (i = 0; i < n; i++) {
+                pthread_create(&s[i].tid, NULL, scan_work, &s[i]);
+            }
+            for (i = 0; i < n; i++) {
+                pthread_join(s[i].tid, NULL);
+                bytes += s[i].bytes;
+            }
+            elapsed = now_sec() - start;
+
+            printf("%-7s %7d %12.1f %14llu\n", names[mode], n, size / elapsed / 1e6, bytes);
+        }
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+
+/*
+ *globalmem稀疏区域测试: 密集写入与稀疏写入的内存占用和吞吐
+ *需要以较大的区域加载模块，例如: insmod globalmem.ko globalmem_size=0x100000000
+ *密集模式在第一个设备上从0开始连续写入n块，稀疏模式在第二个设备上把n块均匀地分散到整个区域，
+ *两者写入的数据量相同。每种模式输出写吞吐、设备实际占用的内存(sysfs中的resident_bytes)
+ *以及系统可用内存(/proc/meminfo中的MemAvailable)的减少量；
+ *最后在稀疏设备上读取写入块之间的空洞，空洞应读出全0，并且读取前后设备占用的内存不变。
+ *两个设备需是刚加载、尚未写入过的设备。
+ *
+ *用法: globalmem_sparse [密集设备] [稀疏设备] [区域大小] [块数] [块大小]
+ */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *设备实际占用的内存，从/sys/class/globalmem_class/<设备名>/stats/resident_bytes读取
+ */
+static long long resident(const char *dev)
+{
+    char path[256], name[64];
+    long long val = -1;
+    FILE *fp;
+
+    snprintf(name, sizeof(name), "%s", dev);
+    snprintf(path, sizeof(path), "/sys/class/globalmem_class/%s/stats/resident_bytes", basename(name));
+    fp = fopen(path, "r");
+    if (fp) {
+        if (fscanf(fp, "%lld", &val) != 1) {
+            val = -1;
+        }
+        fclose(fp);
+    }
+    return val;
+}
+
+static long long mem_available(void)
+{
+    char line[256];
+    long long kb = 0;
+    FILE *fp = fopen("/proc/meminfo", "r");
+
+    if (!fp) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return kb * 1024;
+}
+
+static int run(const char *name, const char *path, unsigned long long stride, unsigned long n, size_t bs)
+{
+    char *buf = malloc(bs);
+    long long res0, avail0;
+    unsigned long i;
+    double start, elapsed;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", path);
+        return -1;
+    }
+    memset(buf, 0x5a, bs);
+    res0 = resident(path);
+    avail0 = mem_available();
+
+    start = now_sec();
+    for (i = 0; i < n; i++) {
+        if (pwrite(fd, buf, bs, i * stride) != (ssize_t)bs) {
+            perror("pwrite");
+            close(fd);
+            free(buf);
+            return -1;
+        }
+    }
+    elapsed = now_sec() - start;
+
+    printf("%-7s %10llu %12.0f %10.1f %14lld %14lld\n", name, stride, n / elapsed, n * bs / elapsed / 1e6,
+           resident(path) - res0, avail0 - mem_available());
+    close(fd);
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dense = argc > 1 ? argv[1] : "/dev/globalmem_0";
+    const char *sparse = argc > 2 ? argv[2] : "/dev/globalmem_1";
+    unsigned long long size = argc > 3 ? strtoull(argv[3], NULL, 0) : 1ull << 32;
+    unsigned long n = argc > 4 ? strtoul(argv[4], NULL, 0) : 16384;
+    size_t bs = argc > 5 ? strtoul(argv[5], NULL, 0) : 4096;
+    unsigned long long stride = size / n & ~4095ull;
+    unsigned long long off, zeroes = 0, bytes = 0;
+    long long res0;
+    double start, elapsed;
+    char *buf;
+    int fd;
+
+    if (stride < bs) {
+        printf("region too small: %llu B for %lu blocks of %zu B\n", size, n, bs);
+        return 1;
+    }
+
+    printf("globalmem dense vs sparse writes, %lu blocks of %zu B, region %llu B\n", n, bs, size);
+    printf("%-7s %10s %12s %10s %14s %14s\n", "pattern", "stride", "writes/s", "MB/s", "resident(B)", "memused(B)");
+    if (run("dense", dense, bs, n, bs) || run("sparse", sparse, stride, n, bs)) {
+        return 1;
+    }
+
+    /*读取稀疏设备上各块之后的空洞，空洞不申请内存*/
+    fd = open(sparse, O_RDONLY);
+    if (-1 == fd) {
+        printf("open device file %s error.\n", sparse);
+        return 1;
+    }
+    buf = malloc(stride - bs);
+    res0 = resident(sparse);
+    start = now_sec();
+    for (off = 0; off + stride <= size; off += stride) {
+        ssize_t ret = pread(fd, buf, stride - bs, off + bs);
+        ssize_t k;
+
+        if (ret != (ssize_t)(stride - bs)) {
+            perror("pread");
+            return 1;
+        }
+        for (k = 0; k < ret; k++) {
+            zeroes += 0 == buf[k];
+        }
+        bytes += ret;
+    }
+    elapsed = now_sec() - start;
+    printf("hole reads: %llu B at %.1f MB/s, %llu non-zero bytes, resident grew by %lld B\n",
+           bytes, bytes / elapsed / 1e6, bytes - zeroes, resident(sparse) - res0);
+
+    free(buf);
+    close(fd);
+    return 0;
+}
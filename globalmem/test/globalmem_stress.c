@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ *多设备并发压力测试
+ *1..N个线程同时对设备做"写len字节、读len字节"的循环，分两种情况:
+ *  shared  : 所有线程访问同一个次设备(prefix0)，互斥体和数据所在的cache line在线程间来回传递
+ *  separate: 第i个线程访问第i个次设备(prefix<i>)，各设备之间互不干扰，理想情况下吞吐随线程数线性增长
+ *separate一列相对单线程的倍数即多设备扩展性，第i个线程绑定到第i个CPU上。
+ *globalmem使用pwrite/pread在偏移0处读写；globalfifo忽略偏移，先写后读同样长度，FIFO不会满也不会空，
+ *因此同一工具也可用于globalfifo: globalmem_stress /dev/globalfifo_
+ *
+ *用法: globalmem_stress [设备文件前缀] [最大线程数] [每轮秒数] [单次长度]
+ */
+
+#define MAX_THREADS     10      /*与驱动的DEVICE_NUM一致*/
+
+struct worker {
+    pthread_t tid;
+    int cpu;
+    int fd;
+    size_t len;
+    double seconds;
+    unsigned long long ops;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *work(void *arg)
+{
+    struct worker *w = arg;
+    char *buf = malloc(w->len);
+    double start, elapsed;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    memset(buf, 'm', w->len);
+    start = now_sec();
+    do {
+        int i;
+
+        for (i = 0; i < 1024; i++) {
+            if (pwrite(w->fd, buf, w->len, 0) != (ssize_t)w->len ||
+                pread(w->fd, buf, w->len, 0) != (ssize_t)w->len) {
+                perror("stress");
+                goto out;
+            }
+            w->ops += 2;
+        }
+        elapsed = now_sec() - start;
+    } while (elapsed < w->seconds);
+out:
+    free(buf);
+    return NULL;
+}
+
+/*
+ *返回所有线程合计的每秒操作数
+ */
+static double run(const char *prefix, int threads, int separate, double seconds, size_t len)
+{
+    struct worker w[MAX_THREADS];
+    unsigned long long ops = 0;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    char path[64];
+    double start, elapsed;
+    int i;
+
+    for (i = 0; i < threads; i++) {
+        snprintf(path, sizeof(path), "%s%d", prefix, separate ? i : 0);
+        w[i].fd = open(path, O_RDWR | O_NONBLOCK);
+        if (-1 == w[i].fd) {
+            printf("open device file %s error.\n", path);
+            exit(1);
+        }
+        w[i].cpu = i % ncpu;
+        w[i].len = len;
+        w[i].seconds = seconds;
+        w[i].ops = 0;
+    }
+
+    start = now_sec();
+    for (i = 0; i < threads; i++) {
+        pthread_create(&w[i].tid, NULL, work, &w[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(w[i].tid, NULL);
+        ops += w[i].ops;
+        close(w[i].fd);
+    }
+    elapsed = now_sec() - start;
+
+    return ops / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prefix = argc > 1 ? argv[1] : "/dev/globalmem_";
+    int max = argc > 2 ? atoi(argv[2]) : MAX_THREADS;
+    double seconds = argc > 3 ? atof(argv[3]) : 1.0;
+    size_t len = argc > 4 ? strtoul(argv[4], NULL, 0) : 64;
+    double base = 0;
+    int n;
+
+    if (max < 1 || max > MAX_THREADS) {
+        max = MAX_THREADS;
+    }
+
+    printf("multi-device stress on %s*, %zu B per op, %.1f s per run\n", prefix, len, seconds);
+    printf("threads %14s %14s %9s\n", "shared ops/s", "separate ops/s", "scaling");
+    for (n = 1; n <= max; n++) {
+        double shared = run(prefix, n, 0, seconds, len);
+        double separate = run(prefix, n, 1, seconds, len);
+
+        if (1 == n) {
+            base = separate;
+        }
+        printf("%7d %14.0f %14.0f %8.2fx\n", n, shared, separate, separate / base);
+    }
+
+    return 0;
+}
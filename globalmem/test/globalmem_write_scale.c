@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>      /*open等函数的头文件*/
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ *globalmem写扩展性测试
+ *1、2、4、8、16个线程同时对同一个次设备pwrite，两种偏移模式:
+ *  disjoint  第i个线程只写自己的区域(偏移i*单元大小)，落在不同的锁条带上，可以并行
+ *  overlap   所有线程都写偏移0，必须互斥
+ *输出合计写吞吐及相对单线程的倍数。overlap模式下每个线程写入整块相同的字节，
+ *结束后检查该区域仍然由同一字节组成(重叠的写入保持原子)。
+ *单元大小应不小于模块参数globalmem_stripe_size(默认一页)，区域至少为16个单元。
+ *
+ *用法: globalmem_write_scale [设备文件] [每轮秒数] [单次长度] [单元大小]
+ */
+
+#define MAX_THREADS     16
+
+struct writer {
+    pthread_t tid;
+    int cpu;
+    int fd;
+    off_t off;
+    size_t len;
+    double seconds;
+    unsigned long long ops;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *write_work(void *arg)
+{
+    struct writer *w = arg;
+    char *buf = malloc(w->len);
+    double start;
+
+    pin(w->cpu);
+    memset(buf, w->cpu + 1, w->len);
+    start = now_sec();
+    do {
+        int i;
+
+        for (i = 0; i < 256; i++) {
+            if (pwrite(w->fd, buf, w->len, w->off) != (ssize_t)w->len) {
+                perror("pwrite");
+                goto out;
+            }
+            w->ops++;
+        }
+    } while (now_sec() - start < w->seconds);
+out:
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/globalmem_0";
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    size_t len = argc > 3 ? strtoul(argv[3], NULL, 0) : 4096;
+    size_t unit = argc > 4 ? strtoul(argv[4], NULL, 0) : 4096;
+    const char *names[] = { "disjoint", "overlap" };
+    int counts[] = { 1, 2, 4, 8, 16 };
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    struct writer w[MAX_THREADS];
+    unsigned int c;
+    int mode, i;
+
+    if (len > unit) {
+        printf("write length %zu larger than unit %zu\n", len, unit);
+        return 1;
+    }
+
+    printf("globalmem write scaling on %s, %zu B per pwrite, %zu B unit, %.1f s per run\n",
+           path, len, unit, seconds);
+    printf("%-9s %7s %12s %10s %9s %6s\n", "pattern", "threads", "writes/s", "MB/s", "scaling", "torn");
+    for (mode = 0; mode < 2; mode++) {
+        double base = 0;
+
+        for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            int n = counts[c];
+            unsigned long long ops = 0;
+            double start, elapsed;
+            const char *torn = "-";
+
+            for (i = 0; i < n; i++) {
+                w[i].fd = open(path, O_WRONLY);
+                if (-1 == w[i].fd) {
+                    printf("open device file %s error.\n", path);
+                    return 1;
+                }
+                w[i].cpu = i % ncpu;
+                w[i].off = 0 == mode ? (off_t)i * unit : 0;
+                w[i].len = len;
+                w[i].seconds = seconds;
+                w[i].ops = 0;
+            }
+
+            start = now_sec();
+            for (i = 0; i < n; i++) {
+                pthread_create(&w[i].tid, NULL, write_work, &w[i]);
+            }
+            for (i = 0; i < n; i++) {
+                pthread_join(w[i].tid, NULL);
+                ops += w[i].ops;
+                close(w[i].fd);
+            }
+            elapsed = now_sec() - start;
+
+            if (1 == mode) {    /*检查最后留下的是某一个写者的完整数据*/
+                char *buf = malloc(len);
+                int fd = open(path, O_RDONLY);
+                size_t k;
+
+                torn = "no";
+                if (-1 == fd || pread(fd, buf, len, 0) != (ssize_t)len) {
+                    torn = "?";
+                }
+                for (k = 1; k < len && '?' != torn[0]; k++) {
+                    if (buf[k] != buf[0]) {
+                        torn = "yes";
+                        break;
+                    }
+                }
+                if (-1 != fd) {
+                    close(fd);
+                }
+                free(buf);
+            }
+
+            if (1 == n) {
+                base = ops / elapsed;
+            }
+            printf("%-9s %7d %12.0f %10.1f %8.2fx %6s\n", names[mode], n, ops / elapsed,
+                   ops * len / elapsed / 1e6, ops / elapsed / base, torn);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+#include "../../kshim.h"
+
+/*
+ *跟踪点在用户态没有意义，每个事件展开为一个空的内联函数
+ */
+#ifndef _KSHIM_TRACEPOINT_H
+#define _KSHIM_TRACEPOINT_H
+
+#define TP_PROTO(args...)       args
+#define TP_ARGS(args...)        args
+#define DECLARE_EVENT_CLASS(...)
+#define DEFINE_EVENT(template, name, proto, args)           static inline void trace_##name(proto) { }
+#define TRACE_EVENT(name, proto, args, struct, assign, print) static inline void trace_##name(proto) { }
+
+#endif /* _KSHIM_TRACEPOINT_H */
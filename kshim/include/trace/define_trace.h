@@ -0,0 +1,3 @@
+/*
+ *跟踪点全部为空函数，不需要再次展开事件定义
+ */
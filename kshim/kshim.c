@@ -0,0 +1,1391 @@
+/*
+ * kshim: a user space stand-in for the parts of the kernel API used by
+ * globalfifo, globalmem and second
+ *
+ * Licensed under GPLv2 or later
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include "kshim.h"
+
+struct module { int dummy; } __this_module;
+
+int printk(const char *fmt, ...)
+{
+    static int enabled = -1;
+    va_list ap;
+    int ret;
+
+    if (-1 == enabled) {
+        enabled = NULL != getenv("KSHIM_PRINTK");
+    }
+    if (!enabled) {
+        return 0;
+    }
+    va_start(ap, fmt);
+    ret = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+/*
+ *内存分配
+ *kmalloc系列按缓存行对齐，便于驱动中____cacheline_aligned的成员在ASan下不报未对齐访问
+ */
+static void *kshim_alloc(size_t size, size_t align, int zero)
+{
+    void *p;
+
+    if (posix_memalign(&p, align, size ? size : 1)) {
+        return NULL;
+    }
+    if (zero) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void *kmalloc(size_t size, gfp_t flags)
+{
+    return kshim_alloc(size, SMP_CACHE_BYTES, flags & __GFP_ZERO);
+}
+
+void *kzalloc(size_t size, gfp_t flags)
+{
+    return kshim_alloc(size, SMP_CACHE_BYTES, 1);
+}
+
+void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+    if (size && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    return kshim_alloc(n * size, SMP_CACHE_BYTES, 1);
+}
+
+void *kzalloc_node(size_t size, gfp_t flags, int node)
+{
+    return kzalloc(size, flags);
+}
+
+void kfree(const void *p)
+{
+    free((void *)p);
+}
+
+void *vmalloc_user(unsigned long size)
+{
+    return kshim_alloc(PAGE_ALIGN(size), PAGE_SIZE, 1);
+}
+
+void vfree(const void *p)
+{
+    free((void *)p);
+}
+
+void *kvmalloc_array(size_t n, size_t size, gfp_t flags)
+{
+    if (size && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    return kshim_alloc(n * size, SMP_CACHE_BYTES, flags & __GFP_ZERO);
+}
+
+void kvfree(const void *p)
+{
+    free((void *)p);
+}
+
+/*
+ *物理页: struct page数组与页内存一起分配，page_to_pfn返回内存地址的页号
+ */
+struct page *alloc_pages_node(int node, gfp_t flags, unsigned int order)
+{
+    unsigned long i, n = 1UL << order;
+    struct page *page = calloc(n, sizeof(*page));
+    char *mem = kshim_alloc(PAGE_SIZE << order, PAGE_SIZE, flags & __GFP_ZERO);
+
+    if (!page || !mem) {
+        free(page);
+        free(mem);
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        page[i].addr = mem + i * PAGE_SIZE;
+    }
+    return page;
+}
+
+void __free_pages(struct page *page, unsigned int order)
+{
+    if (page) {
+        free(page->addr);
+        free(page);
+    }
+}
+
+void *page_address(const struct page *page)
+{
+    return page->addr;
+}
+
+unsigned long page_to_pfn(struct page *page)
+{
+    return (unsigned long)page->addr >> PAGE_SHIFT;
+}
+
+int roundup_pow_of_two_fn(unsigned long n)
+{
+    return n <= 1 ? 1 : 1UL << (64 - __builtin_clzl(n - 1));
+}
+
+/*
+ *CPU与per-cpu变量
+ */
+static int kshim_next_cpu;
+static __thread int kshim_cpu = -1;
+
+int smp_processor_id(void)
+{
+    if (kshim_cpu < 0) {
+        kshim_cpu = __atomic_fetch_add(&kshim_next_cpu, 1, __ATOMIC_RELAXED) % KSHIM_NR_CPUS;
+    }
+    return kshim_cpu;
+}
+
+unsigned int cpumask_local_spread(unsigned int i, int node)
+{
+    return i % KSHIM_NR_CPUS;
+}
+
+/*
+ *在调用者的线程中执行func，执行期间smp_processor_id()返回cpu，
+ *这样func中启动的定时器会记下这个CPU，处理函数也在该CPU号下运行
+ */
+int smp_call_function_single(int cpu, void (*func)(void *), void *info, int wait)
+{
+    int old = smp_processor_id();
+
+    if (!cpu_online(cpu)) {
+        return -ENXIO;
+    }
+    kshim_cpu = cpu;
+    func(info);
+    kshim_cpu = old;
+    return 0;
+}
+
+void *__alloc_percpu(size_t size, size_t align)
+{
+    if (size > KSHIM_PERCPU_UNIT || align > KSHIM_PERCPU_UNIT) {
+        fprintf(stderr, "kshim: per-cpu object of %zu bytes exceeds KSHIM_PERCPU_UNIT\n", size);
+        return NULL;
+    }
+    return kshim_alloc(KSHIM_PERCPU_UNIT * KSHIM_NR_CPUS, SMP_CACHE_BYTES, 1);
+}
+
+void free_percpu(void *p)
+{
+    free(p);
+}
+
+/*
+ *用户空间访问
+ */
+unsigned long copy_to_user(void __user *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+unsigned long copy_from_user(void *to, const void __user *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+unsigned long clear_user(void __user *to, unsigned long n)
+{
+    memset(to, 0, n);
+    return 0;
+}
+
+/*
+ *锁
+ */
+void mutex_init(struct mutex *lock)
+{
+    pthread_mutex_init(&lock->m, NULL);
+}
+
+void mutex_destroy(struct mutex *lock)
+{
+    pthread_mutex_destroy(&lock->m);
+}
+
+void mutex_lock(struct mutex *lock)
+{
+    pthread_mutex_lock(&lock->m);
+}
+
+int mutex_lock_interruptible(struct mutex *lock)
+{
+    pthread_mutex_lock(&lock->m);
+    return 0;
+}
+
+int mutex_trylock(struct mutex *lock)
+{
+    return 0 == pthread_mutex_trylock(&lock->m);
+}
+
+void mutex_unlock(struct mutex *lock)
+{
+    pthread_mutex_unlock(&lock->m);
+}
+
+void spin_lock_init(spinlock_t *lock)
+{
+    pthread_mutex_init(&lock->m, NULL);
+}
+
+void spin_lock(spinlock_t *lock)
+{
+    pthread_mutex_lock(&lock->m);
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+    pthread_mutex_unlock(&lock->m);
+}
+
+/*
+ *顺序计数: 读者读到的数据可能正在被改写，这是seqcount的本意，用户态用__atomic访问计数本身
+ */
+unsigned int read_seqcount_begin(const seqcount_t *s)
+{
+    unsigned int seq;
+
+    while ((seq = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        sched_yield();
+    }
+    return seq;
+}
+
+int read_seqcount_retry(const seqcount_t *s, unsigned int start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->sequence, __ATOMIC_RELAXED) != start;
+}
+
+void write_seqcount_begin(seqcount_t *s)
+{
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void write_seqcount_end(seqcount_t *s)
+{
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ *RCU: 读侧临界区持有全局读写锁的读锁，synchronize_rcu拿到写锁时之前进入的读者都已离开；
+ *读侧临界区里不能睡眠，所以读锁不会被长时间持有
+ */
+static pthread_rwlock_t kshim_rcu_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void rcu_read_lock(void)
+{
+    pthread_rwlock_rdlock(&kshim_rcu_lock);
+}
+
+void rcu_read_unlock(void)
+{
+    pthread_rwlock_unlock(&kshim_rcu_lock);
+}
+
+void synchronize_rcu(void)
+{
+    pthread_rwlock_wrlock(&kshim_rcu_lock);
+    pthread_rwlock_unlock(&kshim_rcu_lock);
+}
+
+/*
+ *链表: 与内核一样用WRITE_ONCE/READ_ONCE访问next，waitqueue_active可以不加锁检查队列是否为空
+ */
+#define kshim_set_next(p, n)    __atomic_store_n(&(p)->next, (n), __ATOMIC_RELAXED)
+
+void INIT_LIST_HEAD(struct list_head *list)
+{
+    kshim_set_next(list, list);
+    list->prev = list;
+}
+
+void list_add(struct list_head *entry, struct list_head *head)
+{
+    struct list_head *next = head->next;
+
+    next->prev = entry;
+    entry->next = next;
+    entry->prev = head;
+    kshim_set_next(head, entry);
+}
+
+void list_add_tail(struct list_head *entry, struct list_head *head)
+{
+    struct list_head *prev = head->prev;
+
+    head->prev = entry;
+    entry->next = head;
+    entry->prev = prev;
+    kshim_set_next(prev, entry);
+}
+
+void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    kshim_set_next(entry->prev, entry->next);
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+int list_empty(const struct list_head *head)
+{
+    return __atomic_load_n(&head->next, __ATOMIC_RELAXED) == head;
+}
+
+int list_is_singular(const struct list_head *head)
+{
+    return !list_empty(head) && head->next == head->prev;
+}
+
+/*
+ *调度
+ *每个线程有一个task_struct，state用原子操作访问；schedule()在线程自己的条件变量上等到state变回TASK_RUNNING
+ */
+static __thread struct task_struct *kshim_task;
+static int kshim_next_pid = 1;
+static pthread_key_t kshim_task_key;
+static pthread_once_t kshim_task_once = PTHREAD_ONCE_INIT;
+
+static void kshim_task_free(void *p)
+{
+    struct task_struct *task = p;
+
+    pthread_cond_destroy(&task->cond);
+    pthread_mutex_destroy(&task->lock);
+    free(task);
+}
+
+static void kshim_task_key_init(void)
+{
+    pthread_key_create(&kshim_task_key, kshim_task_free);
+}
+
+/*
+ *线程第一次进入驱动时创建task_struct，线程退出时释放
+ */
+unsigned long long kshim_caps = ~0ULL;
+
+struct task_struct *kshim_current(void)
+{
+    if (!kshim_task) {
+        kshim_task = calloc(1, sizeof(*kshim_task));
+        kshim_task->pid = __atomic_fetch_add(&kshim_next_pid, 1, __ATOMIC_RELAXED);
+        pthread_mutex_init(&kshim_task->lock, NULL);
+        pthread_cond_init(&kshim_task->cond, NULL);
+        pthread_once(&kshim_task_once, kshim_task_key_init);
+        pthread_setspecific(kshim_task_key, kshim_task);
+    }
+    return kshim_task;
+}
+
+static int kshim_wake_task(struct task_struct *task)
+{
+    int woken;
+
+    pthread_mutex_lock(&task->lock);
+    woken = TASK_RUNNING != __atomic_load_n(&task->state, __ATOMIC_RELAXED);
+    __atomic_store_n(&task->state, TASK_RUNNING, __ATOMIC_RELAXED);
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return woken;
+}
+
+void __set_current_state(int state)
+{
+    __atomic_store_n(&current->state, state, __ATOMIC_RELAXED);
+}
+
+void set_current_state(int state)
+{
+    __atomic_store_n(&current->state, state, __ATOMIC_SEQ_CST);
+}
+
+void schedule(void)
+{
+    struct task_struct *task = current;
+
+    pthread_mutex_lock(&task->lock);
+    while (TASK_RUNNING != __atomic_load_n(&task->state, __ATOMIC_RELAXED)) {
+        pthread_cond_wait(&task->cond, &task->lock);
+    }
+    pthread_mutex_unlock(&task->lock);
+}
+
+void cond_resched(void)
+{
+    sched_yield();
+}
+
+/*
+ *等待队列
+ *等待项的entry.next为NULL表示不在队列上，prepare_to_wait与finish_wait可以重复调用
+ */
+int default_wake_function(struct wait_queue_entry *entry, unsigned int mode, int flags, void *key)
+{
+    return kshim_wake_task(entry->private);
+}
+
+void init_waitqueue_head(wait_queue_head_t *wq)
+{
+    spin_lock_init(&wq->lock);
+    INIT_LIST_HEAD(&wq->head);
+}
+
+void add_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *entry)
+{
+    spin_lock(&wq->lock);
+    list_add_tail(&entry->entry, &wq->head);
+    spin_unlock(&wq->lock);
+}
+
+void remove_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *entry)
+{
+    spin_lock(&wq->lock);
+    list_del(&entry->entry);
+    spin_unlock(&wq->lock);
+}
+
+void prepare_to_wait(wait_queue_head_t *wq, wait_queue_entry_t *entry, int state)
+{
+    spin_lock(&wq->lock);
+    if (!entry->entry.next) {
+        list_add_tail(&entry->entry, &wq->head);
+    }
+    set_current_state(state);
+    spin_unlock(&wq->lock);
+}
+
+void finish_wait(wait_queue_head_t *wq, wait_queue_entry_t *entry)
+{
+    __set_current_state(TASK_RUNNING);
+    spin_lock(&wq->lock);
+    if (entry->entry.next) {
+        list_del(&entry->entry);
+    }
+    spin_unlock(&wq->lock);
+}
+
+void __wake_up(wait_queue_head_t *wq, void *key)
+{
+    struct list_head *p, *next;
+
+    spin_lock(&wq->lock);
+    for (p = wq->head.next; p != &wq->head; p = next) {
+        wait_queue_entry_t *entry = list_entry(p, wait_queue_entry_t, entry);
+
+        next = p->next;
+        entry->func(entry, TASK_INTERRUPTIBLE, 0, key);
+    }
+    spin_unlock(&wq->lock);
+}
+
+/*
+ *无锁检查队列是否为空，与内核一样可能看到旧值，由调用者的内存屏障保证不丢唤醒
+ */
+bool waitqueue_active(wait_queue_head_t *wq)
+{
+    return !list_empty(&wq->head);
+}
+
+bool wq_has_sleeper(wait_queue_head_t *wq)
+{
+    smp_mb();
+    return waitqueue_active(wq);
+}
+
+/*
+ *位操作与按位等待，所有按位等待共用一个条件变量
+ */
+static pthread_mutex_t kshim_bit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kshim_bit_cond = PTHREAD_COND_INITIALIZER;
+
+void set_bit(long nr, volatile unsigned long *addr)
+{
+    __atomic_fetch_or(addr + nr / BITS_PER_LONG, 1UL << (nr % BITS_PER_LONG), __ATOMIC_SEQ_CST);
+}
+
+void clear_bit(long nr, volatile unsigned long *addr)
+{
+    __atomic_fetch_and(addr + nr / BITS_PER_LONG, ~(1UL << (nr % BITS_PER_LONG)), __ATOMIC_SEQ_CST);
+}
+
+int test_bit(long nr, const volatile unsigned long *addr)
+{
+    return (__atomic_load_n(addr + nr / BITS_PER_LONG, __ATOMIC_ACQUIRE) >> (nr % BITS_PER_LONG)) & 1;
+}
+
+int test_and_set_bit(long nr, volatile unsigned long *addr)
+{
+    unsigned long mask = 1UL << (nr % BITS_PER_LONG);
+
+    return !!(__atomic_fetch_or(addr + nr / BITS_PER_LONG, mask, __ATOMIC_SEQ_CST) & mask);
+}
+
+int test_and_clear_bit(long nr, volatile unsigned long *addr)
+{
+    unsigned long mask = 1UL << (nr % BITS_PER_LONG);
+
+    return !!(__atomic_fetch_and(addr + nr / BITS_PER_LONG, ~mask, __ATOMIC_SEQ_CST) & mask);
+}
+
+unsigned long find_next_bit(const unsigned long *addr, unsigned long size, unsigned long offset)
+{
+    for (; offset < size; offset++) {
+        if (test_bit(offset, addr)) {
+            break;
+        }
+    }
+    return offset < size ? offset : size;
+}
+
+int wait_on_bit(unsigned long *word, int bit, unsigned int mode)
+{
+    pthread_mutex_lock(&kshim_bit_lock);
+    while (test_bit(bit, word)) {
+        pthread_cond_wait(&kshim_bit_cond, &kshim_bit_lock);
+    }
+    pthread_mutex_unlock(&kshim_bit_lock);
+    return 0;
+}
+
+int wait_on_bit_lock(unsigned long *word, int bit, unsigned int mode)
+{
+    while (test_and_set_bit(bit, word)) {
+        wait_on_bit(word, bit, mode);
+    }
+    return 0;
+}
+
+void wake_up_bit(void *word, int bit)
+{
+    pthread_mutex_lock(&kshim_bit_lock);
+    pthread_cond_broadcast(&kshim_bit_cond);
+    pthread_mutex_unlock(&kshim_bit_lock);
+}
+
+/*
+ *高精度定时器
+ *定时器线程在第一次hrtimer_start时创建，每次取出最早到期的定时器，放开锁后调用处理函数；
+ *hrtimer_cancel等到处理函数返回后才返回，与内核一样不能在处理函数内对自身调用
+ */
+#define KSHIM_MAX_TIMERS        1024
+
+static struct hrtimer *kshim_timers[KSHIM_MAX_TIMERS];
+static int kshim_timer_cpu[KSHIM_MAX_TIMERS];
+static int kshim_ntimers;
+static struct hrtimer *kshim_running_timer;
+static pthread_mutex_t kshim_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kshim_timer_cond;
+static pthread_t kshim_timer_thread;
+static int kshim_timer_started;
+
+u64 ktime_get_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int kshim_timer_slot(const struct hrtimer *timer)
+{
+    int i;
+
+    for (i = 0; i < kshim_ntimers; i++) {
+        if (kshim_timers[i] == timer) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void *kshim_timer_fn(void *arg)
+{
+    pthread_mutex_lock(&kshim_timer_lock);
+    for (;;) {
+        struct hrtimer *timer = NULL;
+        struct timespec ts;
+        int i, slot = -1;
+
+        for (i = 0; i < kshim_ntimers; i++) {
+            if (kshim_timers[i]->queued && (!timer || kshim_timers[i]->expires < timer->expires)) {
+                timer = kshim_timers[i];
+                slot = i;
+            }
+        }
+        if (!timer) {
+            pthread_cond_wait(&kshim_timer_cond, &kshim_timer_lock);
+            continue;
+        }
+        if (timer->expires > (ktime_t)ktime_get_ns()) {
+            ts.tv_sec = timer->expires / NSEC_PER_SEC;
+            ts.tv_nsec = timer->expires % NSEC_PER_SEC;
+            pthread_cond_timedwait(&kshim_timer_cond, &kshim_timer_lock, &ts);
+            continue;
+        }
+
+        timer->queued = 0;
+        kshim_running_timer = timer;
+        kshim_cpu = kshim_timer_cpu[slot];
+        pthread_mutex_unlock(&kshim_timer_lock);
+        i = timer->function(timer);
+        pthread_mutex_lock(&kshim_timer_lock);
+        if (HRTIMER_RESTART == i) {
+            timer->queued = 1;
+        }
+        kshim_running_timer = NULL;
+        pthread_cond_broadcast(&kshim_timer_cond);
+    }
+    return NULL;
+}
+
+void hrtimer_init(struct hrtimer *timer, int clock, enum hrtimer_mode mode)
+{
+    memset(timer, 0, sizeof(*timer));
+}
+
+void hrtimer_start(struct hrtimer *timer, ktime_t tim, enum hrtimer_mode mode)
+{
+    int slot;
+
+    pthread_mutex_lock(&kshim_timer_lock);
+    if (!kshim_timer_started) {
+        pthread_condattr_t attr;
+
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&kshim_timer_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_create(&kshim_timer_thread, NULL, kshim_timer_fn, NULL);
+        kshim_timer_started = 1;
+    }
+    slot = kshim_timer_slot(timer);
+    if (slot < 0) {
+        if (kshim_ntimers >= KSHIM_MAX_TIMERS) {
+            fprintf(stderr, "kshim: more than %d hrtimers\n", KSHIM_MAX_TIMERS);
+            abort();
+        }
+        slot = kshim_ntimers++;
+        kshim_timers[slot] = timer;
+        timer->registered = 1;
+    }
+    kshim_timer_cpu[slot] = smp_processor_id();
+    timer->expires = (mode & HRTIMER_MODE_REL) ? (ktime_t)ktime_get_ns() + tim : tim;
+    timer->queued = 1;
+    pthread_cond_broadcast(&kshim_timer_cond);
+    pthread_mutex_unlock(&kshim_timer_lock);
+}
+
+/*
+ *取消后把定时器从表中移走，驱动随后释放定时器所在的结构时定时器线程不会再访问它
+ */
+int hrtimer_cancel(struct hrtimer *timer)
+{
+    int was, slot;
+
+    pthread_mutex_lock(&kshim_timer_lock);
+    while (kshim_running_timer == timer) {
+        pthread_cond_wait(&kshim_timer_cond, &kshim_timer_lock);
+    }
+    was = timer->queued;
+    timer->queued = 0;
+    slot = kshim_timer_slot(timer);
+    if (slot >= 0) {
+        kshim_ntimers--;
+        kshim_timers[slot] = kshim_timers[kshim_ntimers];
+        kshim_timer_cpu[slot] = kshim_timer_cpu[kshim_ntimers];
+        timer->registered = 0;
+    }
+    pthread_mutex_unlock(&kshim_timer_lock);
+    return was;
+}
+
+bool hrtimer_active(const struct hrtimer *timer)
+{
+    bool active;
+
+    pthread_mutex_lock(&kshim_timer_lock);
+    active = timer->queued || kshim_running_timer == timer;
+    pthread_mutex_unlock(&kshim_timer_lock);
+    return active;
+}
+
+/*
+ *只在处理函数中或定时器未排队时调用，不需要加锁
+ */
+u64 hrtimer_forward(struct hrtimer *timer, ktime_t now, ktime_t interval)
+{
+    u64 n;
+
+    if (now < timer->expires) {
+        return 0;
+    }
+    n = (now - timer->expires) / interval + 1;
+    timer->expires += n * interval;
+    return n;
+}
+
+/*
+ *iov_iter: 只支持iovec，用户地址即进程内地址
+ */
+void iov_iter_init(struct iov_iter *i, int dir, const struct iovec *iov, unsigned long nr_segs, size_t count)
+{
+    i->type = dir;
+    i->iov = iov;
+    i->nr_segs = nr_segs;
+    i->iov_offset = 0;
+    i->count = count;
+}
+
+static size_t kshim_iter_copy(struct iov_iter *i, void *kbuf, size_t bytes, int to_user)
+{
+    size_t done = 0;
+
+    while (done < bytes && i->count) {
+        size_t seg = i->iov->iov_len - i->iov_offset, n;
+        char *ubuf = (char *)i->iov->iov_base + i->iov_offset;
+
+        if (!seg) {
+            i->iov++;
+            i->nr_segs--;
+            i->iov_offset = 0;
+            continue;
+        }
+        n = min3(seg, bytes - done, i->count);
+        if (kbuf) {
+            if (to_user) {
+                memcpy(ubuf, (char *)kbuf + done, n);
+            } else {
+                memcpy((char *)kbuf + done, ubuf, n);
+            }
+        } else if (to_user) {
+            memset(ubuf, 0, n);
+        }
+        i->iov_offset += n;
+        i->count -= n;
+        done += n;
+    }
+    return done;
+}
+
+size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
+{
+    return kshim_iter_copy(i, (void *)addr, bytes, 1);
+}
+
+size_t copy_from_iter(void *addr, size_t bytes, struct iov_iter *i)
+{
+    return kshim_iter_copy(i, addr, bytes, 0);
+}
+
+bool copy_from_iter_full(void *addr, size_t bytes, struct iov_iter *i)
+{
+    if (i->count < bytes) {
+        return false;
+    }
+    return kshim_iter_copy(i, addr, bytes, 0) == bytes;
+}
+
+size_t iov_iter_zero(size_t bytes, struct iov_iter *i)
+{
+    return kshim_iter_copy(i, NULL, bytes, 1);
+}
+
+void iov_iter_advance(struct iov_iter *i, size_t bytes)
+{
+    kshim_iter_copy(i, NULL, bytes, 0);
+}
+
+void iov_iter_revert(struct iov_iter *i, size_t bytes)
+{
+    i->count += bytes;
+    while (bytes) {
+        if (i->iov_offset >= bytes) {
+            i->iov_offset -= bytes;
+            return;
+        }
+        bytes -= i->iov_offset;
+        i->iov--;
+        i->nr_segs++;
+        i->iov_offset = i->iov->iov_len;
+    }
+}
+
+/*
+ *poll与异步通知: poll_wait不登记等待，kshim_poll只返回一次当前状态
+ */
+void poll_wait(struct file *filp, wait_queue_head_t *wq, poll_table *p)
+{
+}
+
+int fasync_helper(int fd, struct file *filp, int on, struct fasync_struct **fapp)
+{
+    return 0;
+}
+
+void kill_fasync(struct fasync_struct **fp, int sig, int band)
+{
+}
+
+/*
+ *没有管道，splice只提供符号
+ */
+ssize_t generic_file_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe, size_t len, unsigned int flags)
+{
+    return -EINVAL;
+}
+
+ssize_t iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out, loff_t *ppos, size_t len, unsigned int flags)
+{
+    return -EINVAL;
+}
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr, unsigned long pgoff)
+{
+    return 0;
+}
+
+vm_fault_t vmf_insert_pfn(struct vm_area_struct *vma, unsigned long addr, unsigned long pfn)
+{
+    return VM_FAULT_NOPAGE;
+}
+
+/*
+ *字符设备与设备类
+ *cdev_add登记的设备号范围供kshim_open查找；device_create记下drvdata和属性组，供kshim_show读取sysfs属性
+ */
+#define KSHIM_MAX_CDEVS         64
+#define KSHIM_MAX_DEVICES       512
+
+struct class {
+    const char *name;
+};
+
+struct device {
+    dev_t devt;
+    void *drvdata;
+    const struct attribute_group **groups;
+};
+
+static struct cdev *kshim_cdevs[KSHIM_MAX_CDEVS];
+static struct device *kshim_devices[KSHIM_MAX_DEVICES];
+static pthread_mutex_t kshim_dev_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void cdev_init(struct cdev *cdev, const struct file_operations *fops)
+{
+    memset(cdev, 0, sizeof(*cdev));
+    cdev->ops = fops;
+}
+
+int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count)
+{
+    int i, ret = -ENOMEM;
+
+    cdev->dev = dev;
+    cdev->count = count;
+    pthread_mutex_lock(&kshim_dev_lock);
+    for (i = 0; i < KSHIM_MAX_CDEVS; i++) {
+        if (!kshim_cdevs[i]) {
+            kshim_cdevs[i] = cdev;
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kshim_dev_lock);
+    return ret;
+}
+
+void cdev_del(struct cdev *cdev)
+{
+    int i;
+
+    pthread_mutex_lock(&kshim_dev_lock);
+    for (i = 0; i < KSHIM_MAX_CDEVS; i++) {
+        if (kshim_cdevs[i] == cdev) {
+            kshim_cdevs[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&kshim_dev_lock);
+}
+
+int register_chrdev_region(dev_t from, unsigned int count, const char *name)
+{
+    return 0;
+}
+
+int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name)
+{
+    static int next_major = 240;
+
+    *dev = MKDEV(__atomic_fetch_add(&next_major, 1, __ATOMIC_RELAXED), baseminor);
+    return 0;
+}
+
+void unregister_chrdev_region(dev_t from, unsigned int count)
+{
+}
+
+struct class *class_create(struct module *owner, const char *name)
+{
+    struct class *cls = calloc(1, sizeof(*cls));
+
+    if (!cls) {
+        return ERR_PTR(-ENOMEM);
+    }
+    cls->name = name;
+    return cls;
+}
+
+void class_destroy(struct class *cls)
+{
+    free(cls);
+}
+
+struct device *device_create_with_groups(struct class *cls, struct device *parent, dev_t devt, void *drvdata,
+                                         const struct attribute_group **groups, const char *fmt, ...)
+{
+    struct device *dev = calloc(1, sizeof(*dev));
+    int i;
+
+    if (!dev) {
+        return ERR_PTR(-ENOMEM);
+    }
+    dev->devt = devt;
+    dev->drvdata = drvdata;
+    dev->groups = groups;
+    pthread_mutex_lock(&kshim_dev_lock);
+    for (i = 0; i < KSHIM_MAX_DEVICES; i++) {
+        if (!kshim_devices[i]) {
+            kshim_devices[i] = dev;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kshim_dev_lock);
+    if (KSHIM_MAX_DEVICES == i) {
+        free(dev);
+        return ERR_PTR(-ENOMEM);
+    }
+    return dev;
+}
+
+struct device *device_create(struct class *cls, struct device *parent, dev_t devt, void *drvdata,
+                             const char *fmt, ...)
+{
+    return device_create_with_groups(cls, parent, devt, drvdata, NULL, "");
+}
+
+void device_destroy(struct class *cls, dev_t devt)
+{
+    int i;
+
+    pthread_mutex_lock(&kshim_dev_lock);
+    for (i = 0; i < KSHIM_MAX_DEVICES; i++) {
+        if (kshim_devices[i] && kshim_devices[i]->devt == devt) {
+            free(kshim_devices[i]);
+            kshim_devices[i] = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kshim_dev_lock);
+}
+
+void *dev_get_drvdata(const struct device *dev)
+{
+    return dev->drvdata;
+}
+
+/*
+ *测试程序使用的接口
+ */
+struct device *kshim_find_device(dev_t dev)
+{
+    struct device *found = NULL;
+    int i;
+
+    pthread_mutex_lock(&kshim_dev_lock);
+    for (i = 0; i < KSHIM_MAX_DEVICES; i++) {
+        if (kshim_devices[i] && kshim_devices[i]->devt == dev) {
+            found = kshim_devices[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kshim_dev_lock);
+    return found;
+}
+
+/*
+ *读取设备属性，相当于cat /sys/class/<class>/<device>/<group>/<name>，group为NULL表示不在子目录中
+ */
+ssize_t kshim_show(dev_t devt, const char *group, const char *name, char *buf)
+{
+    struct device *dev = kshim_find_device(devt);
+    const struct attribute_group **g;
+    struct attribute **a;
+
+    if (!dev || !dev->groups) {
+        return -ENODEV;
+    }
+    for (g = dev->groups; *g; g++) {
+        if ((*g)->name != group && (!group || !(*g)->name || strcmp((*g)->name, group))) {
+            continue;
+        }
+        for (a = (*g)->attrs; *a; a++) {
+            if (!strcmp((*a)->name, name)) {
+                struct device_attribute *attr = container_of(*a, struct device_attribute, attr);
+
+                return attr->show(dev, attr, buf);
+            }
+        }
+    }
+    return -ENOENT;
+}
+
+static struct cdev *kshim_find_cdev(dev_t dev)
+{
+    struct cdev *found = NULL;
+    int i;
+
+    pthread_mutex_lock(&kshim_dev_lock);
+    for (i = 0; i < KSHIM_MAX_CDEVS; i++) {
+        struct cdev *cdev = kshim_cdevs[i];
+
+        if (cdev && dev >= cdev->dev && dev < cdev->dev + cdev->count) {
+            found = cdev;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kshim_dev_lock);
+    return found;
+}
+
+/*
+ *打开设备，失败时返回ERR_PTR
+ */
+struct file *kshim_open(dev_t dev, unsigned int flags)
+{
+    struct cdev *cdev = kshim_find_cdev(dev);
+    struct inode *inode;
+    struct file *filp;
+    int ret;
+
+    if (!cdev) {
+        return ERR_PTR(-ENXIO);
+    }
+    inode = calloc(1, sizeof(*inode));
+    filp = calloc(1, sizeof(*filp));
+    if (!inode || !filp) {
+        free(inode);
+        free(filp);
+        return ERR_PTR(-ENOMEM);
+    }
+    inode->i_cdev = cdev;
+    inode->i_rdev = dev;
+    filp->f_inode = inode;
+    filp->f_op = cdev->ops;
+    filp->f_flags = flags;
+    switch (flags & O_ACCMODE) {
+    case O_RDONLY:
+        filp->f_mode = FMODE_READ;
+        break;
+    case O_WRONLY:
+        filp->f_mode = FMODE_WRITE;
+        break;
+    default:
+        filp->f_mode = FMODE_READ | FMODE_WRITE;
+        break;
+    }
+    if (filp->f_op->open) {
+        ret = filp->f_op->open(inode, filp);
+        if (ret) {
+            free(inode);
+            free(filp);
+            return ERR_PTR(ret);
+        }
+    }
+    return filp;
+}
+
+int kshim_close(struct file *filp)
+{
+    int ret = 0;
+
+    if (filp->f_op->release) {
+        ret = filp->f_op->release(filp->f_inode, filp);
+    }
+    free(filp->f_inode);
+    free(filp);
+    return ret;
+}
+
+/*
+ *读写按VFS的规则选择read/write或read_iter/write_iter，pos为NULL时使用并更新f_pos
+ *ki_flags为IOCB_*，IOCB_NOWAIT只能用于open时设置了FMODE_NOWAIT的文件，与preadv2的RWF_NOWAIT一致
+ */
+static ssize_t kshim_rw_iter(struct file *filp, int dir, const struct iovec *iov, int iovcnt, loff_t *pos, int ki_flags)
+{
+    struct kiocb iocb = { filp, pos ? *pos : filp->f_pos, ki_flags };
+    struct iov_iter iter;
+    size_t count = 0;
+    ssize_t ret;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+    if ((ki_flags & IOCB_NOWAIT) && !(filp->f_mode & FMODE_NOWAIT)) {
+        return -EOPNOTSUPP;
+    }
+    iov_iter_init(&iter, dir, iov, iovcnt, count);
+    if (READ == dir) {
+        if (!filp->f_op->read_iter) {
+            return -EINVAL;
+        }
+        ret = filp->f_op->read_iter(&iocb, &iter);
+    } else {
+        if (!filp->f_op->write_iter) {
+            return -EINVAL;
+        }
+        ret = filp->f_op->write_iter(&iocb, &iter);
+    }
+    if (ret >= 0) {
+        *(pos ? pos : &filp->f_pos) = iocb.ki_pos;
+    }
+    return ret;
+}
+
+static ssize_t kshim_rw(struct file *filp, int dir, void *buf, size_t count, loff_t *pos)
+{
+    struct iovec iov = { buf, count };
+    loff_t *ppos = pos ? pos : &filp->f_pos;
+
+    if (READ == dir && filp->f_op->read) {
+        return filp->f_op->read(filp, buf, count, ppos);
+    }
+    if (WRITE == dir && filp->f_op->write) {
+        return filp->f_op->write(filp, buf, count, ppos);
+    }
+    return kshim_rw_iter(filp, dir, &iov, 1, pos, 0);
+}
+
+ssize_t kshim_read(struct file *filp, void *buf, size_t count)
+{
+    return kshim_rw(filp, READ, buf, count, NULL);
+}
+
+ssize_t kshim_write(struct file *filp, const void *buf, size_t count)
+{
+    return kshim_rw(filp, WRITE, (void *)buf, count, NULL);
+}
+
+ssize_t kshim_pread(struct file *filp, void *buf, size_t count, loff_t pos)
+{
+    return kshim_rw(filp, READ, buf, count, &pos);
+}
+
+ssize_t kshim_pwrite(struct file *filp, const void *buf, size_t count, loff_t pos)
+{
+    return kshim_rw(filp, WRITE, (void *)buf, count, &pos);
+}
+
+ssize_t kshim_readv(struct file *filp, const struct iovec *iov, int iovcnt)
+{
+    return kshim_rw_iter(filp, READ, iov, iovcnt, NULL, 0);
+}
+
+ssize_t kshim_writev(struct file *filp, const struct iovec *iov, int iovcnt)
+{
+    return kshim_rw_iter(filp, WRITE, iov, iovcnt, NULL, 0);
+}
+
+ssize_t kshim_readv2(struct file *filp, const struct iovec *iov, int iovcnt, int ki_flags)
+{
+    return kshim_rw_iter(filp, READ, iov, iovcnt, NULL, ki_flags);
+}
+
+ssize_t kshim_writev2(struct file *filp, const struct iovec *iov, int iovcnt, int ki_flags)
+{
+    return kshim_rw_iter(filp, WRITE, iov, iovcnt, NULL, ki_flags);
+}
+
+loff_t kshim_llseek(struct file *filp, loff_t offset, int whence)
+{
+    if (!filp->f_op->llseek) {
+        return -ESPIPE;
+    }
+    return filp->f_op->llseek(filp, offset, whence);
+}
+
+long kshim_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    if (!filp->f_op->unlocked_ioctl) {
+        return -ENOTTY;
+    }
+    return filp->f_op->unlocked_ioctl(filp, cmd, arg);
+}
+
+__poll_t kshim_poll(struct file *filp)
+{
+    if (!filp->f_op->poll) {
+        return POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM;
+    }
+    return filp->f_op->poll(filp, NULL);
+}
+
+/*
+ *xarray
+ */
+#define XA_CHUNK_SHIFT          6
+#define XA_CHUNK_SIZE           (1UL << XA_CHUNK_SHIFT)
+#define XA_LEVELS               4
+#define XA_MAX_INDEX            ((1UL << (XA_LEVELS * XA_CHUNK_SHIFT)) - 1)
+
+struct xa_node {
+    void *slots[XA_CHUNK_SIZE];
+};
+
+void xa_init(struct xarray *xa)
+{
+    xa->root = NULL;
+}
+
+/*
+ *返回index对应的叶子槽位，create为0时中间节点不存在则返回NULL；并发创建同一节点时以cmpxchg的胜者为准
+ */
+static void **xa_slot(struct xarray *xa, unsigned long index, int create)
+{
+    void **slot = &xa->root;
+    int level;
+
+    for (level = XA_LEVELS - 1; level >= 0; level--) {
+        struct xa_node *node = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+        if (!node) {
+            struct xa_node *expected = NULL;
+
+            if (!create) {
+                return NULL;
+            }
+            node = calloc(1, sizeof(*node));
+            if (!node) {
+                return NULL;
+            }
+            if (!__atomic_compare_exchange_n(slot, (void **)&expected, node, 0, __ATOMIC_ACQ_REL,
+                                             __ATOMIC_ACQUIRE)) {
+                free(node);
+                node = expected;
+            }
+        }
+        slot = &node->slots[(index >> (level * XA_CHUNK_SHIFT)) & (XA_CHUNK_SIZE - 1)];
+    }
+    return slot;
+}
+
+void *xa_load(struct xarray *xa, unsigned long index)
+{
+    void **slot;
+
+    if (index > XA_MAX_INDEX) {
+        return NULL;
+    }
+    slot = xa_slot(xa, index, 0);
+    return slot ? __atomic_load_n(slot, __ATOMIC_ACQUIRE) : NULL;
+}
+
+void *xa_cmpxchg(struct xarray *xa, unsigned long index, void *old, void *entry, gfp_t gfp)
+{
+    void **slot;
+    void *expected = old;
+
+    if (index > XA_MAX_INDEX) {
+        return ERR_PTR(-EINVAL);
+    }
+    slot = xa_slot(xa, index, 1);
+    if (!slot) {
+        return ERR_PTR(-ENOMEM);
+    }
+    __atomic_compare_exchange_n(slot, &expected, entry, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return expected;
+}
+
+void *xa_find(struct xarray *xa, unsigned long *index, unsigned long max, int filter)
+{
+    unsigned long i;
+
+    for (i = *index; i <= min(max, XA_MAX_INDEX); i++) {
+        void *entry;
+
+        if (0 == (i & (XA_CHUNK_SIZE - 1)) && !xa_slot(xa, i, 0)) {
+            i += XA_CHUNK_SIZE - 1;
+            continue;
+        }
+        entry = xa_load(xa, i);
+        if (entry) {
+            *index = i;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void *xa_find_after(struct xarray *xa, unsigned long *index, unsigned long max, int filter)
+{
+    unsigned long i = *index + 1;
+    void *entry;
+
+    if (!i) {
+        return NULL;
+    }
+    entry = xa_find(xa, &i, max, filter);
+    if (entry) {
+        *index = i;
+    }
+    return entry;
+}
+
+static void xa_free_node(struct xa_node *node, int level)
+{
+    unsigned long i;
+
+    if (!node) {
+        return;
+    }
+    if (level > 0) {
+        for (i = 0; i < XA_CHUNK_SIZE; i++) {
+            xa_free_node(node->slots[i], level - 1);
+        }
+    }
+    free(node);
+}
+
+void xa_destroy(struct xarray *xa)
+{
+    xa_free_node(xa->root, XA_LEVELS - 1);
+    xa->root = NULL;
+}
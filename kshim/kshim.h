@@ -0,0 +1,684 @@
+/*
+ * kshim: a user space stand-in for the parts of the kernel API used by
+ * globalfifo, globalmem and second
+ *
+ * Licensed under GPLv2 or later
+ */
+
+/*
+ *驱动源文件不做任何修改，直接#include到测试程序中，与kshim.c一起编译成普通的用户态程序，
+ *从而可以在任意Linux机器上用多线程测试驱动的读写路径，并配合ASan/TSan检查内存错误和数据竞争。
+ *include/linux/下的同名头文件都只是包含本文件，编译时用-I指向kshim/include。
+ *
+ *对应关系:
+ *  进程上下文      调用驱动的用户线程，current为每个线程一个的task_struct
+ *  睡眠与唤醒      等待队列项挂在队列上，schedule()在线程自己的条件变量上等待
+ *  mutex/spinlock  pthread_mutex，spin_lock_irqsave等同spin_lock
+ *  RCU             读者持有全局读写锁的读锁，synchronize_rcu()获取一次写锁，保证等到之前的读者全部离开
+ *  per-cpu         每个变量有KSHIM_NR_CPUS份，每个线程按创建顺序分到一个CPU号
+ *  hrtimer         一个后台线程按到期时间依次调用处理函数，处理函数在该线程中运行(相当于中断上下文)
+ *  用户空间指针    与内核指针相同，copy_to_user/copy_from_user即memcpy
+ *  字符设备        cdev_add登记设备号，kshim_open按设备号找到file_operations并调用open
+ *没有实现的: 信号(signal_pending总是0，可中断的等待不会被打断)、mmap建立真实映射、fasync发送信号、
+ *tracepoint(为空函数)、管道与splice(通用的splice实现只提供符号，返回EINVAL)。
+ */
+
+#ifndef _KSHIM_H
+#define _KSHIM_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/types.h>
+#include <asm-generic/errno.h>
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ *编译属性与常用宏
+ */
+#define __user
+#define __init
+#define __exit
+#define __iomem
+#define __force
+#define __must_check
+#define __percpu
+#define __rcu
+#define SMP_CACHE_BYTES                 64
+#define L1_CACHE_BYTES                  SMP_CACHE_BYTES
+#define ____cacheline_aligned           __attribute__((aligned(SMP_CACHE_BYTES)))
+#define ____cacheline_aligned_in_smp    ____cacheline_aligned
+#define __cacheline_aligned_in_smp      ____cacheline_aligned
+
+#define likely(x)               __builtin_expect(!!(x), 1)
+#define unlikely(x)             __builtin_expect(!!(x), 0)
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#define min(a, b)               ((a) < (b) ? (a) : (b))
+#define max(a, b)               ((a) > (b) ? (a) : (b))
+#define min3(a, b, c)           min(min(a, b), c)
+#define min_t(t, a, b)          ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)          ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp_t(t, v, lo, hi)   min_t(t, max_t(t, v, lo), hi)
+#define ARRAY_SIZE(a)           (sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(c)         ((void)sizeof(char[1 - 2 * !!(c)]))
+#define DIV_ROUND_UP(n, d)      (((n) + (d) - 1) / (d))
+#define ALIGN(x, a)             (((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define BITS_PER_LONG           64
+#define GENMASK(h, l)           (((~0UL) << (l)) & (~0UL >> (BITS_PER_LONG - 1 - (h))))
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+
+#define IS_ERR_VALUE(x)         ((unsigned long)(x) >= (unsigned long)-4095)
+#define IS_ERR(p)               IS_ERR_VALUE(p)
+#define IS_ERR_OR_NULL(p)       (!(p) || IS_ERR(p))
+#define PTR_ERR(p)              ((long)(p))
+#define ERR_PTR(e)              ((void *)(long)(e))
+#define ERESTARTSYS             512
+#define ENOIOCTLCMD             515
+
+#define U32_MAX                 0xffffffffU
+#define U64_MAX                 (~0ULL)
+#define NSEC_PER_USEC           1000L
+#define NSEC_PER_MSEC           1000000L
+#define NSEC_PER_SEC            1000000000L
+#define USEC_PER_SEC            1000000L
+#define HZ                      250
+
+/*
+ *类型
+ */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef unsigned int gfp_t;
+typedef unsigned int fmode_t;
+typedef unsigned int __poll_t;
+typedef s64 ktime_t;
+
+/*
+ *原子操作与内存屏障，全部映射到GCC的__atomic内建函数；READ_ONCE/WRITE_ONCE也用relaxed原子访问，TSan不会把它们报告为数据竞争
+ */
+#define READ_ONCE(x)            __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v)        __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define smp_load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_mb()                __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()               __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb()               __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_mb__before_atomic() smp_mb()
+#define smp_mb__after_atomic()  smp_mb()
+#define barrier()               __asm__ __volatile__("" ::: "memory")
+#define cpu_relax()             barrier()
+#define cmpxchg(p, o, n)        __sync_val_compare_and_swap(p, o, n)
+#define xchg(p, n)              __atomic_exchange_n(p, n, __ATOMIC_SEQ_CST)
+
+typedef struct { int counter; } atomic_t;
+typedef struct { long counter; } atomic_long_t;
+typedef struct { s64 counter; } atomic64_t;
+#define ATOMIC_INIT(i)          { (i) }
+
+#define atomic_read(v)          __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_set(v, i)        __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_add(i, v)        ((void)__atomic_fetch_add(&(v)->counter, (i), __ATOMIC_RELAXED))
+#define atomic_inc(v)           atomic_add(1, v)
+#define atomic_dec(v)           ((void)__atomic_fetch_sub(&(v)->counter, 1, __ATOMIC_RELAXED))
+#define atomic_add_return(i, v) __atomic_add_fetch(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_inc_return(v)    atomic_add_return(1, v)
+#define atomic_dec_return(v)    __atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_and_test(v)  (0 == atomic_dec_return(v))
+#define atomic_xchg(v, n)       __atomic_exchange_n(&(v)->counter, (n), __ATOMIC_SEQ_CST)
+#define atomic_cmpxchg(v, o, n) __sync_val_compare_and_swap(&(v)->counter, (o), (n))
+#define atomic_long_read        atomic_read
+#define atomic_long_set         atomic_set
+#define atomic_long_add         atomic_add
+#define atomic_long_inc         atomic_inc
+#define atomic_long_dec         atomic_dec
+#define atomic64_read           atomic_read
+#define atomic64_set            atomic_set
+#define atomic64_add            atomic_add
+#define atomic64_inc            atomic_inc
+#define atomic64_cmpxchg        atomic_cmpxchg
+
+/*
+ *打印与调试，设置环境变量KSHIM_PRINTK后printk才输出
+ */
+int printk(const char *fmt, ...);
+#define KERN_EMERG              ""
+#define KERN_ERR                ""
+#define KERN_WARNING            ""
+#define KERN_INFO               ""
+#define KERN_DEBUG              ""
+#define pr_err(...)             printk(__VA_ARGS__)
+#define pr_warn(...)            printk(__VA_ARGS__)
+#define pr_info(...)            printk(__VA_ARGS__)
+#define pr_debug(...)           printk(__VA_ARGS__)
+#define WARN_ON(c)              (!!(c))
+#define WARN_ON_ONCE(c)         (!!(c))
+#define BUG_ON(c)               ((void)(c))
+
+struct lock_class_key { int dummy; };
+#define lockdep_set_class(l, k) do { (void)(l); (void)(k); } while (0)
+#define lockdep_is_held(l)      1
+
+/*
+ *模块: module_init/module_exit分别定义为init_module()/cleanup_module()，由测试程序调用；
+ *模块参数就是普通的全局变量，测试程序在init_module()之前直接赋值
+ */
+struct module;
+extern struct module __this_module;
+#define THIS_MODULE             (&__this_module)
+#define module_param(n, t, p)               static void *__kshim_param_##n __attribute__((unused)) = &n
+#define module_param_named(a, n, t, p)      static void *__kshim_param_##a __attribute__((unused)) = &n
+#define module_param_array(n, t, c, p)      static void *__kshim_param_##n __attribute__((unused)) = &n
+#define MODULE_PARM_DESC(n, d)
+#define module_init(f)          int init_module(void) { return f(); }
+#define module_exit(f)          void cleanup_module(void) { f(); }
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define S_IRUGO                 0444
+#define S_IWUSR                 0200
+#define S_IRUSR                 0400
+int init_module(void);
+void cleanup_module(void);
+
+/*
+ *内存分配与页
+ */
+#define GFP_KERNEL              0x00u
+#define GFP_ATOMIC              0x01u
+#define GFP_NOWAIT              GFP_ATOMIC
+#define __GFP_ZERO              0x02u
+#define __GFP_NOWARN            0x04u
+#define __GFP_COMP              0x08u
+#define __GFP_NORETRY           0x10u
+#define GFP_HIGHUSER            0x20u
+#define NUMA_NO_NODE            (-1)
+#define PAGE_SHIFT              12
+#define PAGE_SIZE               (1UL << PAGE_SHIFT)
+#define PAGE_MASK               (~(PAGE_SIZE - 1))
+#define PAGE_ALIGN(x)           ALIGN(x, PAGE_SIZE)
+#define offset_in_page(p)       ((unsigned long)(p) & ~PAGE_MASK)
+
+void *kmalloc(size_t size, gfp_t flags);
+void *kzalloc(size_t size, gfp_t flags);
+void *kcalloc(size_t n, size_t size, gfp_t flags);
+void *kzalloc_node(size_t size, gfp_t flags, int node);
+void kfree(const void *p);
+void *vmalloc_user(unsigned long size);
+void vfree(const void *p);
+void *kvmalloc_array(size_t n, size_t size, gfp_t flags);
+#define kvmalloc_node(s, f, n)  kvmalloc_array(1, s, f)
+void kvfree(const void *p);
+
+struct page { void *addr; };
+struct page *alloc_pages_node(int node, gfp_t flags, unsigned int order);
+void __free_pages(struct page *page, unsigned int order);
+void *page_address(const struct page *page);
+unsigned long page_to_pfn(struct page *page);
+
+int roundup_pow_of_two_fn(unsigned long n);
+#define roundup_pow_of_two(n)   ((unsigned long)roundup_pow_of_two_fn(n))
+#define is_power_of_2(n)        ((n) != 0 && 0 == ((n) & ((n) - 1)))
+#define order_base_2(n)         ((n) <= 1 ? 0 : 64 - __builtin_clzl((unsigned long)(n) - 1))
+
+/*
+ *CPU与per-cpu变量
+ *per-cpu变量每个CPU一份，间隔KSHIM_PERCPU_UNIT字节连续存放，per_cpu_ptr按CPU号偏移指针；
+ *每个线程第一次调用smp_processor_id()时按顺序分到一个CPU号，不超过KSHIM_NR_CPUS个线程时互不共用
+ */
+#define KSHIM_NR_CPUS           64
+#define KSHIM_PERCPU_UNIT       1024
+#define nr_cpu_ids              KSHIM_NR_CPUS
+int smp_processor_id(void);
+#define raw_smp_processor_id()  smp_processor_id()
+#define preempt_disable()       barrier()
+#define preempt_enable()        barrier()
+#define cpu_online(c)           ((c) >= 0 && (c) < KSHIM_NR_CPUS)
+#define cpu_possible(c)         cpu_online(c)
+#define num_online_cpus()       KSHIM_NR_CPUS
+#define for_each_possible_cpu(c) for ((c) = 0; (c) < KSHIM_NR_CPUS; (c)++)
+#define for_each_online_cpu(c)  for_each_possible_cpu(c)
+#define cpu_to_node(c)          0
+#define numa_node_id()          0
+unsigned int cpumask_local_spread(unsigned int i, int node);
+int smp_call_function_single(int cpu, void (*func)(void *), void *info, int wait);
+
+void *__alloc_percpu(size_t size, size_t align);
+void free_percpu(void *p);
+#define alloc_percpu(t)         ((t *)__alloc_percpu(sizeof(t), __alignof__(t)))
+#define per_cpu_ptr(p, c)       ((__typeof__(p))((char *)(p) + (c) * KSHIM_PERCPU_UNIT))
+#define this_cpu_ptr(p)         per_cpu_ptr(p, smp_processor_id())
+#define this_cpu_add(v, n)      (*this_cpu_ptr(&(v)) += (n))
+#define this_cpu_inc(v)         this_cpu_add(v, 1)
+
+/*
+ *用户空间访问: 用户指针就是普通指针，总是成功
+ */
+unsigned long copy_to_user(void __user *to, const void *from, unsigned long n);
+unsigned long copy_from_user(void *to, const void __user *from, unsigned long n);
+unsigned long clear_user(void __user *to, unsigned long n);
+#define put_user(x, p)          ({ *(p) = (x); 0; })
+#define get_user(x, p)          ({ (x) = *(p); 0; })
+
+/*
+ *锁
+ */
+struct mutex { pthread_mutex_t m; };
+void mutex_init(struct mutex *lock);
+void mutex_destroy(struct mutex *lock);
+void mutex_lock(struct mutex *lock);
+int mutex_lock_interruptible(struct mutex *lock);
+int mutex_trylock(struct mutex *lock);
+void mutex_unlock(struct mutex *lock);
+
+typedef struct { pthread_mutex_t m; } spinlock_t;
+void spin_lock_init(spinlock_t *lock);
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+#define spin_lock_irqsave(l, f)         do { (f) = 0; spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, f)    do { (void)(f); spin_unlock(l); } while (0)
+#define spin_lock_irq(l)                spin_lock(l)
+#define spin_unlock_irq(l)              spin_unlock(l)
+#define spin_lock_bh(l)                 spin_lock(l)
+#define spin_unlock_bh(l)               spin_unlock(l)
+
+typedef struct { unsigned int sequence; } seqcount_t;
+#define seqcount_init(s)        ((s)->sequence = 0)
+unsigned int read_seqcount_begin(const seqcount_t *s);
+int read_seqcount_retry(const seqcount_t *s, unsigned int start);
+void write_seqcount_begin(seqcount_t *s);
+void write_seqcount_end(seqcount_t *s);
+
+/*
+ *RCU
+ */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void synchronize_rcu(void);
+#define rcu_dereference(p)              __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_access_pointer(p)           __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define rcu_assign_pointer(p, v)        __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define RCU_INIT_POINTER(p, v)          ((p) = (v))
+
+/*
+ *链表
+ */
+struct list_head { struct list_head *next, *prev; };
+#define LIST_HEAD_INIT(n)       { &(n), &(n) }
+#define LIST_HEAD(n)            struct list_head n = LIST_HEAD_INIT(n)
+#define list_entry(ptr, type, member)   container_of(ptr, type, member)
+#define list_for_each_entry(pos, head, member)                                      \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member); &pos->member != (head);  \
+         pos = list_entry(pos->member.next, __typeof__(*pos), member))
+void INIT_LIST_HEAD(struct list_head *list);
+void list_add(struct list_head *entry, struct list_head *head);
+void list_add_tail(struct list_head *entry, struct list_head *head);
+void list_del(struct list_head *entry);
+int list_empty(const struct list_head *head);
+int list_is_singular(const struct list_head *head);
+
+/*
+ *调度与等待队列
+ */
+#define TASK_RUNNING            0
+#define TASK_INTERRUPTIBLE      1
+#define TASK_UNINTERRUPTIBLE    2
+#define TASK_KILLABLE           3
+struct task_struct {
+    int pid;
+    volatile int state;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+struct task_struct *kshim_current(void);
+#define current                 kshim_current()
+void __set_current_state(int state);
+void set_current_state(int state);
+void schedule(void);
+void cond_resched(void);
+#define signal_pending(t)       0
+#define fatal_signal_pending(t) 0
+
+/*调用者具有的能力，每个CAP_*一位，默认全部具有，测试可以清除某一位来检查无权限时的行为*/
+#define CAP_SYS_NICE            23
+extern unsigned long long kshim_caps;
+#define capable(cap)            (!!(kshim_caps & (1ULL << (cap))))
+
+struct wait_queue_entry;
+typedef struct wait_queue_entry wait_queue_entry_t;
+typedef int (*wait_queue_func_t)(struct wait_queue_entry *entry, unsigned int mode, int flags, void *key);
+struct wait_queue_entry {
+    unsigned int flags;
+    void *private;
+    wait_queue_func_t func;
+    struct list_head entry;
+};
+typedef struct wait_queue_head {
+    spinlock_t lock;
+    struct list_head head;
+} wait_queue_head_t;
+int default_wake_function(struct wait_queue_entry *entry, unsigned int mode, int flags, void *key);
+#define DECLARE_WAITQUEUE(name, tsk)    struct wait_queue_entry name = { 0, tsk, default_wake_function, { NULL, NULL } }
+#define DEFINE_WAIT(name)               DECLARE_WAITQUEUE(name, current)
+void init_waitqueue_head(wait_queue_head_t *wq);
+void add_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *entry);
+void remove_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *entry);
+void prepare_to_wait(wait_queue_head_t *wq, wait_queue_entry_t *entry, int state);
+void finish_wait(wait_queue_head_t *wq, wait_queue_entry_t *entry);
+void __wake_up(wait_queue_head_t *wq, void *key);
+#define wake_up(wq)                             __wake_up(wq, NULL)
+#define wake_up_all(wq)                         __wake_up(wq, NULL)
+#define wake_up_interruptible(wq)               __wake_up(wq, NULL)
+#define wake_up_interruptible_all(wq)           __wake_up(wq, NULL)
+#define wake_up_interruptible_poll(wq, m)       __wake_up(wq, (void *)(unsigned long)(m))
+#define wake_up_interruptible_sync_poll(wq, m)  __wake_up(wq, (void *)(unsigned long)(m))
+bool waitqueue_active(wait_queue_head_t *wq);
+bool wq_has_sleeper(wait_queue_head_t *wq);
+
+#define wait_event(wq, cond)                                                \
+    do {                                                                    \
+        DEFINE_WAIT(__wait);                                                \
+        for (;;) {                                                          \
+            prepare_to_wait(&(wq), &__wait, TASK_UNINTERRUPTIBLE);          \
+            if (cond) {                                                     \
+                break;                                                      \
+            }                                                               \
+            schedule();                                                     \
+        }                                                                   \
+        finish_wait(&(wq), &__wait);                                        \
+    } while (0)
+#define wait_event_interruptible(wq, cond)  ({ wait_event(wq, cond); 0; })
+#define wait_event_killable(wq, cond)       ({ wait_event(wq, cond); 0; })
+
+void set_bit(long nr, volatile unsigned long *addr);
+void clear_bit(long nr, volatile unsigned long *addr);
+int test_bit(long nr, const volatile unsigned long *addr);
+int test_and_set_bit(long nr, volatile unsigned long *addr);
+int test_and_clear_bit(long nr, volatile unsigned long *addr);
+#define test_and_set_bit_lock(nr, addr)     test_and_set_bit(nr, addr)
+#define clear_bit_unlock(nr, addr)          clear_bit(nr, addr)
+unsigned long find_next_bit(const unsigned long *addr, unsigned long size, unsigned long offset);
+#define for_each_set_bit(bit, addr, size)                                   \
+    for ((bit) = find_next_bit((addr), (size), 0); (bit) < (size);          \
+         (bit) = find_next_bit((addr), (size), (bit) + 1))
+int wait_on_bit(unsigned long *word, int bit, unsigned int mode);
+int wait_on_bit_lock(unsigned long *word, int bit, unsigned int mode);
+void wake_up_bit(void *word, int bit);
+
+/*
+ *时间与高精度定时器
+ */
+u64 ktime_get_ns(void);
+#define ktime_get()             ((ktime_t)ktime_get_ns())
+#define ktime_to_ns(k)          ((s64)(k))
+#define ns_to_ktime(n)          ((ktime_t)(n))
+#define ktime_add(a, b)         ((a) + (b))
+#define ktime_add_ns(k, n)      ((k) + (ktime_t)(n))
+#define ktime_sub(a, b)         ((a) - (b))
+#define ktime_us_delta(a, b)    (((a) - (b)) / NSEC_PER_USEC)
+#define ktime_set(s, ns)        ((ktime_t)((s) * NSEC_PER_SEC + (ns)))
+
+#define CLOCK_MONOTONIC         1
+enum hrtimer_restart { HRTIMER_NORESTART, HRTIMER_RESTART };
+enum hrtimer_mode {
+    HRTIMER_MODE_ABS        = 0x0,
+    HRTIMER_MODE_REL        = 0x1,
+    HRTIMER_MODE_PINNED     = 0x2,
+    HRTIMER_MODE_ABS_PINNED = 0x2,
+    HRTIMER_MODE_REL_PINNED = 0x3,
+};
+struct hrtimer {
+    enum hrtimer_restart (*function)(struct hrtimer *timer);
+    ktime_t expires;
+    int queued;                 /*以下由定时器线程的锁保护*/
+    int registered;
+};
+void hrtimer_init(struct hrtimer *timer, int clock, enum hrtimer_mode mode);
+void hrtimer_start(struct hrtimer *timer, ktime_t tim, enum hrtimer_mode mode);
+int hrtimer_cancel(struct hrtimer *timer);
+bool hrtimer_active(const struct hrtimer *timer);
+u64 hrtimer_forward(struct hrtimer *timer, ktime_t now, ktime_t interval);
+#define hrtimer_forward_now(t, i)   hrtimer_forward(t, ktime_get(), i)
+#define hrtimer_get_expires(t)      ((t)->expires)
+#define hrtimer_cb_get_time(t)      ktime_get()
+
+/*
+ *文件
+ */
+#define O_ACCMODE               00000003
+#define O_RDONLY                00000000
+#define O_WRONLY                00000001
+#define O_RDWR                  00000002
+#define O_NONBLOCK              00004000
+#define FMODE_READ              0x1u
+#define FMODE_WRITE             0x2u
+#define FMODE_ATOMIC_POS        0x8000u
+#define FMODE_NOWAIT            0x8000000u
+#define IOCB_NOWAIT             (1 << 7)
+#define SEEK_SET                0
+#define SEEK_CUR                1
+#define SEEK_END                2
+#define SEEK_DATA               3
+#define SEEK_HOLE               4
+#define SIGIO                   29
+#define POLL_IN                 1
+#define POLL_OUT                2
+#define POLLIN                  0x0001
+#define POLLPRI                 0x0002
+#define POLLOUT                 0x0004
+#define POLLERR                 0x0008
+#define POLLRDNORM              0x0040
+#define POLLWRNORM              0x0100
+#define EPOLLIN                 POLLIN
+#define EPOLLOUT                POLLOUT
+#define EPOLLERR                POLLERR
+#define EPOLLRDNORM             POLLRDNORM
+#define EPOLLWRNORM             POLLWRNORM
+#define READ                    0
+#define WRITE                   1
+
+struct cdev;
+struct inode {
+    struct cdev *i_cdev;
+    dev_t i_rdev;
+};
+struct file {
+    unsigned int f_flags;
+    fmode_t f_mode;
+    loff_t f_pos;
+    void *private_data;
+    struct inode *f_inode;
+    const struct file_operations *f_op;
+};
+
+struct kiocb {
+    struct file *ki_filp;
+    loff_t ki_pos;
+    int ki_flags;
+};
+struct kvec { void *iov_base; size_t iov_len; };
+struct iov_iter {
+    int type;
+    size_t iov_offset;
+    size_t count;
+    const struct iovec *iov;
+    unsigned long nr_segs;
+};
+void iov_iter_init(struct iov_iter *i, int dir, const struct iovec *iov, unsigned long nr_segs, size_t count);
+#define iov_iter_count(i)       ((i)->count)
+size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i);
+size_t copy_from_iter(void *addr, size_t bytes, struct iov_iter *i);
+bool copy_from_iter_full(void *addr, size_t bytes, struct iov_iter *i);
+size_t iov_iter_zero(size_t bytes, struct iov_iter *i);
+void iov_iter_advance(struct iov_iter *i, size_t bytes);
+void iov_iter_revert(struct iov_iter *i, size_t bytes);
+
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+void poll_wait(struct file *filp, wait_queue_head_t *wq, poll_table *p);
+struct fasync_struct;
+int fasync_helper(int fd, struct file *filp, int on, struct fasync_struct **fapp);
+void kill_fasync(struct fasync_struct **fp, int sig, int band);
+
+struct vm_area_struct;
+struct pipe_inode_info;
+struct file_operations {
+    struct module *owner;
+    loff_t (*llseek)(struct file *, loff_t, int);
+    ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+    ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+    ssize_t (*read_iter)(struct kiocb *, struct iov_iter *);
+    ssize_t (*write_iter)(struct kiocb *, struct iov_iter *);
+    __poll_t (*poll)(struct file *, struct poll_table_struct *);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+    long (*compat_ioctl)(struct file *, unsigned int, unsigned long);
+    int (*mmap)(struct file *, struct vm_area_struct *);
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    int (*fasync)(int, struct file *, int);
+    ssize_t (*splice_write)(struct pipe_inode_info *, struct file *, loff_t *, size_t, unsigned int);
+    ssize_t (*splice_read)(struct file *, loff_t *, struct pipe_inode_info *, size_t, unsigned int);
+};
+
+ssize_t generic_file_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe, size_t len, unsigned int flags);
+ssize_t iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out, loff_t *ppos, size_t len, unsigned int flags);
+
+/*
+ *内存映射: 只提供类型，mmap/缺页处理可以编译但测试中不会建立映射
+ */
+typedef int vm_fault_t;
+#define VM_READ                 0x00000001ul
+#define VM_WRITE                0x00000002ul
+#define VM_SHARED               0x00000008ul
+#define VM_MAYWRITE             0x00000020ul
+#define VM_PFNMAP               0x00000400ul
+#define VM_IO                   0x00004000ul
+#define VM_DONTEXPAND           0x00040000ul
+#define VM_DONTDUMP             0x04000000ul
+#define VM_MIXEDMAP             0x10000000ul
+#define VM_HUGEPAGE             0x20000000ul
+#define VM_FAULT_OOM            0x0001
+#define VM_FAULT_SIGBUS         0x0002
+#define VM_FAULT_NOPAGE         0x0100
+#define VM_FAULT_LOCKED         0x0200
+struct vm_fault;
+struct vm_operations_struct {
+    void (*open)(struct vm_area_struct *);
+    void (*close)(struct vm_area_struct *);
+    vm_fault_t (*fault)(struct vm_fault *);
+};
+struct vm_area_struct {
+    unsigned long vm_start, vm_end, vm_pgoff, vm_flags;
+    const struct vm_operations_struct *vm_ops;
+    void *vm_private_data;
+    struct file *vm_file;
+    unsigned long vm_page_prot;
+};
+struct vm_fault {
+    struct vm_area_struct *vma;
+    unsigned int flags;
+    unsigned long pgoff;
+    unsigned long address;
+    struct page *page;
+};
+#define vma_pages(v)            (((v)->vm_end - (v)->vm_start) >> PAGE_SHIFT)
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr, unsigned long pgoff);
+vm_fault_t vmf_insert_pfn(struct vm_area_struct *vma, unsigned long addr, unsigned long pfn);
+
+/*
+ *字符设备、设备类与sysfs属性
+ */
+struct kobject { const char *name; };
+struct cdev {
+    struct kobject kobj;
+    struct module *owner;
+    const struct file_operations *ops;
+    dev_t dev;
+    unsigned int count;
+};
+#define MINORBITS               20
+#define MINORMASK               ((1U << MINORBITS) - 1)
+#define MKDEV(ma, mi)           ((dev_t)(((ma) << MINORBITS) | (mi)))
+#define MAJOR(dev)              ((unsigned int)((dev) >> MINORBITS))
+#define MINOR(dev)              ((unsigned int)((dev) & MINORMASK))
+void cdev_init(struct cdev *cdev, const struct file_operations *fops);
+int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count);
+void cdev_del(struct cdev *cdev);
+int register_chrdev_region(dev_t from, unsigned int count, const char *name);
+int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name);
+void unregister_chrdev_region(dev_t from, unsigned int count);
+
+struct device;
+struct class;
+struct attribute { const char *name; unsigned short mode; };
+struct device_attribute {
+    struct attribute attr;
+    ssize_t (*show)(struct device *, struct device_attribute *, char *);
+    ssize_t (*store)(struct device *, struct device_attribute *, const char *, size_t);
+};
+struct attribute_group {
+    const char *name;
+    struct attribute **attrs;
+};
+#define __ATTR_RO(n)            { { #n, 0444 }, n##_show, NULL }
+#define __ATTR_RW(n)            { { #n, 0644 }, n##_show, n##_store }
+#define DEVICE_ATTR_RO(n)       struct device_attribute dev_attr_##n = __ATTR_RO(n)
+#define DEVICE_ATTR_RW(n)       struct device_attribute dev_attr_##n = __ATTR_RW(n)
+struct class *class_create(struct module *owner, const char *name);
+void class_destroy(struct class *cls);
+struct device *device_create(struct class *cls, struct device *parent, dev_t devt, void *drvdata,
+                             const char *fmt, ...);
+struct device *device_create_with_groups(struct class *cls, struct device *parent, dev_t devt, void *drvdata,
+                                         const struct attribute_group **groups, const char *fmt, ...);
+void device_destroy(struct class *cls, dev_t devt);
+void *dev_get_drvdata(const struct device *dev);
+
+/*
+ *xarray: 4层64叉的基数树，覆盖2^24个索引，load无锁，cmpxchg用原子操作更新槽位
+ */
+#define XA_PRESENT              8
+struct xarray { void *root; };
+void xa_init(struct xarray *xa);
+void *xa_load(struct xarray *xa, unsigned long index);
+void *xa_cmpxchg(struct xarray *xa, unsigned long index, void *old, void *entry, gfp_t gfp);
+void *xa_find(struct xarray *xa, unsigned long *index, unsigned long max, int filter);
+void *xa_find_after(struct xarray *xa, unsigned long *index, unsigned long max, int filter);
+void xa_destroy(struct xarray *xa);
+#define xa_is_err(entry)        0
+#define xa_for_each(xa, index, entry)                                           \
+    for (index = 0, entry = xa_find(xa, &index, ~0UL, XA_PRESENT); entry;      \
+         entry = xa_find_after(xa, &index, ~0UL, XA_PRESENT))
+
+/*
+ *测试程序使用的接口，相当于系统调用: 按设备号打开驱动登记的字符设备，经file_operations读写
+ */
+struct file *kshim_open(dev_t dev, unsigned int flags);
+int kshim_close(struct file *filp);
+ssize_t kshim_read(struct file *filp, void *buf, size_t count);
+ssize_t kshim_write(struct file *filp, const void *buf, size_t count);
+ssize_t kshim_pread(struct file *filp, void *buf, size_t count, loff_t pos);
+ssize_t kshim_pwrite(struct file *filp, const void *buf, size_t count, loff_t pos);
+ssize_t kshim_readv(struct file *filp, const struct iovec *iov, int iovcnt);
+ssize_t kshim_writev(struct file *filp, const struct iovec *iov, int iovcnt);
+ssize_t kshim_readv2(struct file *filp, const struct iovec *iov, int iovcnt, int ki_flags);
+ssize_t kshim_writev2(struct file *filp, const struct iovec *iov, int iovcnt, int ki_flags);
+loff_t kshim_llseek(struct file *filp, loff_t offset, int whence);
+long kshim_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+__poll_t kshim_poll(struct file *filp);
+struct device *kshim_find_device(dev_t dev);
+ssize_t kshim_show(dev_t dev, const char *group, const char *name, char *buf);
+
+#endif /* _KSHIM_H */
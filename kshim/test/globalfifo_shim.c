@@ -0,0 +1,583 @@
+/*
+ *globalfifo用户态测试
+ *把驱动源文件与kshim一起编译，不需要加载模块，用ASan/TSan版本检查读写路径上的内存错误和数据竞争。
+ *  stream: 每对读写线程使用一个设备，写者用随机长度、随机分段的writev写入按偏移生成的字节，读者readv后逐字节校验
+ *  spsc:   同上，开启SPSC无锁路径
+ *  dgram:  数据报模式，每条记录的长度和内容由序号决定，读者校验记录边界和内容
+ *  mpmc:   整体读写模式，多个写者和多个读者共用设备0，记录带写者号和序号，校验每个写者的记录不丢不重且按序
+ *  mq-rr/mq-ts: 多队列模式，多个写者整体写入记录，一个读者用随机长度读取后重新分帧，校验每个写者的记录连续
+ *  nowait: IOCB_NOWAIT的读写在没有数据/空间或锁被占用时立即返回EAGAIN，条件满足后正常完成
+ *  switch: 共用一个文件的线程睡眠在读取中时切换多队列模式，之后写入的数据仍能被它读到
+ *  align:  流模式读写使下标停在非对齐处后切换到数据报模式，记录的长度头仍在数据区内且4字节对齐
+ *每项输出吞吐量，最后输出设备0的统计属性。
+ *
+ *用法: globalfifo_shim [读写线程对数，不超过10] [每对传输的MB数]
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../globalfifo/globalfifo.c"
+
+#define MAX_MSG         4096
+#define MAX_RECORD      1024    /*数据报模式下记录长度上限，加上记录头后不超过默认容量*/
+#define MPMC_THREADS    4
+#define MPMC_RECORDS    50000
+#define MQ_MINOR        1
+#define NOWAIT_MINOR    2
+#define SWITCH_MINOR    3
+#define ALIGN_MINOR     4
+
+struct record {
+    u32 writer;
+    u32 seq;
+    u32 check;
+    u32 pad;
+};
+
+struct pair {
+    int minor;
+    struct file *wf;
+    struct file *rf;
+    unsigned long total;
+    pthread_t writer;
+    pthread_t reader;
+};
+
+static int dgram_mode;
+static unsigned long mpmc_count[MPMC_THREADS];
+
+/*
+ *发现错误时直接退出，对端线程可能正阻塞在读写中
+ */
+static void __attribute__((noreturn)) fail(const char *what, long a, long b)
+{
+    fprintf(stderr, "FAILED %s: %ld %ld\n", what, a, b);
+    exit(1);
+}
+
+static u64 now_ns(void)
+{
+    return ktime_get_ns();
+}
+
+static unsigned char pattern(unsigned long off)
+{
+    return (unsigned char)(off * 7 + (off >> 12));
+}
+
+/*
+ *把buf随机分成不超过3段
+ */
+static int split(unsigned char *buf, size_t n, struct iovec *iov, unsigned int *seed)
+{
+    size_t off = 0;
+    int k = 0;
+
+    while (off < n && k < 2) {
+        size_t len = rand_r(seed) % (n - off) + 1;
+
+        iov[k].iov_base = buf + off;
+        iov[k].iov_len = len;
+        off += len;
+        k++;
+    }
+    if (off < n) {
+        iov[k].iov_base = buf + off;
+        iov[k].iov_len = n - off;
+        k++;
+    }
+    return k;
+}
+
+static void *stream_writer(void *arg)
+{
+    struct pair *p = arg;
+    unsigned char buf[MAX_MSG];
+    unsigned int seed = p->minor + 1;
+    unsigned long sent = 0, rec = 0;
+    struct iovec iov[3];
+
+    while (sent < p->total) {
+        size_t n = rand_r(&seed) % MAX_MSG + 1, i;
+        ssize_t ret;
+
+        if (dgram_mode) {
+            n = (rec * 131) % MAX_RECORD + 1;
+            for (i = 0; i < n; i++) {
+                buf[i] = (unsigned char)(rec + i);
+            }
+        } else {
+            n = min(n, p->total - sent);
+            for (i = 0; i < n; i++) {
+                buf[i] = pattern(sent + i);
+            }
+        }
+        ret = kshim_writev(p->wf, iov, split(buf, n, iov, &seed));
+        if (ret <= 0 || (dgram_mode && (size_t)ret != n)) {
+            fail("write", ret, n);
+        }
+        sent += ret;
+        rec++;
+    }
+    return NULL;
+}
+
+static void *stream_reader(void *arg)
+{
+    struct pair *p = arg;
+    unsigned char buf[MAX_MSG];
+    unsigned int seed = p->minor + 100;
+    unsigned long got = 0, rec = 0;
+    struct iovec iov[3];
+
+    while (got < p->total) {
+        size_t n = dgram_mode ? MAX_MSG : rand_r(&seed) % MAX_MSG + 1, i;
+        ssize_t ret = kshim_readv(p->rf, iov, split(buf, n, iov, &seed));
+
+        if (ret <= 0) {
+            fail("read", ret, n);
+        }
+        if (dgram_mode) {
+            if ((size_t)ret != (rec * 131) % MAX_RECORD + 1) {
+                fail("record length", ret, rec);
+            }
+            for (i = 0; i < (size_t)ret; i++) {
+                if (buf[i] != (unsigned char)(rec + i)) {
+                    fail("record data", rec, i);
+                }
+            }
+        } else {
+            for (i = 0; i < (size_t)ret; i++) {
+                if (buf[i] != pattern(got + i)) {
+                    fail("stream data", got + i, buf[i]);
+                }
+            }
+        }
+        got += ret;
+        rec++;
+    }
+    return NULL;
+}
+
+static void run_pairs(const char *name, int npairs, unsigned long total, int spsc, int dgram)
+{
+    struct pair pairs[DEVICE_NUM];
+    u64 t0, t1;
+    int i;
+
+    dgram_mode = dgram;
+    for (i = 0; i < npairs; i++) {
+        struct pair *p = &pairs[i];
+
+        p->minor = i;
+        p->total = total;
+        p->wf = kshim_open(MKDEV(globalfifo_major, i), O_WRONLY);
+        p->rf = kshim_open(MKDEV(globalfifo_major, i), O_RDONLY);
+        if (IS_ERR(p->wf) || IS_ERR(p->rf)) {
+            fail("open", i, 0);
+        }
+        kshim_ioctl(p->wf, GLOBALFIFO_IOC_SET_SPSC, spsc);
+        if (kshim_ioctl(p->wf, GLOBALFIFO_IOC_SET_DGRAM, dgram)) {
+            fail("SET_DGRAM", i, dgram);
+        }
+    }
+
+    t0 = now_ns();
+    for (i = 0; i < npairs; i++) {
+        pthread_create(&pairs[i].writer, NULL, stream_writer, &pairs[i]);
+        pthread_create(&pairs[i].reader, NULL, stream_reader, &pairs[i]);
+    }
+    for (i = 0; i < npairs; i++) {
+        pthread_join(pairs[i].writer, NULL);
+        pthread_join(pairs[i].reader, NULL);
+    }
+    t1 = now_ns();
+
+    for (i = 0; i < npairs; i++) {
+        kshim_ioctl(pairs[i].wf, GLOBALFIFO_IOC_SET_DGRAM, 0);
+        kshim_close(pairs[i].wf);
+        kshim_close(pairs[i].rf);
+    }
+    printf("%-8s %2d pairs %10.1f MB/s\n", name, npairs, (double)total * npairs / 1e6 / ((t1 - t0) / 1e9));
+}
+
+static struct file *mpmc_filp[MPMC_THREADS * 2];
+
+static void *mpmc_writer(void *arg)
+{
+    long id = (long)arg;
+    struct record r = { (u32)id, 0, 0, 0 };
+
+    for (r.seq = 0; r.seq < MPMC_RECORDS; r.seq++) {
+        ssize_t ret;
+
+        r.check = r.writer * 2654435761u ^ r.seq;
+        ret = kshim_write(mpmc_filp[id], &r, sizeof(r));
+        if (ret != sizeof(r)) {
+            fail("mpmc write", ret, r.seq);
+        }
+    }
+    return NULL;
+}
+
+/*
+ *每个读者看到的同一写者的记录序号必须递增；所有读者收到的记录数之和等于写入数
+ */
+static void *mpmc_reader(void *arg)
+{
+    long id = (long)arg;
+    long last[MPMC_THREADS];
+    struct record r;
+    unsigned long n = 0;
+    int i;
+
+    for (i = 0; i < MPMC_THREADS; i++) {
+        last[i] = -1;
+    }
+    for (;;) {
+        ssize_t ret = kshim_read(mpmc_filp[MPMC_THREADS + id], &r, sizeof(r));
+
+        if (ret != sizeof(r)) {
+            fail("mpmc read", ret, n);
+        }
+        if (r.writer == U32_MAX) {
+            break;
+        }
+        if (r.writer >= MPMC_THREADS || r.check != (r.writer * 2654435761u ^ r.seq) || (long)r.seq <= last[r.writer]) {
+            fail("mpmc record", r.writer, r.seq);
+        }
+        last[r.writer] = r.seq;
+        n++;
+    }
+    mpmc_count[id] = n;
+    return NULL;
+}
+
+static void run_mpmc(void)
+{
+    pthread_t th[MPMC_THREADS * 2];
+    struct record stop = { U32_MAX, 0, 0, 0 };
+    unsigned long sum = 0;
+    u64 t0, t1;
+    long i;
+
+    for (i = 0; i < MPMC_THREADS * 2; i++) {
+        mpmc_filp[i] = kshim_open(MKDEV(globalfifo_major, 0), i < MPMC_THREADS ? O_WRONLY : O_RDONLY);
+        kshim_ioctl(mpmc_filp[i], GLOBALFIFO_IOC_SET_ATOMIC, 1);
+    }
+    t0 = now_ns();
+    for (i = 0; i < MPMC_THREADS * 2; i++) {
+        pthread_create(&th[i], NULL, i < MPMC_THREADS ? mpmc_writer : mpmc_reader, (void *)(i % MPMC_THREADS));
+    }
+    for (i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    for (i = 0; i < MPMC_THREADS; i++) {
+        kshim_write(mpmc_filp[0], &stop, sizeof(stop));
+    }
+    for (i = MPMC_THREADS; i < MPMC_THREADS * 2; i++) {
+        pthread_join(th[i], NULL);
+    }
+    t1 = now_ns();
+
+    for (i = 0; i < MPMC_THREADS; i++) {
+        sum += mpmc_count[i];
+    }
+    if (sum != (unsigned long)MPMC_THREADS * MPMC_RECORDS) {
+        fail("mpmc records", sum, (long)MPMC_THREADS * MPMC_RECORDS);
+    }
+    for (i = 0; i < MPMC_THREADS * 2; i++) {
+        kshim_close(mpmc_filp[i]);
+    }
+    printf("%-8s %d+%d    %10.0f records/s\n", "mpmc", MPMC_THREADS, MPMC_THREADS, sum / ((t1 - t0) / 1e9));
+}
+
+static struct file *mq_filp[MPMC_THREADS * 2];
+
+static void *mq_writer(void *arg)
+{
+    long id = (long)arg;
+    struct record r = { (u32)id, 0, 0, 0 };
+
+    for (r.seq = 0; r.seq < MPMC_RECORDS; r.seq++) {
+        ssize_t ret;
+
+        r.check = r.writer * 2654435761u ^ r.seq;
+        ret = kshim_write(mq_filp[id], &r, sizeof(r));
+        if (ret != sizeof(r)) {
+            fail("mq write", ret, r.seq);
+        }
+    }
+    return NULL;
+}
+
+/*
+ *读者读取的长度与记录边界无关，部分读走的记录在下一次读取时先返回，拼接后仍是完整的记录序列
+ */
+static void run_mq(const char *name, int mode)
+{
+    pthread_t th[MPMC_THREADS * 2];
+    struct file *filp = kshim_open(MKDEV(globalfifo_major, MQ_MINOR), O_RDONLY);
+    unsigned char buf[MAX_MSG + sizeof(struct record)];
+    unsigned long total = (unsigned long)MPMC_THREADS * 2 * MPMC_RECORDS, n = 0;
+    u32 next[MPMC_THREADS * 2] = { 0 };
+    unsigned int seed = mode, have = 0, off;
+    struct record r;
+    u64 t0, t1;
+    long i;
+
+    if (kshim_ioctl(filp, GLOBALFIFO_IOC_SET_MQ, mode)) {
+        fail("SET_MQ", mode, 0);
+    }
+    for (i = 0; i < MPMC_THREADS * 2; i++) {
+        mq_filp[i] = kshim_open(MKDEV(globalfifo_major, MQ_MINOR), O_WRONLY);
+        kshim_ioctl(mq_filp[i], GLOBALFIFO_IOC_SET_ATOMIC, 1);
+    }
+    if (kshim_ioctl(filp, GLOBALFIFO_IOC_SET_MQ, 0) != -EBUSY) {
+        fail("SET_MQ while shared", mode, 0);
+    }
+
+    t0 = now_ns();
+    for (i = 0; i < MPMC_THREADS * 2; i++) {
+        pthread_create(&th[i], NULL, mq_writer, (void *)i);
+    }
+    while (n < total) {
+        ssize_t ret = kshim_read(filp, buf + have, rand_r(&seed) % MAX_MSG + 1);
+
+        if (ret <= 0) {
+            fail("mq read", ret, n);
+        }
+        have += ret;
+        for (off = 0; have - off >= sizeof(r); off += sizeof(r), n++) {
+            memcpy(&r, buf + off, sizeof(r));
+            if (r.writer >= MPMC_THREADS * 2 || r.check != (r.writer * 2654435761u ^ r.seq) || r.seq != next[r.writer]) {
+                fail("mq record", r.writer, r.seq);
+            }
+            next[r.writer]++;
+        }
+        memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+    t1 = now_ns();
+
+    for (i = 0; i < MPMC_THREADS * 2; i++) {
+        pthread_join(th[i], NULL);
+        kshim_close(mq_filp[i]);
+    }
+    if (have || kshim_ioctl(filp, GLOBALFIFO_IOC_SET_MQ, 0)) {
+        fail("mq leftover", have, mode);
+    }
+    kshim_close(filp);
+    printf("%-8s %d+1    %10.0f records/s\n", name, MPMC_THREADS * 2, total / ((t1 - t0) / 1e9));
+}
+
+static ssize_t nowait_io(struct file *filp, int dir, void *buf, size_t len)
+{
+    struct iovec iov = { buf, len };
+
+    return READ == dir ? kshim_readv2(filp, &iov, 1, IOCB_NOWAIT) : kshim_writev2(filp, &iov, 1, IOCB_NOWAIT);
+}
+
+/*
+ *依次检查加锁路径、SPSC路径和多队列模式，阻塞的读写者不存在时，NOWAIT的请求不能睡眠
+ */
+static void run_nowait(void)
+{
+    struct globalfifo_dev *dev = globalfifo_devp[NOWAIT_MINOR];
+    struct file *filp = kshim_open(MKDEV(globalfifo_major, NOWAIT_MINOR), O_RDWR);
+    unsigned char buf[MAX_MSG];
+    unsigned int size;
+    ssize_t ret;
+    int spsc;
+
+    if (IS_ERR(filp) || !(filp->f_mode & FMODE_NOWAIT)) {
+        fail("FMODE_NOWAIT", NOWAIT_MINOR, 0);
+    }
+    kshim_ioctl(filp, GLOBALFIFO_IOC_GET_SIZE, (unsigned long)&size);
+    memset(buf, 0x6e, sizeof(buf));
+
+    for (spsc = 0; spsc <= 1; spsc++) {
+        kshim_ioctl(filp, GLOBALFIFO_IOC_SET_SPSC, spsc);
+        if ((ret = nowait_io(filp, READ, buf, 16)) != -EAGAIN) {
+            fail("nowait read empty", ret, spsc);
+        }
+        while ((ret = nowait_io(filp, WRITE, buf, sizeof(buf))) > 0) {
+        }
+        if (ret != -EAGAIN || globalfifo_len(dev) != size) {
+            fail("nowait write full", ret, spsc);
+        }
+
+        /*锁被占用时不等待*/
+        mutex_lock(&dev->mutex);
+        globalfifo_side_lock(dev, GLOBALFIFO_RD_BUSY);
+        if ((ret = nowait_io(filp, READ, buf, 16)) != -EAGAIN) {
+            fail("nowait read locked", ret, spsc);
+        }
+        globalfifo_side_unlock(dev, GLOBALFIFO_RD_BUSY);
+        mutex_unlock(&dev->mutex);
+
+        if ((ret = nowait_io(filp, READ, buf, sizeof(buf))) != sizeof(buf)) {
+            fail("nowait read", ret, spsc);
+        }
+        kshim_ioctl(filp, MEM_CLEAR, 0);
+    }
+    kshim_ioctl(filp, GLOBALFIFO_IOC_SET_SPSC, 0);
+
+    /*多队列模式下本线程所在CPU的子环还没有申请时返回EAGAIN，阻塞的写入申请之后即可使用*/
+    if (kshim_ioctl(filp, GLOBALFIFO_IOC_SET_MQ, GLOBALFIFO_MQ_RR)) {
+        fail("SET_MQ", NOWAIT_MINOR, 0);
+    }
+    if ((ret = nowait_io(filp, WRITE, buf, 16)) != -EAGAIN) {
+        fail("nowait mq write before alloc", ret, 0);
+    }
+    if (kshim_write(filp, buf, 16) != 16 || nowait_io(filp, WRITE, buf, 16) != 16) {
+        fail("mq write", 0, 0);
+    }
+    if ((ret = nowait_io(filp, READ, buf, sizeof(buf))) != 32 || (ret = nowait_io(filp, READ, buf, 16)) != -EAGAIN) {
+        fail("nowait mq read", ret, 0);
+    }
+    kshim_ioctl(filp, GLOBALFIFO_IOC_SET_MQ, GLOBALFIFO_MQ_OFF);
+    kshim_close(filp);
+    printf("%-8s ok\n", "nowait");
+}
+
+struct switch_reader {
+    struct file *filp;
+    ssize_t ret;
+    pthread_t thread;
+};
+
+static void *switch_read(void *arg)
+{
+    struct switch_reader *r = arg;
+    unsigned char buf[64];
+
+    /*驱动不使用文件位置，用pread避免两个线程同时更新同一个文件的f_pos*/
+    __atomic_store_n(&r->ret, kshim_pread(r->filp, buf, sizeof(buf), 0), __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ *读者线程在当前模式的路径上睡眠后，主线程通过同一个文件切换模式并写入，读者必须改走新模式的路径读到数据
+ */
+static void switch_once(struct file *filp, struct globalfifo_dev *dev, int from, int to)
+{
+    struct switch_reader r = { filp, 0 };
+    unsigned char buf[16];
+    int i;
+
+    memset(buf, 0x73, sizeof(buf));
+    pthread_create(&r.thread, NULL, switch_read, &r);
+    while (!waitqueue_active(&dev->r_wait)) {
+        sched_yield();
+    }
+    if (kshim_ioctl(filp, GLOBALFIFO_IOC_SET_MQ, to)) {
+        fail("SET_MQ with sleeping reader", from, to);
+    }
+    if (kshim_write(filp, buf, sizeof(buf)) != sizeof(buf)) {
+        fail("switch write", from, to);
+    }
+    for (i = 0; i < 1000 && !__atomic_load_n(&r.ret, __ATOMIC_ACQUIRE); i++) {
+        usleep(1000);
+    }
+    if (r.ret != sizeof(buf)) {
+        fail("switch read", from * 10 + to, r.ret);
+    }
+    pthread_join(r.thread, NULL);
+}
+
+static void run_switch(void)
+{
+    struct globalfifo_dev *dev = globalfifo_devp[SWITCH_MINOR];
+    struct file *filp = kshim_open(MKDEV(globalfifo_major, SWITCH_MINOR), O_RDWR);
+    int spsc;
+
+    for (spsc = 0; spsc <= 1; spsc++) {
+        kshim_ioctl(filp, GLOBALFIFO_IOC_SET_SPSC, spsc);
+        switch_once(filp, dev, GLOBALFIFO_MQ_OFF, GLOBALFIFO_MQ_RR);
+        switch_once(filp, dev, GLOBALFIFO_MQ_RR, GLOBALFIFO_MQ_OFF);
+    }
+    kshim_ioctl(filp, GLOBALFIFO_IOC_SET_SPSC, 0);
+    kshim_close(filp);
+    printf("%-8s ok\n", "switch");
+}
+
+/*
+ *长度头越界只越过数据区末尾几个字节，落在vmalloc的同一次申请之内，ASan发现不了，因此直接检查长度头的偏移
+ */
+static void run_align(void)
+{
+    struct globalfifo_dev *dev = globalfifo_devp[ALIGN_MINOR];
+    struct file *filp = kshim_open(MKDEV(globalfifo_major, ALIGN_MINOR), O_RDWR);
+    struct globalfifo_ring *ring = globalfifo_ring(dev);
+    unsigned char buf[MAX_MSG];
+    unsigned int size = ring->size, left, off;
+    ssize_t ret;
+
+    /*流模式下读写size - 2字节，head/tail停在数据区末尾前2字节处*/
+    memset(buf, 0x61, sizeof(buf));
+    for (left = size - 2; left; left -= ret) {
+        ret = kshim_write(filp, buf, min_t(unsigned int, left, sizeof(buf)));
+        if (ret <= 0 || kshim_read(filp, buf, ret) != ret) {
+            fail("align stream", ret, left);
+        }
+    }
+    if (kshim_ioctl(filp, GLOBALFIFO_IOC_SET_DGRAM, 1)) {
+        fail("align SET_DGRAM", size, 0);
+    }
+
+    off = ring->ctrl->head & (size - 1);
+    if (off % GLOBALFIFO_DGRAM_HDR || off + GLOBALFIFO_DGRAM_HDR > size) {
+        fail("dgram header offset", off, size);
+    }
+    memset(buf, 0x64, 7);
+    if ((ret = kshim_write(filp, buf, 7)) != 7 || (ret = kshim_read(filp, buf, sizeof(buf))) != 7 || buf[6] != 0x64) {
+        fail("align dgram", ret, off);
+    }
+
+    kshim_ioctl(filp, GLOBALFIFO_IOC_SET_DGRAM, 0);
+    kshim_close(filp);
+    printf("%-8s ok\n", "align");
+}
+
+int main(int argc, char *argv[])
+{
+    int npairs = argc > 1 ? atoi(argv[1]) : 4;
+    unsigned long total = (argc > 2 ? atol(argv[2]) : 4) << 20;
+    const char *stats[] = { "reads", "writes", "read_bytes", "write_bytes", "read_blocks", "write_blocks" };
+    char buf[64];
+    unsigned int i;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    npairs = clamp_t(int, npairs, 1, DEVICE_NUM);
+    if (init_module()) {
+        fprintf(stderr, "init_module failed\n");
+        return 1;
+    }
+    /*容量不足一页时提升到一页，只拒绝超过上限的容量*/
+    if (globalfifo_check_size(1) != PAGE_SIZE || globalfifo_check_size(PAGE_SIZE + 1) != 2 * PAGE_SIZE ||
+        globalfifo_check_size(GLOBALFIFO_MAX_SIZE + 1UL)) {
+        fail("check_size", globalfifo_check_size(1), globalfifo_check_size(PAGE_SIZE + 1));
+    }
+
+    run_pairs("stream", npairs, total, 0, 0);
+    run_pairs("spsc", npairs, total, 1, 0);
+    run_pairs("dgram", npairs, total, 0, 1);
+    run_mpmc();
+    run_mq("mq-rr", GLOBALFIFO_MQ_RR);
+    run_mq("mq-ts", GLOBALFIFO_MQ_TS);
+    run_nowait();
+    run_switch();
+    run_align();
+
+    for (i = 0; i < ARRAY_SIZE(stats); i++) {
+        if (kshim_show(MKDEV(globalfifo_major, 0), "stats", stats[i], buf) > 0) {
+            printf("globalfifo0 %-12s %s", stats[i], buf);
+        }
+    }
+    cleanup_module();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ *globalmem用户态测试
+ *把驱动源文件与kshim一起编译，区域大小设为4GB(稀疏)，用ASan/TSan版本检查读写路径。
+ *  torn:   一个写者不断把同一页整页写成同一个字节，多个读者整页读取，检查读到的页内容一致(seqcount无锁读)
+ *  scale:  每个线程在各自的页上交替pwrite/pread，输出总的操作速率
+ *  range:  FILL/COPY(重叠，等同memmove)后与用户态的参照数据比较
+ *  sparse: 在相距很远的位置写入，检查SEEK_DATA/SEEK_HOLE和读到的空洞内容
+ *
+ *用法: globalmem_shim [读者/线程数] [写入次数]
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "../../globalmem/globalmem.c"
+
+#define SHIM_MINOR      0
+
+static volatile int stop;
+static long torn_reads, total_reads;
+static long ops_per_thread = 100000;
+
+static void __attribute__((noreturn)) fail(const char *what, long a, long b)
+{
+    fprintf(stderr, "FAILED %s: %ld %ld\n", what, a, b);
+    exit(1);
+}
+
+static struct file *open_mem(int minor)
+{
+    struct file *filp = kshim_open(MKDEV(globalmem_major, minor), O_RDWR);
+
+    if (IS_ERR(filp)) {
+        fail("open", minor, PTR_ERR(filp));
+    }
+    return filp;
+}
+
+static void *torn_reader(void *arg)
+{
+    struct file *filp = open_mem(SHIM_MINOR);
+    unsigned char buf[PAGE_SIZE];
+    long torn = 0, n = 0;
+    unsigned long i;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        if (kshim_pread(filp, buf, sizeof(buf), 0) != sizeof(buf)) {
+            fail("torn read", n, 0);
+        }
+        for (i = 1; i < sizeof(buf); i++) {
+            if (buf[i] != buf[0]) {
+                torn++;
+                break;
+            }
+        }
+        n++;
+    }
+    __atomic_add_fetch(&torn_reads, torn, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total_reads, n, __ATOMIC_RELAXED);
+    kshim_close(filp);
+    return NULL;
+}
+
+static void run_torn(int nreaders, long writes)
+{
+    struct file *filp = open_mem(SHIM_MINOR);
+    unsigned char buf[PAGE_SIZE];
+    pthread_t th[64];
+    char retries[64] = "";
+    long w;
+    int i;
+
+    memset(buf, 0, sizeof(buf));
+    kshim_pwrite(filp, buf, sizeof(buf), 0);
+    for (i = 0; i < nreaders; i++) {
+        pthread_create(&th[i], NULL, torn_reader, NULL);
+    }
+    for (w = 0; w < writes; w++) {
+        memset(buf, (int)w, sizeof(buf));
+        if (kshim_pwrite(filp, buf, sizeof(buf), 0) != sizeof(buf)) {
+            fail("torn write", w, 0);
+        }
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < nreaders; i++) {
+        pthread_join(th[i], NULL);
+    }
+    stop = 0;
+    kshim_show(MKDEV(globalmem_major, SHIM_MINOR), "stats", "read_retries", retries);
+    printf("torn     %ld writes, %ld reads, %ld torn, read_retries %s", writes, total_reads, torn_reads,
+           retries[0] ? retries : "-\n");
+    if (torn_reads) {
+        fail("torn pages", torn_reads, total_reads);
+    }
+    kshim_close(filp);
+}
+
+/*
+ *线程i使用第i页，相邻的页属于不同的锁条带
+ */
+static void *scale_worker(void *arg)
+{
+    long id = (long)arg;
+    struct file *filp = open_mem(SHIM_MINOR);
+    unsigned char buf[512], out[512];
+    long n;
+
+    for (n = 0; n < ops_per_thread; n++) {
+        loff_t pos = id * PAGE_SIZE + (n % 8) * sizeof(buf);
+
+        memset(buf, (int)(id + n), sizeof(buf));
+        if (kshim_pwrite(filp, buf, sizeof(buf), pos) != sizeof(buf) ||
+            kshim_pread(filp, out, sizeof(out), pos) != sizeof(out)) {
+            fail("scale io", id, n);
+        }
+        if (memcmp(buf, out, sizeof(buf))) {
+            fail("scale data", id, n);
+        }
+    }
+    kshim_close(filp);
+    return NULL;
+}
+
+static void run_scale(int nthreads)
+{
+    pthread_t th[64];
+    u64 t0, t1;
+    long i;
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < nthreads; i++) {
+        pthread_create(&th[i], NULL, scale_worker, (void *)(i + 1));
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(th[i], NULL);
+    }
+    t1 = ktime_get_ns();
+    printf("scale    %d threads %10.0f ops/s\n", nthreads, 2.0 * ops_per_thread * nthreads / ((t1 - t0) / 1e9));
+}
+
+static void check_range(struct file *filp, const unsigned char *ref, size_t len, const char *what)
+{
+    unsigned char *buf = malloc(len);
+    size_t i;
+
+    if (kshim_pread(filp, buf, len, 0) != (ssize_t)len) {
+        fail(what, 0, 0);
+    }
+    for (i = 0; i < len; i++) {
+        if (buf[i] != ref[i]) {
+            fail(what, i, buf[i]);
+        }
+    }
+    free(buf);
+}
+
+static void run_range(void)
+{
+    struct file *filp = open_mem(1);
+    size_t len = 64 * 1024, i;
+    unsigned char *ref = calloc(1, len);
+    struct globalmem_range r;
+
+    memset(&r, 0, sizeof(r));
+    r.off = 1000;
+    r.len = 30000;
+    r.pattern_len = 3;
+    memcpy(r.pattern, "abc", 3);
+    if (kshim_ioctl(filp, GLOBALMEM_IOC_FILL, (unsigned long)&r) || r.done != r.len) {
+        fail("FILL", r.done, r.len);
+    }
+    for (i = 0; i < r.len; i++) {
+        ref[r.off + i] = "abc"[i % 3];
+    }
+    check_range(filp, ref, len, "FILL data");
+
+    memset(&r, 0, sizeof(r));
+    r.off = 1500;
+    r.src_off = 1000;
+    r.len = 20000;
+    r.src_minor = 1;
+    if (kshim_ioctl(filp, GLOBALMEM_IOC_COPY, (unsigned long)&r)) {
+        fail("COPY up", r.done, r.len);
+    }
+    memmove(ref + 1500, ref + 1000, 20000);
+    check_range(filp, ref, len, "COPY up data");
+
+    r.off = 900;
+    r.src_off = 5000;
+    if (kshim_ioctl(filp, GLOBALMEM_IOC_COPY, (unsigned long)&r)) {
+        fail("COPY down", r.done, r.len);
+    }
+    memmove(ref + 900, ref + 5000, 20000);
+    check_range(filp, ref, len, "COPY down data");
+
+    memset(&r, 0, sizeof(r));
+    r.len = len;
+    if (kshim_ioctl(filp, GLOBALMEM_IOC_CLEAR, (unsigned long)&r)) {
+        fail("CLEAR", r.done, r.len);
+    }
+    memset(ref, 0, len);
+    check_range(filp, ref, len, "CLEAR data");
+    printf("range    ok\n");
+    free(ref);
+    kshim_close(filp);
+}
+
+static void run_sparse(void)
+{
+    struct file *filp = open_mem(2);
+    unsigned char buf[8192];
+    char resident[64] = "-\n";
+    loff_t far = 3UL << 30;
+    size_t i;
+
+    memset(buf, 0x5a, 200);
+    if (kshim_pwrite(filp, buf, 200, far + 4000) != 200) {
+        fail("sparse write", far, 0);
+    }
+    if (kshim_llseek(filp, 0, SEEK_DATA) != far || kshim_llseek(filp, far, SEEK_HOLE) != far + 2 * PAGE_SIZE) {
+        fail("SEEK_DATA/SEEK_HOLE", kshim_llseek(filp, 0, SEEK_DATA), kshim_llseek(filp, far, SEEK_HOLE));
+    }
+    if (kshim_pread(filp, buf, sizeof(buf), far) != sizeof(buf)) {
+        fail("sparse read", far, 0);
+    }
+    for (i = 0; i < sizeof(buf); i++) {
+        if (buf[i] != ((i >= 4000 && i < 4200) ? 0x5a : 0)) {
+            fail("sparse data", i, buf[i]);
+        }
+    }
+    kshim_show(MKDEV(globalmem_major, 2), "stats", "resident_bytes", resident);
+    printf("sparse   ok, resident_bytes %s", resident);
+    kshim_close(filp);
+}
+
+int main(int argc, char *argv[])
+{
+    int nthreads = argc > 1 ? atoi(argv[1]) : 4;
+    long writes = argc > 2 ? atol(argv[2]) : 50000;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    nthreads = clamp_t(int, nthreads, 1, 64);
+    globalmem_size = 1UL << 32;
+    if (init_module()) {
+        fprintf(stderr, "init_module failed\n");
+        return 1;
+    }
+
+    run_torn(nthreads, writes);
+    run_scale(nthreads);
+    run_range();
+    run_sparse();
+
+    cleanup_module();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ *second用户态测试
+ *把驱动源文件与kshim一起编译，定时器由kshim的定时器线程驱动，用ASan/TSan版本检查定时器处理函数与读者之间的环形缓冲区。
+ *  events: 每个次设备一个读者线程，按记录读取，检查seq递增、时间戳不回退，统计跳号(错过的节拍)和溢出
+ *  shared: 两个线程读同一个打开的文件，各自读到的seq仍然递增
+ *  period: 两个线程在同一个打开的文件上交替设置不同周期，同时有一个读者，最终周期是其中之一且读者仍能读到记录
+ *  legacy: 按int读取计数；周期很长时非阻塞读返回EAGAIN、poll不报告可读；没有CAP_SYS_NICE时不能设置过短的周期
+ *最后输出各设备sysfs中的ticks/late/missed。
+ *
+ *用法: second_shim [次设备数] [周期(微秒)] [每个读者的节拍数]
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "../../second/src/second.c"
+
+#define BATCH           256
+
+struct reader {
+    struct file *filp;
+    long ticks;
+    u64 events;
+    u64 gaps;
+    pthread_t thread;
+};
+
+static void __attribute__((noreturn)) fail(const char *what, long a, long b)
+{
+    fprintf(stderr, "FAILED %s: %ld %ld\n", what, a, b);
+    exit(1);
+}
+
+static struct file *open_second(int minor, unsigned int flags, u64 period)
+{
+    struct file *filp = kshim_open(MKDEV(second_major, minor), flags);
+
+    if (IS_ERR(filp)) {
+        fail("open", minor, PTR_ERR(filp));
+    }
+    if (period && kshim_ioctl(filp, SECOND_IOC_SET_PERIOD, (unsigned long)&period)) {
+        fail("SET_PERIOD", minor, period);
+    }
+    return filp;
+}
+
+static void *event_reader(void *arg)
+{
+    struct reader *r = arg;
+    struct second_event ev[BATCH];
+    u64 last_seq = 0, last_ns = 0;
+    long n = 0;
+
+    while (n < r->ticks) {
+        ssize_t ret = kshim_read(r->filp, ev, sizeof(ev));
+        int i;
+
+        if (ret <= 0 || ret % sizeof(ev[0])) {
+            fail("read events", ret, n);
+        }
+        for (i = 0; i < ret / (ssize_t)sizeof(ev[0]); i++) {
+            if (r->events && (ev[i].seq <= last_seq || ev[i].ktime_ns < last_ns)) {
+                fail("event order", ev[i].seq, last_seq);
+            }
+            if (r->events && ev[i].seq != last_seq + 1) {
+                r->gaps += ev[i].seq - last_seq - 1;
+            }
+            last_seq = ev[i].seq;
+            last_ns = ev[i].ktime_ns;
+            r->events++;
+            n = last_seq;
+        }
+    }
+    return NULL;
+}
+
+static void run_events(int num, u64 period, long ticks)
+{
+    struct reader readers[SECOND_MAX_NUM];
+    u64 overrun, t0, t1;
+    u32 cpu;
+    int i;
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < num; i++) {
+        readers[i] = (struct reader){ open_second(i, O_RDONLY, period), ticks, 0, 0 };
+        if (kshim_ioctl(readers[i].filp, SECOND_IOC_GET_CPU, (unsigned long)&cpu) || cpu != (u32)(i % nr_cpu_ids)) {
+            fail("GET_CPU", i, cpu);
+        }
+        pthread_create(&readers[i].thread, NULL, event_reader, &readers[i]);
+    }
+    for (i = 0; i < num; i++) {
+        pthread_join(readers[i].thread, NULL);
+    }
+    t1 = ktime_get_ns();
+
+    for (i = 0; i < num; i++) {
+        kshim_ioctl(readers[i].filp, SECOND_IOC_GET_OVERRUN, (unsigned long)&overrun);
+        printf("events   second_%d: %llu events, %llu gaps, %llu overrun\n", i,
+               (unsigned long long)readers[i].events, (unsigned long long)readers[i].gaps,
+               (unsigned long long)overrun);
+        kshim_close(readers[i].filp);
+    }
+    printf("events   %d devices %10.0f events/s\n", num, (double)ticks * num / ((t1 - t0) / 1e9));
+}
+
+static void run_shared(u64 period, long ticks)
+{
+    struct reader readers[2];
+    struct file *filp = open_second(0, O_RDONLY, period);
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        readers[i] = (struct reader){ filp, ticks, 0, 0 };
+        pthread_create(&readers[i].thread, NULL, event_reader, &readers[i]);
+    }
+    for (i = 0; i < 2; i++) {
+        pthread_join(readers[i].thread, NULL);
+    }
+    printf("shared   %llu + %llu events\n", (unsigned long long)readers[0].events,
+           (unsigned long long)readers[1].events);
+    kshim_close(filp);
+}
+
+struct setter {
+    struct file *filp;
+    u64 period;
+    pthread_t thread;
+};
+
+static void *period_setter(void *arg)
+{
+    struct setter *s = arg;
+    int i;
+
+    for (i = 0; i < 200; i++) {
+        if (kshim_ioctl(s->filp, SECOND_IOC_SET_PERIOD, (unsigned long)&s->period)) {
+            fail("concurrent SET_PERIOD", i, s->period);
+        }
+    }
+    return NULL;
+}
+
+static void run_period(u64 period, long ticks)
+{
+    struct file *filp = open_second(0, O_RDONLY, period);
+    struct reader reader = { filp, ticks / 10, 0, 0 };
+    struct setter setters[2];
+    u64 cur;
+    int i;
+
+    pthread_create(&reader.thread, NULL, event_reader, &reader);
+    for (i = 0; i < 2; i++) {
+        setters[i] = (struct setter){ filp, period * (i + 1) };
+        pthread_create(&setters[i].thread, NULL, period_setter, &setters[i]);
+    }
+    for (i = 0; i < 2; i++) {
+        pthread_join(setters[i].thread, NULL);
+    }
+    pthread_join(reader.thread, NULL);
+    if (kshim_ioctl(filp, SECOND_IOC_GET_PERIOD, (unsigned long)&cur) ||
+        (cur != setters[0].period && cur != setters[1].period)) {
+        fail("period after concurrent SET_PERIOD", cur, period);
+    }
+    kshim_close(filp);
+    printf("period   ok, %llu events\n", (unsigned long long)reader.events);
+}
+
+static void run_legacy(u64 period)
+{
+    struct file *filp = open_second(0, O_RDONLY, period);
+    int counter, old = -1, i;
+    ssize_t ret;
+
+    for (i = 0; i < 10; i++) {
+        if (kshim_read(filp, &counter, sizeof(counter)) != sizeof(counter) || counter <= old) {
+            fail("legacy read", counter, old);
+        }
+        old = counter;
+    }
+    kshim_close(filp);
+
+    filp = open_second(0, O_RDONLY | O_NONBLOCK, 0);
+    ret = kshim_read(filp, &counter, sizeof(counter));
+    if (-EAGAIN != ret || (kshim_poll(filp) & POLLIN)) {
+        fail("nonblock read", ret, kshim_poll(filp));
+    }
+
+    /*没有CAP_SYS_NICE时不能设置短于second_min_period_ns的周期*/
+    kshim_caps &= ~(1ULL << CAP_SYS_NICE);
+    period = second_min_period_ns - 1;
+    ret = kshim_ioctl(filp, SECOND_IOC_SET_PERIOD, (unsigned long)&period);
+    if (-EPERM != ret) {
+        fail("short period without CAP_SYS_NICE", ret, period);
+    }
+    period = second_min_period_ns;
+    if (kshim_ioctl(filp, SECOND_IOC_SET_PERIOD, (unsigned long)&period)) {
+        fail("min period without CAP_SYS_NICE", 0, period);
+    }
+    kshim_caps |= 1ULL << CAP_SYS_NICE;
+    kshim_close(filp);
+    printf("legacy   ok, counter %d\n", old);
+}
+
+int main(int argc, char *argv[])
+{
+    int num = argc > 1 ? atoi(argv[1]) : 4;
+    u64 period = (argc > 2 ? atol(argv[2]) : 100) * NSEC_PER_USEC;
+    long ticks = argc > 3 ? atol(argv[3]) : 10000;
+    const char *stats[] = { "ticks", "late", "missed", "max_late_ns" };
+    char buf[64];
+    unsigned int j;
+    int i;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    second_num = clamp_t(int, num, 1, SECOND_MAX_NUM);
+    if (init_module()) {
+        fprintf(stderr, "init_module failed\n");
+        return 1;
+    }
+
+    run_events(second_num, period, ticks);
+    run_shared(period, ticks);
+    run_period(period, ticks);
+    run_legacy(period);
+
+    for (i = 0; i < second_num; i++) {
+        printf("second_%d", i);
+        for (j = 0; j < ARRAY_SIZE(stats); j++) {
+            if (kshim_show(MKDEV(second_major, i), "stats", stats[j], buf) > 0) {
+                buf[strcspn(buf, "\n")] = '\0';
+                printf(" %s %s", stats[j], buf);
+            }
+        }
+        printf("\n");
+    }
+    cleanup_module();
+    printf("ok\n");
+    return 0;
+}
@@ -4,61 +4,341 @@
 #include <linux/init.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
 #include <linux/uaccess.h>
 #include <linux/device.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/sched/signal.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+
+#include "second.h"
 
 #define SECOND_MAJOR        0
+#define SECOND_RING_SIZE    4096    /*每个打开者缓存的事件记录数*/
+#define SECOND_RING_MAX     (1 << 20)
+#define SECOND_MAX_NUM      256     /*次设备数目上限*/
 ;
 static int second_major = SECOND_MAJOR;
 module_param(second_major, int, S_IRUGO);
 
+static int second_num = 1;
+module_param(second_num, int, S_IRUGO);     /*次设备数目，设备文件为/dev/second、/dev/second_1 ~ /dev/second_<n-1>*/
+
+static unsigned long second_min_period_ns = 100000;
+module_param(second_min_period_ns, ulong, S_IRUGO | S_IWUSR);  /*没有CAP_SYS_NICE的调用者能设置的最短周期(纳秒)*/
+
+static unsigned int second_late_ns = 50000;
+module_param(second_late_ns, uint, S_IRUGO | S_IWUSR);  /*处理函数晚于到期时刻超过该值(纳秒)时计为迟到*/
+
+static int second_cpus[SECOND_MAX_NUM];
+static int second_ncpus;
+module_param_array(second_cpus, int, &second_ncpus, S_IRUGO);  /*次设备i的定时器所在的CPU，未指定时为i % nr_cpu_ids*/
+
+static unsigned int second_ring_size = SECOND_RING_SIZE;
+module_param(second_ring_size, uint, S_IRUGO);  /*事件缓冲区的记录数，向上取整为2的幂*/
+
+/*
+ *定时统计，该设备上所有打开者的定时器合计，通过sysfs导出
+ */
+struct second_stats {
+    atomic64_t ticks;                   /*处理函数运行次数*/
+    atomic64_t late;                    /*运行时晚于到期时刻超过second_late_ns的次数*/
+    atomic64_t missed;                  /*处理函数来不及运行而跳过的节拍数*/
+    atomic64_t max_late_ns;             /*运行时晚于到期时刻的最大值*/
+};
+
 struct second_dev {
     struct cdev cdev;
+    int cpu;                            /*该设备上所有定时器都固定在这个CPU上到期*/
+    struct second_stats stats;
+};
+
+static struct second_dev *second_devp;  /*second_num个设备组成的数组*/
+
+/*
+ *每次打开的状态: 每个打开者有自己的高精度定时器、周期和计数，互不干扰
+ *事件记录放在单生产者单消费者的无锁环中: 定时器处理函数是唯一的生产者，只写head；
+ *读者在read_lock保护下作为唯一的消费者，只写tail。head、tail自由增长，用size - 1取模。
+ *环非空即表示上次读取之后定时器到期过，read在环为空时阻塞，poll据此判断是否可读
+ */
+struct second_file {
+    struct hrtimer timer;
+    ktime_t period;
+    struct second_dev *dev;
     atomic_t counter;
-    struct timer_list s_timer;
+    u64 seq;                            /*只在定时器处理函数中修改*/
+    u64 overrun;                        /*丢弃的记录数，只在定时器处理函数中修改*/
+    struct second_event *ring;
+    unsigned int size;
+    unsigned int head ____cacheline_aligned_in_smp;
+    unsigned int tail ____cacheline_aligned_in_smp;
+    struct mutex read_lock;             /*串行化同一文件上的多个读者*/
+    struct mutex period_lock;           /*串行化SET_PERIOD的停止、修改与重新启动*/
+    wait_queue_head_t wait;
+    struct fasync_struct *async_queue;  /*异步通知*/
 };
 
-static struct second_dev *second_devp;
+/*
+ *放入一条事件记录，只在定时器处理函数中调用；环满时丢弃并计入溢出
+ */
+static void second_push_event(struct second_file *sf, ktime_t now)
+{
+    unsigned int head = sf->head;
+    struct second_event *ev;
 
-static void second_timer_handler(unsigned long arg)
+    if (head - smp_load_acquire(&sf->tail) >= sf->size) {
+        sf->overrun++;
+        return;
+    }
+    ev = &sf->ring[head & (sf->size - 1)];
+    ev->seq = sf->seq;
+    ev->ktime_ns = ktime_to_ns(now);
+    smp_store_release(&sf->head, head + 1);     /*记录写完后才对读者可见*/
+}
+
+static bool second_ring_empty(struct second_file *sf)
+{
+    return smp_load_acquire(&sf->head) == READ_ONCE(sf->tail);
+}
+
+static void second_account(struct second_stats *stats, s64 late, u64 ticks)
 {
-    mod_timer(&second_devp->s_timer, jiffies + HZ);
-    atomic_inc(&second_devp->counter);
+    s64 max = atomic64_read(&stats->max_late_ns);
+
+    atomic64_inc(&stats->ticks);
+    if (ticks > 1) {
+        atomic64_add(ticks - 1, &stats->missed);
+    }
+    if (late > second_late_ns) {
+        atomic64_inc(&stats->late);
+    }
+    while (late > max) {
+        s64 old = atomic64_cmpxchg(&stats->max_late_ns, max, late);
 
-    printk(KERN_INFO "current jiffies is %ld\n", jiffies);
+        if (old == max) {
+            break;
+        }
+        max = old;
+    }
+}
+
+/*
+ *定时器到期，在中断上下文中执行，只做计数、记录事件和统计，不打印(微秒级周期下printk会占满CPU)
+ *下一次到期时刻由hrtimer_forward在上一次到期时刻的基础上前移整数个周期得到，始终是启动时刻加整数倍周期，
+ *处理函数运行得晚不会使后续节拍累积漂移。处理函数晚了不止一个周期时，前移的周期数大于1，
+ *错过的节拍同样计入计数和seq(seq因此跳号)，使seq * 周期与时间保持对应
+ */
+static enum hrtimer_restart second_timer_handler(struct hrtimer *timer)
+{
+    struct second_file *sf = container_of(timer, struct second_file, timer);
+    ktime_t now = ktime_get();
+    s64 late = ktime_to_ns(ktime_sub(now, hrtimer_get_expires(timer)));
+    u64 ticks;
+
+    ticks = hrtimer_forward(timer, now, READ_ONCE(sf->period));
+    atomic_add(ticks, &sf->counter);
+    sf->seq += ticks;
+    second_push_event(sf, now);
+    second_account(&sf->dev->stats, late, ticks);
+
+    /*没有等待者时跳过唤醒，与read/poll中的内存屏障配对*/
+    if (wq_has_sleeper(&sf->wait)) {
+        wake_up_interruptible(&sf->wait);
+    }
+    kill_fasync(&sf->async_queue, SIGIO, POLL_IN);
+
+    return HRTIMER_RESTART;
+}
+
+static void second_start_local(void *info)
+{
+    struct second_file *sf = info;
+
+    hrtimer_start(&sf->timer, READ_ONCE(sf->period), HRTIMER_MODE_REL_PINNED);
+}
+
+/*
+ *在设备指定的CPU上启动定时器: PINNED模式的定时器加入调用者所在CPU的队列，
+ *之后的每次到期和重新装载都留在该CPU上，因此通过IPI到目标CPU上启动。CPU不在线时返回ENXIO
+ */
+static int second_start_timer(struct second_file *sf)
+{
+    return smp_call_function_single(sf->dev->cpu, second_start_local, sf, 1);
 }
 
 static int second_open(struct inode *inode, struct file *filp)
 {
-    init_timer(&second_devp->s_timer);
+    struct second_dev *dev = container_of(inode->i_cdev, struct second_dev, cdev);
+    struct second_file *sf;
+    int ret;
 
-    second_devp->s_timer.function = &second_timer_handler;
-    second_devp->s_timer.expires = jiffies + HZ;
+    sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+    if (NULL == sf) {
+        return -ENOMEM;
+    }
+    sf->size = second_ring_size;
+    sf->ring = kvmalloc_array(sf->size, sizeof(*sf->ring), GFP_KERNEL);
+    if (NULL == sf->ring) {
+        kfree(sf);
+        return -ENOMEM;
+    }
 
-    add_timer(&second_devp->s_timer);
+    sf->period = ns_to_ktime(SECOND_DEFAULT_PERIOD_NS);
+    sf->dev = dev;
+    atomic_set(&sf->counter, 0);
+    mutex_init(&sf->read_lock);
+    mutex_init(&sf->period_lock);
+    init_waitqueue_head(&sf->wait);
+    hrtimer_init(&sf->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+    sf->timer.function = second_timer_handler;
+    filp->private_data = sf;
 
-    atomic_set(&second_devp->counter, 0);
+    ret = second_start_timer(sf);
+    if (ret) {
+        kvfree(sf->ring);
+        kfree(sf);
+    }
 
-    return 0;
+    return ret;
+}
+
+static int second_fasync(int fd, struct file *filp, int mode)
+{
+    struct second_file *sf = filp->private_data;
+
+    return fasync_helper(fd, filp, mode, &sf->async_queue);
 }
 
 static int second_release(struct inode *inode, struct file *filp)
 {
-    del_timer(&second_devp->s_timer);
+    struct second_file *sf = filp->private_data;
+
+    hrtimer_cancel(&sf->timer);
+    second_fasync(-1, filp, 0);
+    kvfree(sf->ring);
+    kfree(sf);
 
     return 0;
 }
 
+/*
+ *读取事件: 环为空时阻塞到下一次定时器到期(O_NONBLOCK时返回EAGAIN)，不再需要用户态忙等。
+ *缓冲区能放下至少一条记录时一次取走尽可能多的记录；否则按旧接口返回int计数并清空环
+ */
 static ssize_t second_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 {
-    int counter;
+    struct second_file *sf = filp->private_data;
+    unsigned int head, tail, n, idx, first;
+    ssize_t ret;
 
-    counter = atomic_read(&second_devp->counter);
-    if (put_user(counter, (int *)buf)) { //复制counter到用户空间
-        return -EFAULT;
-    } else {
-        return sizeof(unsigned int);
+    for (;;) {
+        if (mutex_lock_interruptible(&sf->read_lock)) {
+            return -ERESTARTSYS;
+        }
+        if (!second_ring_empty(sf)) {
+            break;
+        }
+        mutex_unlock(&sf->read_lock);
+
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(sf->wait, !second_ring_empty(sf))) {
+            return -ERESTARTSYS;
+        }
     }
+
+    head = smp_load_acquire(&sf->head);
+    tail = sf->tail;
+    if (count < sizeof(struct second_event)) {
+        if (put_user(atomic_read(&sf->counter), (int __user *)buf)) { //复制counter到用户空间
+            ret = -EFAULT;
+        } else {
+            tail = head;
+            ret = sizeof(unsigned int);
+        }
+        goto out;
+    }
+
+    /*环中的记录在tail前移之前不会被生产者覆盖，可以直接复制，回绕时分两段*/
+    n = min_t(size_t, head - tail, count / sizeof(struct second_event));
+    idx = tail & (sf->size - 1);
+    first = min(n, sf->size - idx);
+    if (copy_to_user(buf, &sf->ring[idx], first * sizeof(struct second_event)) ||
+        copy_to_user(buf + first * sizeof(struct second_event), sf->ring,
+                     (n - first) * sizeof(struct second_event))) {
+        ret = -EFAULT;
+        goto out;
+    }
+    tail += n;
+    ret = n * sizeof(struct second_event);
+
+out:
+    smp_store_release(&sf->tail, tail);     /*记录复制完后才允许生产者复用这些位置*/
+    mutex_unlock(&sf->read_lock);
+    return ret;
+}
+
+static __poll_t second_poll(struct file *filp, poll_table *wait)
+{
+    struct second_file *sf = filp->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(filp, &sf->wait, wait);
+    smp_mb();   /*与定时器处理函数中wq_has_sleeper()的内存屏障配对，避免丢失唤醒*/
+    if (!second_ring_empty(sf)) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+
+    return mask;
+}
+
+static long second_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct second_file *sf = filp->private_data;
+    u64 period;
+    int ret;
+
+    switch (cmd) {
+    case SECOND_IOC_SET_PERIOD:
+        if (get_user(period, (u64 __user *)arg)) {
+            return -EFAULT;
+        }
+        if (period < SECOND_MIN_PERIOD_NS) {
+            return -EINVAL;
+        }
+        if (period < READ_ONCE(second_min_period_ns) && !capable(CAP_SYS_NICE)) {
+            return -EPERM;
+        }
+        /*
+         *先停下定时器再修改周期，处理函数不会看到修改了一半的状态；计数保持不变。
+         *共享同一文件的两个线程并发设置时，若不串行化，一方的重新启动可能落在另一方的
+         *停止与修改之间，定时器会以旧周期继续运行
+         */
+        if (mutex_lock_interruptible(&sf->period_lock)) {
+            return -ERESTARTSYS;
+        }
+        hrtimer_cancel(&sf->timer);
+        WRITE_ONCE(sf->period, ns_to_ktime(period));
+        ret = second_start_timer(sf);
+        mutex_unlock(&sf->period_lock);
+        return ret;
+    case SECOND_IOC_GET_PERIOD:
+        return put_user((u64)ktime_to_ns(READ_ONCE(sf->period)), (u64 __user *)arg);
+    case SECOND_IOC_GET_OVERRUN:
+        return put_user(READ_ONCE(sf->overrun), (u64 __user *)arg);
+    case SECOND_IOC_GET_CPU:
+        return put_user((__u32)sf->dev->cpu, (__u32 __user *)arg);
+    default:
+        return -EINVAL;
+    }
+
+    return 0;
 }
 
 static const struct file_operations second_fops = {
@@ -66,6 +346,44 @@ static const struct file_operations second_fops = {
     .open       = second_open,
     .release    = second_release,
     .read       = second_read,
+    .poll       = second_poll,
+    .fasync     = second_fasync,
+    .unlocked_ioctl = second_ioctl,
+};
+
+/*
+ *定时统计通过sysfs导出: /sys/class/second_class/second(次设备0)或second_<n>/stats/下每个计数一个文件
+ */
+#define SECOND_STAT_ATTR(_name)                                                                     \
+static ssize_t _name##_show(struct device *d, struct device_attribute *attr, char *buf)            \
+{                                                                                                   \
+    struct second_dev *dev = dev_get_drvdata(d);                                                    \
+                                                                                                    \
+    return sprintf(buf, "%lld\n", (long long)atomic64_read(&dev->stats._name));                     \
+}                                                                                                   \
+static DEVICE_ATTR_RO(_name)
+
+SECOND_STAT_ATTR(ticks);
+SECOND_STAT_ATTR(late);
+SECOND_STAT_ATTR(missed);
+SECOND_STAT_ATTR(max_late_ns);
+
+static struct attribute *second_stats_attrs[] = {
+    &dev_attr_ticks.attr,
+    &dev_attr_late.attr,
+    &dev_attr_missed.attr,
+    &dev_attr_max_late_ns.attr,
+    NULL,
+};
+
+static const struct attribute_group second_stats_group = {
+    .name   = "stats",
+    .attrs  = second_stats_attrs,
+};
+
+static const struct attribute_group *second_groups[] = {
+    &second_stats_group,
+    NULL,
 };
 
 static void second_setup_cdev(struct second_dev *dev, int index)
@@ -76,25 +394,45 @@ static void second_setup_cdev(struct second_dev *dev, int index)
     dev->cdev.owner = THIS_MODULE;
     err = cdev_add(&dev->cdev, devno, 1);
     if (err) {
-        printk(KERN_ERR "Failed to add second device\n");
+        printk(KERN_ERR "Failed to add second device %d\n", index);
     }
 }
 
 static struct class *second_class;
 static int __init second_init(void)
 {
-    int ret;
+    int ret, i;
     struct device *second_device = NULL;
     dev_t devno = MKDEV(second_major, 0);
 
+    if (second_ring_size < 2 || second_ring_size > SECOND_RING_MAX) {
+        return -EINVAL;
+    }
+    second_ring_size = roundup_pow_of_two(second_ring_size);
+    if (second_num < 1 || second_num > SECOND_MAX_NUM || second_ncpus > second_num) {
+        return -EINVAL;
+    }
+
+    second_devp = kcalloc(second_num, sizeof(*second_devp), GFP_KERNEL);
+    if (NULL == second_devp) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < second_num; i++) {
+        second_devp[i].cpu = i < second_ncpus ? second_cpus[i] : i % nr_cpu_ids;
+        if (second_devp[i].cpu < 0 || second_devp[i].cpu >= nr_cpu_ids || !cpu_possible(second_devp[i].cpu)) {
+            ret = -EINVAL;
+            goto fail_region;
+        }
+    }
+
     if (second_major) {
-        ret = register_chrdev_region(devno, 1, "second");
+        ret = register_chrdev_region(devno, second_num, "second");
     } else {
-        ret = alloc_chrdev_region(&devno, 0, 1, "second");
+        ret = alloc_chrdev_region(&devno, 0, second_num, "second");
         second_major = MAJOR(devno);
     }
     if (ret < 0) {
-        return ret;
+        goto fail_region;
     }
 
     second_class = class_create(THIS_MODULE, "second_class");
@@ -103,40 +441,49 @@ static int __init second_init(void)
         goto fail_class;
     }
 
-    second_device = device_create(second_class, NULL, MKDEV(second_major, 0), NULL, "second");
-    if (IS_ERR(second_device)) {
-        ret = PTR_ERR(second_device);
-        goto fail_device;
-    }
-    
-    second_devp = kzalloc(sizeof(*second_devp), GFP_KERNEL);
-    if (NULL == second_devp) {
-        ret = -ENOMEM;
-        goto fail_malloc;
+    /*次设备0沿用原来的设备文件名/dev/second，只有新增的次设备带编号*/
+    for (i = 0; i < second_num; i++) {
+        second_device = device_create_with_groups(second_class, NULL, MKDEV(second_major, i), &second_devp[i],
+                                                  second_groups, i ? "second_%d" : "second", i);
+        if (IS_ERR(second_device)) {
+            ret = PTR_ERR(second_device);
+            goto fail_device;
+        }
     }
 
-    second_setup_cdev(second_devp, 0);
+    for (i = 0; i < second_num; i++) {
+        second_setup_cdev(&second_devp[i], i);
+    }
 
     return 0;
 
-fail_malloc:
-    device_destroy(second_class, MKDEV(second_major, 0));
 fail_device:
+    while (i--) {
+        device_destroy(second_class, MKDEV(second_major, i));
+    }
     class_destroy(second_class);
 fail_class:
-    unregister_chrdev_region(devno, 1);
+    unregister_chrdev_region(devno, second_num);
+fail_region:
+    kfree(second_devp);
     return ret;
 }
 module_init(second_init);
 
 static void __exit second_exit(void)
 {
-    cdev_del(&second_devp->cdev);
-    kfree(second_devp);
-    unregister_chrdev_region(MKDEV(second_major, 0), 1);
+    int i;
 
-    device_destroy(second_class, MKDEV(second_major, 0));
+    for (i = 0; i < second_num; i++) {
+        cdev_del(&second_devp[i].cdev);
+    }
+    for (i = 0; i < second_num; i++) {
+        device_destroy(second_class, MKDEV(second_major, i));
+    }
     class_destroy(second_class);
+
+    kfree(second_devp);
+    unregister_chrdev_region(MKDEV(second_major, 0), second_num);
 }
 module_exit(second_exit);
 
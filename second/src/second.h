@@ -0,0 +1,51 @@
+/*
+ * second ioctl definitions, shared by the driver and user space programs
+ *
+ * Licensed under GPLv2 or later
+ */
+
+#ifndef _SECOND_H
+#define _SECOND_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define SECOND_IOC_MAGIC        's'
+
+#define SECOND_MIN_PERIOD_NS    1000ULL         /*定时周期下限，1微秒，需要CAP_SYS_NICE，见SET_PERIOD*/
+#define SECOND_DEFAULT_PERIOD_NS 1000000000ULL  /*默认定时周期，1秒*/
+
+/*
+ *定时周期(纳秒，对当前打开的文件生效)
+ *每个打开者有独立的高精度定时器和计数，互不影响
+ *SET_PERIOD: 参数为__u64周期，小于SECOND_MIN_PERIOD_NS时返回EINVAL；设置后定时器从当前时刻重新开始计时。
+ *            每个打开者都可以有自己的定时器，为避免普通用户打开多次、每个都设成极短的周期造成中断风暴，
+ *            小于模块参数second_min_period_ns(默认100微秒)的周期只允许具有CAP_SYS_NICE的调用者设置，
+ *            否则返回EPERM
+ *GET_PERIOD: 返回当前周期
+ */
+#define SECOND_IOC_SET_PERIOD   _IOW(SECOND_IOC_MAGIC, 1, __u64)
+#define SECOND_IOC_GET_PERIOD   _IOR(SECOND_IOC_MAGIC, 2, __u64)
+
+/*
+ *定时器事件记录
+ *每次定时器到期都向该打开者的环形缓冲区放入一条记录，read的缓冲区不小于一条记录时按记录读取，
+ *一次read取走尽可能多的完整记录；缓冲区小于一条记录时仍按旧接口返回int计数，并丢弃已缓存的记录。
+ *缓冲区满时新记录被丢弃并计入溢出计数，seq随之跳号
+ */
+struct second_event {
+    __u64 seq;                  /*节拍序号，设置周期不会重置；处理函数错过的节拍同样计入，seq会因此跳号*/
+    __u64 ktime_ns;             /*定时器处理函数运行时的CLOCK_MONOTONIC时间(纳秒)*/
+};
+
+/*
+ *GET_OVERRUN: 返回因缓冲区满而丢弃的记录数
+ */
+#define SECOND_IOC_GET_OVERRUN  _IOR(SECOND_IOC_MAGIC, 3, __u64)
+
+/*
+ *GET_CPU: 返回该设备定时器所在的CPU(由模块参数second_cpus指定)
+ */
+#define SECOND_IOC_GET_CPU      _IOR(SECOND_IOC_MAGIC, 4, __u32)
+
+#endif /* _SECOND_H */
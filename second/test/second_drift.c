@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include "../src/second.h"
+
+/*
+ *second长时间漂移测试
+ *以给定周期运行定时器直到seq前进指定的节拍数(默认100万)，读取事件记录，以第一条记录为起点，
+ *第k个节拍的理论时刻为起点时间戳 + (seq - 起点seq) * 周期，计算:
+ *  漂移: 最后一条记录的时间戳与其理论时刻之差，到期时刻按绝对时间前移时不随节拍数增长
+ *  每10万节拍输出一次当时的漂移，以及这一段内各记录相对理论时刻的最小、最大偏差
+ *并输出测试期间sysfs中该设备迟到、错过节拍计数的增量。
+ *
+ *用法: second_drift [设备文件] [节拍数] [周期(纳秒)]
+ */
+
+#define BATCH   1024
+#define STEP    100000
+
+static long long read_stat(const char *dev, const char *name)
+{
+    char path[128];
+    long long val = -1;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/sys/class/second_class/%s/stats/%s", dev, name);
+    fp = fopen(path, "r");
+    if (fp) {
+        if (1 != fscanf(fp, "%lld", &val)) {
+            val = -1;
+        }
+        fclose(fp);
+    }
+    return val;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/second";
+    uint64_t ticks = argc > 2 ? strtoull(argv[2], NULL, 0) : 1000000;
+    uint64_t period = argc > 3 ? strtoull(argv[3], NULL, 0) : 100000;
+    const char *stats[] = { "ticks", "late", "missed", "max_late_ns" };
+    long long before[4], after[4];
+    struct second_event ev[BATCH], first = { 0, 0 }, last = { 0, 0 };
+    int64_t dmin = INT64_MAX, dmax = INT64_MIN;
+    uint64_t next = STEP, overrun = 0;
+    char *dev = strdup(path);
+    int fd, i;
+
+    dev = basename(dev);
+    fd = open(path, O_RDONLY);
+    if (-1 == fd) {
+        printf("Device open failure.\n");
+        return 1;
+    }
+    for (i = 0; i < 4; i++) {
+        before[i] = read_stat(dev, stats[i]);
+    }
+    if (ioctl(fd, SECOND_IOC_SET_PERIOD, &period)) {
+        perror("SECOND_IOC_SET_PERIOD");
+        return 1;
+    }
+
+    printf("second drift on %s, period %llu ns, %llu ticks (%.1f s)\n", path, (unsigned long long)period,
+           (unsigned long long)ticks, ticks * period / 1e9);
+    printf("%10s %12s %12s %12s\n", "ticks", "drift(ns)", "min(ns)", "max(ns)");
+    while (!first.seq || last.seq - first.seq < ticks) {
+        ssize_t ret = read(fd, ev, sizeof(ev));
+        long n;
+
+        if (ret <= 0) {
+            perror("read");
+            return 1;
+        }
+        for (n = 0; n < ret / (long)sizeof(ev[0]); n++) {
+            int64_t d;
+
+            if (!first.seq) {
+                first = ev[n];
+            }
+            last = ev[n];
+            d = (int64_t)(last.ktime_ns - first.ktime_ns) - (int64_t)((last.seq - first.seq) * period);
+            dmin = d < dmin ? d : dmin;
+            dmax = d > dmax ? d : dmax;
+            if (last.seq - first.seq >= next) {
+                printf("%10llu %12lld %12lld %12lld\n", (unsigned long long)(last.seq - first.seq), (long long)d,
+                       (long long)dmin, (long long)dmax);
+                dmin = INT64_MAX;
+                dmax = INT64_MIN;
+                next += STEP;
+            }
+        }
+    }
+
+    ioctl(fd, SECOND_IOC_GET_OVERRUN, &overrun);
+    for (i = 0; i < 4; i++) {
+        after[i] = read_stat(dev, stats[i]);
+    }
+    close(fd);
+
+    printf("total drift after %llu ticks: %lld ns\n", (unsigned long long)(last.seq - first.seq),
+           (long long)(last.ktime_ns - first.ktime_ns) - (long long)((last.seq - first.seq) * period));
+    printf("ring overrun %llu\n", (unsigned long long)overrun);
+    for (i = 0; i < 3; i++) {
+        printf("%s +%lld\n", stats[i], before[i] < 0 || after[i] < 0 ? -1 : after[i] - before[i]);
+    }
+    printf("%s %lld\n", stats[3], after[3]);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include "../src/second.h"
+
+/*
+ *second事件流测试
+ *以10kHz(周期100us)运行定时器，阻塞read批量读取事件记录，检查:
+ *  驱动报告的溢出计数为0，即没有记录因缓冲区满而丢弃
+ *  seq跳号的总数(丢弃的记录和处理函数来不及运行而错过的节拍都会使seq跳号)
+ *并输出每次read平均取到的记录数，以及内核时间戳相邻间隔与周期之差的最小、最大值(纳秒)。
+ *有记录丢弃时返回1。
+ *
+ *用法: second_events [设备文件] [秒数] [周期(纳秒)]
+ */
+
+#define BATCH   1024
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/second";
+    double seconds = argc > 2 ? atof(argv[2]) : 10.0;
+    uint64_t period = argc > 3 ? strtoull(argv[3], NULL, 0) : 100000;
+    struct second_event ev[BATCH];
+    uint64_t expect = 0, last = 0, events = 0, reads = 0, gaps = 0, overrun = 0;
+    int64_t dmin = INT64_MAX, dmax = INT64_MIN;
+    uint64_t want;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (-1 == fd) {
+        printf("Device open failure.\n");
+        return 1;
+    }
+    if (ioctl(fd, SECOND_IOC_SET_PERIOD, &period)) {
+        perror("SECOND_IOC_SET_PERIOD");
+        return 1;
+    }
+
+    want = seconds * 1e9 / period;
+    while (events < want) {
+        ssize_t ret = read(fd, ev, sizeof(ev));
+        long i, n;
+
+        if (ret <= 0 || ret % sizeof(ev[0])) {
+            perror("read");
+            return 1;
+        }
+        n = ret / sizeof(ev[0]);
+        for (i = 0; i < n; i++) {
+            if (expect && ev[i].seq != expect) {
+                gaps += ev[i].seq - expect;
+            }
+            if (last) {
+                int64_t d = (int64_t)(ev[i].ktime_ns - last) - (int64_t)period;
+
+                dmin = d < dmin ? d : dmin;
+                dmax = d > dmax ? d : dmax;
+            }
+            expect = ev[i].seq + 1;
+            last = ev[i].ktime_ns;
+        }
+        events += n;
+        reads++;
+    }
+
+    if (ioctl(fd, SECOND_IOC_GET_OVERRUN, &overrun)) {
+        perror("SECOND_IOC_GET_OVERRUN");
+        return 1;
+    }
+    close(fd);
+
+    printf("period %llu ns, %llu events in %llu reads (%.1f per read)\n", (unsigned long long)period,
+           (unsigned long long)events, (unsigned long long)reads, (double)events / reads);
+    printf("interval - period (ns): min %lld max %lld\n", (long long)dmin, (long long)dmax);
+    printf("seq gaps %llu, overrun %llu: %s\n", (unsigned long long)gaps, (unsigned long long)overrun,
+           overrun ? "FAIL" : "ok");
+
+    return overrun ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include "../src/second.h"
+
+/*
+ *second定时周期误差测试
+ *依次把周期设为1ms、100us、10us，循环read计数(计数不变时read阻塞)，在计数变化时记录CLOCK_MONOTONIC时间戳，
+ *相邻两次变化的间隔减去周期即为周期误差，输出误差的分布(纳秒)以及漏掉的节拍数(一次变化超过1)。
+ *测到的是用户态观察到的误差，包含进程被唤醒的延迟；建议绑定到空闲的CPU上运行。
+ *短于模块参数second_min_period_ns的周期需要CAP_SYS_NICE，没有该权限时跳过这些周期并给出提示。
+ *
+ *用法: second_jitter [设备文件] [每个周期的节拍数] [绑定的CPU，-1表示不绑定]
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*返回0表示测量完成，1表示没有权限设置该周期而跳过，-1表示出错*/
+static int measure(int fd, uint64_t period, long ticks)
+{
+    int64_t *err = malloc(ticks * sizeof(*err));
+    long n = 0, missed = 0;
+    int counter, old;
+    long i;
+    uint64_t last = 0;
+    double sum = 0, sq = 0, mean;
+
+    if (ioctl(fd, SECOND_IOC_SET_PERIOD, &period)) {
+        if (EPERM == errno) {
+            printf("%10llu skipped: needs CAP_SYS_NICE (below second_min_period_ns)\n",
+                   (unsigned long long)period);
+            free(err);
+            return 1;
+        }
+        perror("SECOND_IOC_SET_PERIOD");
+        free(err);
+        return -1;
+    }
+
+    if (read(fd, &old, sizeof(old)) != sizeof(old)) {
+        perror("read");
+        free(err);
+        return -1;
+    }
+    /*第一次变化只作为起点*/
+    while (n < ticks) {
+        uint64_t t;
+
+        if (read(fd, &counter, sizeof(counter)) != sizeof(counter)) {
+            perror("read");
+            break;
+        }
+        if (counter == old) {
+            continue;
+        }
+        t = now_ns();
+        if (last) {
+            missed += counter - old - 1;
+            err[n++] = (int64_t)(t - last) - (int64_t)(period * (counter - old));
+        }
+        last = t;
+        old = counter;
+    }
+
+    if (0 == n) {
+        free(err);
+        return -1;
+    }
+    qsort(err, n, sizeof(err[0]), cmp_i64);
+    for (i = 0; i < n; i++) {
+        sum += err[i];
+        sq += (double)err[i] * err[i];
+    }
+    mean = n ? sum / n : 0;
+    printf("%10llu %8ld %10lld %10lld %10lld %10lld %10lld %10.0f %8ld\n", (unsigned long long)period, n,
+           (long long)err[0], (long long)err[n / 100], (long long)err[n / 2], (long long)err[n * 99 / 100],
+           (long long)err[n - 1], sqrt(sq / n - mean * mean), missed);
+    free(err);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/second";
+    long ticks = argc > 2 ? atol(argv[2]) : 10000;
+    int cpu = argc > 3 ? atoi(argv[3]) : -1;
+    uint64_t periods[] = { 1000000, 100000, 10000 };
+    unsigned int i;
+    int fd;
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    fd = open(path, O_RDONLY);
+    if (-1 == fd) {
+        printf("Device open failure.\n");
+        return 1;
+    }
+
+    printf("second period error (interval - period, ns), %ld ticks per period\n", ticks);
+    printf("%10s %8s %10s %10s %10s %10s %10s %10s %8s\n", "period", "ticks", "min", "p1", "p50", "p99", "max",
+           "stddev", "missed");
+    for (i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+        if (measure(fd, periods[i], ticks) < 0) {
+            return 1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include "../src/second.h"
+
+/*
+ *second每CPU定时器抖动测试
+ *依次打开/dev/second、/dev/second_1……直到打开失败，用GET_CPU查询每个设备定时器所在的CPU，
+ *为每个设备起一个绑定在该CPU上的读者线程，同时运行，批量读取事件记录，统计:
+ *  唤醒延迟: read返回时刻减去最后一条记录的内核时间戳，即定时器到期到读者开始运行的时间
+ *  周期误差: 相邻记录内核时间戳之差与周期之差的绝对值，反映定时器中断本身的抖动
+ *按CPU输出两者的对数直方图(单位微秒，每列为[下限, 2*下限)，最后一列为以上全部)。
+ *加载模块时用second_num=<CPU数>创建设备，默认次设备i在CPU i上。
+ *
+ *用法: second_percpu [周期(纳秒)] [秒数]
+ */
+
+#define MAX_DEV         256
+#define NBUCKET         12
+#define BATCH           256
+
+struct reader {
+    pthread_t tid;
+    int fd;
+    int cpu;
+    unsigned long long events, gaps;
+    unsigned long wake[NBUCKET];
+    unsigned long jitter[NBUCKET];
+};
+
+static uint64_t period;
+static double seconds;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ *[0, 1us)落在第0列，[2^(k-1), 2^k)us落在第k列
+ */
+static int bucket(int64_t ns)
+{
+    uint64_t us = (ns < 0 ? -ns : ns) / 1000;
+    int b = 0;
+
+    while (us && b < NBUCKET - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void *read_work(void *arg)
+{
+    struct reader *r = arg;
+    struct second_event ev[BATCH];
+    uint64_t end, last = 0, expect = 0;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(r->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (ioctl(r->fd, SECOND_IOC_SET_PERIOD, &period)) {
+        perror("SECOND_IOC_SET_PERIOD");
+        return NULL;
+    }
+    end = now_ns() + seconds * 1e9;
+    while (now_ns() < end) {
+        ssize_t ret = read(r->fd, ev, sizeof(ev));
+        uint64_t t = now_ns();
+        long i, n;
+
+        if (ret <= 0) {
+            perror("read");
+            break;
+        }
+        n = ret / sizeof(ev[0]);
+        r->wake[bucket(t - ev[n - 1].ktime_ns)]++;
+        for (i = 0; i < n; i++) {
+            if (last) {
+                r->jitter[bucket((int64_t)(ev[i].ktime_ns - last) - (int64_t)period)]++;
+            }
+            if (expect && ev[i].seq != expect) {
+                r->gaps += ev[i].seq - expect;
+            }
+            last = ev[i].ktime_ns;
+            expect = ev[i].seq + 1;
+        }
+        r->events += n;
+    }
+    return NULL;
+}
+
+static void print_hist(const char *name, struct reader *r, int nr, int jitter)
+{
+    int i, b;
+
+    printf("%s (us)\n%4s", name, "cpu");
+    for (b = 0; b < NBUCKET; b++) {
+        char label[16];
+
+        if (0 == b) {
+            snprintf(label, sizeof(label), "<1");
+        } else {
+            snprintf(label, sizeof(label), "%s%d", NBUCKET - 1 == b ? ">=" : "", 1 << (b - 1));
+        }
+        printf(" %8s", label);
+    }
+    printf("\n");
+    for (i = 0; i < nr; i++) {
+        printf("%4d", r[i].cpu);
+        for (b = 0; b < NBUCKET; b++) {
+            printf(" %8lu", jitter ? r[i].jitter[b] : r[i].wake[b]);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static struct reader r[MAX_DEV];
+    int nr = 0, i;
+
+    period = argc > 1 ? strtoull(argv[1], NULL, 0) : 100000;
+    seconds = argc > 2 ? atof(argv[2]) : 5.0;
+
+    for (nr = 0; nr < MAX_DEV; nr++) {
+        char path[32];
+        __u32 cpu;
+
+        if (0 == nr) {
+            snprintf(path, sizeof(path), "/dev/second");
+        } else {
+            snprintf(path, sizeof(path), "/dev/second_%d", nr);
+        }
+        r[nr].fd = open(path, O_RDONLY);
+        if (-1 == r[nr].fd) {
+            break;
+        }
+        if (ioctl(r[nr].fd, SECOND_IOC_GET_CPU, &cpu)) {
+            perror("SECOND_IOC_GET_CPU");
+            return 1;
+        }
+        r[nr].cpu = cpu;
+    }
+    if (0 == nr) {
+        printf("Device open failure.\n");
+        return 1;
+    }
+
+    printf("second per-cpu jitter, %d devices, period %llu ns, %.1f s\n", nr, (unsigned long long)period, seconds);
+    for (i = 0; i < nr; i++) {
+        pthread_create(&r[i].tid, NULL, read_work, &r[i]);
+    }
+    for (i = 0; i < nr; i++) {
+        pthread_join(r[i].tid, NULL);
+        close(r[i].fd);
+    }
+
+    print_hist("wake latency", r, nr, 0);
+    print_hist("period error", r, nr, 1);
+    printf("%4s %12s %8s\n", "cpu", "events", "gaps");
+    for (i = 0; i < nr; i++) {
+        printf("%4d %12llu %8llu\n", r[i].cpu, r[i].events, r[i].gaps);
+    }
+
+    return 0;
+}
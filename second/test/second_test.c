@@ -1,23 +1,167 @@
-﻿#include <fcntl.h>
+﻿#define _GNU_SOURCE
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include "../src/second.h"
 
-void main(void)
+/*
+ *second计数读取测试
+ *设置周期后等待计数变化，输出每个节拍的唤醒延迟(观察到计数变化的时刻减去该节拍的理论到期时刻，纳秒)
+ *以及整个测试期间进程的CPU占用率。等待方式:
+ *  read    阻塞read，计数不变时在驱动中睡眠
+ *  poll    poll等待可读后用O_NONBLOCK的read取计数
+ *  sigio   O_ASYNC异步通知，sigwaitinfo等待SIGIO后读取
+ *理论到期时刻按设置周期的时刻加上整数个周期计算，设置周期的ioctl本身的耗时也计入延迟。
+ *周期不小于10ms时逐个节拍打印，否则只打印汇总。
+ *
+ *用法: second_test [周期(微秒)] [节拍数] [read|poll|sigio] [设备文件]
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ *等待计数变化，返回新的计数，出错返回-1
+ */
+static int wait_tick(int fd, int mode, sigset_t *sigs)
 {
-    int fd;
-    int counter = 0;
-    int old_counter = 0;
-
-    fd = open("/dev/second", O_RDONLY);
-    if (-1 != fd) {
-        while (1) {
-            read(fd, &counter, sizeof(unsigned int));
-            if (counter != old_counter) {
-                printf("seconds after open /dev/second: %d\n", counter);
-                old_counter = counter;
+    int counter;
+
+    for (;;) {
+        if (1 == mode) {
+            struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+            if (poll(&pfd, 1, -1) < 0) {
+                perror("poll");
+                return -1;
             }
+        } else if (2 == mode) {
+            if (sigwaitinfo(sigs, NULL) < 0) {
+                perror("sigwaitinfo");
+                return -1;
+            }
+        }
+        if (read(fd, &counter, sizeof(counter)) == sizeof(counter)) {
+            return counter;
+        }
+        if (EAGAIN != errno) {
+            perror("read");
+            return -1;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t period = (argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000) * 1000ull;
+    long ticks = argc > 2 ? atol(argv[2]) : 10;
+    const char *mode_name = argc > 3 ? argv[3] : "read";
+    const char *path = argc > 4 ? argv[4] : "/dev/second";
+    const char *modes[] = { "read", "poll", "sigio" };
+    int64_t *lat;
+    sigset_t sigs;
+    uint64_t start, cpu, wall;
+    long n = 0, missed = 0;
+    int fd, mode, counter, base, old;
+
+    for (mode = 0; mode < 3; mode++) {
+        if (0 == strcmp(mode_name, modes[mode])) {
+            break;
         }
-    } else {
+    }
+    if (3 == mode || ticks <= 0) {
+        printf("usage: %s [period_us] [ticks] [read|poll|sigio] [device]\n", argv[0]);
+        return 1;
+    }
+
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (-1 == fd) {
         printf("Device open failure.\n");
+        return 1;
+    }
+
+    if (2 == mode) {    /*SIGIO保持阻塞，由sigwaitinfo同步接收*/
+        sigemptyset(&sigs);
+        sigaddset(&sigs, SIGIO);
+        sigprocmask(SIG_BLOCK, &sigs, NULL);
+        fcntl(fd, F_SETOWN, getpid());
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC);
+    }
+
+    /*设置周期前的计数作为基准，设置后第k个节拍的理论到期时刻为start + k * period*/
+    base = read(fd, &counter, sizeof(counter)) == sizeof(counter) ? counter : 0;
+    if (ioctl(fd, SECOND_IOC_SET_PERIOD, &period)) {
+        perror("SECOND_IOC_SET_PERIOD");
+        return 1;
+    }
+    start = now_ns();
+    cpu = cpu_ns();
+    if (0 == mode) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    }
+
+    lat = malloc(ticks * sizeof(*lat));
+    old = base;
+    while (n < ticks) {
+        uint64_t t;
+
+        counter = wait_tick(fd, mode, &sigs);
+        t = now_ns();
+        if (-1 == counter) {
+            break;
+        }
+        missed += counter - old - 1;
+        old = counter;
+        lat[n] = (int64_t)(t - start) - (int64_t)(period * (counter - base));
+        if (period >= 10000000) {
+            printf("seconds after open %s: %d, wake latency %lld ns\n", path, counter, (long long)lat[n]);
+        }
+        n++;
     }
+    wall = now_ns() - start;
+    cpu = cpu_ns() - cpu;
+    close(fd);
+
+    if (0 == n) {
+        free(lat);
+        return 1;
+    }
+    qsort(lat, n, sizeof(lat[0]), cmp_i64);
+    printf("%s: period %llu ns, %ld ticks, %ld missed\n", modes[mode], (unsigned long long)period, n, missed);
+    printf("wake latency (ns): min %lld p50 %lld p99 %lld max %lld\n", (long long)lat[0], (long long)lat[n / 2],
+           (long long)lat[n * 99 / 100], (long long)lat[n - 1]);
+    printf("cpu usage: %.3f s cpu / %.3f s wall = %.2f%%\n", cpu / 1e9, wall / 1e9, 100.0 * cpu / wall);
+    free(lat);
+
+    return 0;
 }